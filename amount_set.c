@@ -24,33 +24,88 @@ typedef struct set_Container{
     struct set_Container* next_container;
 } *SetContainer;
 
+/**
+ * SetStore
+ *
+ * This is an internal struct implemented to be used by the AmountSet struct.
+ * It holds the containers of an AmountSet. asCopy shares the store of a set
+ * with the copy, and a set that shares its store copies it before it is
+ * changed.
+ *  @param first_AS_container - A dummy container, before the first container.
+ *  @param size_of_Set - The number of elements in the store.
+ *  @param references - The number of sets that share the store.
+ */
+typedef struct set_Store{
+    SetContainer first_AS_container;
+    int size_of_Set;
+    int references;
+} *SetStore;
+
 struct AmountSet_t{
     CopyASElement copyElement;
     FreeASElement freeElement;
     CompareASElements compareElements;
-    SetContainer first_AS_container;
+    SetStore store;
     SetContainer iterator;
-    int size_of_Set;
 };
 
 /**
  * freeElements: frees all of the space the elements and containers of a
- * specific AmountSet occupie, except for the dummy container.
+ * specific store occupie, except for the dummy container.
  *
- * @param set - An AmountSet which we want to free the space all of its elements
+ * @param set - An AmountSet that uses the store, whose free function is used.
+ * @param store - The store which we want to free the space all of its elements
  * occupie.
  */
-static void freeElements(AmountSet set){
-    if(!set ||!set->first_AS_container){
-        return;
-    }
-
-    while((set->first_AS_container->next_container)!=NULL){
-        SetContainer tmp=set->first_AS_container->next_container;
-        set->first_AS_container->next_container=(tmp->next_container);
+static void freeElements(AmountSet set, SetStore store){
+    while((store->first_AS_container->next_container)!=NULL){
+        SetContainer tmp=store->first_AS_container->next_container;
+        store->first_AS_container->next_container=(tmp->next_container);
         set->freeElement(tmp->element);
         free(tmp);
     }
+    store->size_of_Set=0;
+}
+
+/**
+ * createStore: allocates a new empty store, used by a single set.
+ *
+ * @return
+ *     NULL - if a memory allocation failed.
+ *     A new store otherwise.
+ */
+static SetStore createStore(){
+    SetStore store=malloc(sizeof(*store));
+    if(!store){
+        return NULL;
+    }
+    SetContainer dummy_container= malloc(sizeof(*dummy_container));
+    if(!dummy_container){
+        free(store);
+        return NULL;
+    }
+    dummy_container->quantity=0;
+    dummy_container->next_container=NULL;
+    dummy_container->element=NULL;
+    store->first_AS_container=dummy_container;
+    store->size_of_Set=0;
+    store->references=1;
+    return store;
+}
+
+/**
+ * releaseStore: stops a set from using its store. The store is freed when the
+ * last set that uses it releases it.
+ *
+ * @param set - The set that releases its store.
+ */
+static void releaseStore(AmountSet set){
+    SetStore store=set->store;
+    if(__atomic_sub_fetch(&store->references,1,__ATOMIC_ACQ_REL)==0){
+        freeElements(set,store);
+        free(store->first_AS_container);
+        free(store);
+    }
 }
 
 /**
@@ -74,11 +129,75 @@ static SetContainer copySetContainer(AmountSet set, SetContainer container){
         free(container_copy);
         return NULL;
     }
-    container_copy->quantity = container->quantity;
+    __atomic_load(&container->quantity,&container_copy->quantity,
+            __ATOMIC_ACQUIRE);
     container_copy->next_container = NULL;
     return container_copy;
 }
 
+/**
+ * copyStore: copies the store of a set, and all the elements in it.
+ *
+ * @param set - The set whose store is copied.
+ * @param iterator - A container in the store, or NULL.
+ * @param iterator_copy - Set to the copy of iterator, if it is not NULL.
+ * @return
+ *     NULL - if a memory allocation failed.
+ *     A copy of the store, used by a single set, otherwise.
+ */
+static SetStore copyStore(AmountSet set, SetContainer iterator,
+                          SetContainer* iterator_copy){
+    SetStore store_copy=createStore();
+    if(!store_copy){
+        return NULL;
+    }
+    SetContainer tmp = set->store->first_AS_container->next_container;
+    SetContainer current_container_of_copy=store_copy->first_AS_container;
+
+    while (tmp){
+        current_container_of_copy->next_container=copySetContainer(set,tmp);
+        //check if allocation failed
+        if(!current_container_of_copy->next_container){
+            freeElements(set,store_copy);
+            free(store_copy->first_AS_container);
+            free(store_copy);
+            return NULL;
+        }
+        if(tmp==iterator){
+            *iterator_copy=current_container_of_copy->next_container;
+        }
+        tmp=tmp->next_container;
+        current_container_of_copy=current_container_of_copy->next_container;
+    }
+    store_copy->size_of_Set=set->store->size_of_Set;
+    return store_copy;
+}
+
+/**
+ * makeStoreExclusive: makes sure that a set is the only one that uses its
+ * store, before the set or its elements are changed. If the store is shared,
+ * the set gets a copy of it, and the iterator is moved to the copy.
+ *
+ * @param set - The set that is about to be changed.
+ * @return
+ *     false - if the store is shared, and copying it failed.
+ *     true - otherwise.
+ */
+static bool makeStoreExclusive(AmountSet set){
+    if(__atomic_load_n(&set->store->references,__ATOMIC_ACQUIRE)==1){
+        return true;
+    }
+    SetContainer iterator=NULL;
+    SetStore store_copy=copyStore(set,set->iterator,&iterator);
+    if(!store_copy){
+        return false;
+    }
+    releaseStore(set);
+    set->store=store_copy;
+    set->iterator=iterator;
+    return true;
+}
+
 AmountSet asCreate(CopyASElement copyElement,
                    FreeASElement freeElement,
                    CompareASElements compareElements){
@@ -89,30 +208,22 @@ AmountSet asCreate(CopyASElement copyElement,
     if(set==NULL){
         return NULL;
     }
-    SetContainer dummy_container= malloc(sizeof(*dummy_container));
-    if(!dummy_container){
+    set->store=createStore();
+    if(!set->store){
         free(set);
         return NULL;
     }
-
-    dummy_container->quantity=0;
-    dummy_container->next_container=NULL;
-    dummy_container->element=NULL;
     set->copyElement= copyElement;
     set->compareElements= compareElements;
     set->freeElement= freeElement;
-    set->first_AS_container= dummy_container;
     set->iterator=NULL;
-    set->size_of_Set=0;
 
     return set;
 }
 
 void asDestroy(AmountSet set) {
     if(set!=NULL){
-        freeElements(set);
-        SetContainer tmp=set->first_AS_container;
-        free(tmp);
+        releaseStore(set);
         free(set);
     }
 }
@@ -125,36 +236,39 @@ AmountSet asCopy(AmountSet set){
     if(set_copy == NULL){
         return NULL;
     }
-    SetContainer dummy_container_copy = malloc(sizeof(*dummy_container_copy));
-    if(!dummy_container_copy){
-        free(set_copy);
-        return NULL;
-    }
-    dummy_container_copy->quantity=0;
-    dummy_container_copy->next_container=NULL;
     set_copy->copyElement = set->copyElement;
     set_copy->compareElements = set->compareElements;
     set_copy->freeElement = set->freeElement;
-    set_copy->first_AS_container = dummy_container_copy;
+    set_copy->store = set->store;
+    __atomic_add_fetch(&set->store->references,1,__ATOMIC_ACQ_REL);
     set_copy->iterator = NULL;
-    set_copy->size_of_Set = 0;
+    return set_copy;
+}
 
-    SetContainer tmp = set->first_AS_container->next_container;
-    SetContainer current_container_of_copy=set_copy->first_AS_container;
+AmountSetResult asDetach(AmountSet set){
+    if(!set){
+        return AS_NULL_ARGUMENT;
+    }
+    return makeStoreExclusive(set) ? AS_SUCCESS : AS_OUT_OF_MEMORY;
+}
 
-    while (tmp){
-        current_container_of_copy->next_container=copySetContainer(set,tmp);
-        //check if allocation failed
-        if(!current_container_of_copy->next_container){
-            asDestroy(set_copy);
-            return NULL;
-        }
-        tmp=tmp->next_container;
-        current_container_of_copy=current_container_of_copy->next_container;
+AmountSet asCopyDeep(AmountSet set){
+    if(!set){
+        return NULL;
+    }
+    AmountSet set_copy = malloc(sizeof(*set_copy));
+    if(set_copy == NULL){
+        return NULL;
+    }
+    set_copy->copyElement = set->copyElement;
+    set_copy->compareElements = set->compareElements;
+    set_copy->freeElement = set->freeElement;
+    set_copy->store = copyStore(set,NULL,NULL);
+    if(!set_copy->store){
+        free(set_copy);
+        return NULL;
     }
     set_copy->iterator = NULL;
-    set->iterator = NULL;
-    set_copy->size_of_Set=set->size_of_Set;
     return set_copy;
 }
 
@@ -162,7 +276,7 @@ int asGetSize(AmountSet set){
     if(set == NULL){
         return NULL_WAS_SENT_GETSIZE;
     }
-    return set->size_of_Set;
+    return set->store->size_of_Set;
 }
 
 bool asContains(AmountSet set, ASElement element)
@@ -170,7 +284,8 @@ bool asContains(AmountSet set, ASElement element)
     if(!set || !element){
         return false;
     }
-    SetContainer current_container=set->first_AS_container->next_container;
+    SetContainer current_container=
+            set->store->first_AS_container->next_container;
     while (current_container){
         if(set->compareElements(current_container->element,element)
         ==ELEMENTS_ARE_EQUAL){
@@ -190,10 +305,10 @@ AmountSetResult asGetAmount(AmountSet set, ASElement element,double *outAmount){
     if(!asContains(set,element)){
         return AS_ITEM_DOES_NOT_EXIST;
     }
-    SetContainer tmp = set->first_AS_container->next_container;
+    SetContainer tmp = set->store->first_AS_container->next_container;
     while (tmp){
         if(set->compareElements(tmp->element,element)==ELEMENTS_ARE_EQUAL){
-            *outAmount=tmp->quantity;
+            __atomic_load(&tmp->quantity,outAmount,__ATOMIC_ACQUIRE);
             break;
         }
         tmp=tmp->next_container;
@@ -209,6 +324,9 @@ AmountSetResult asRegister(AmountSet set, ASElement element){
     if(asContains(set,element)){
         return  AS_ITEM_ALREADY_EXISTS;
     }
+    if(!makeStoreExclusive(set)){
+        return AS_OUT_OF_MEMORY;
+    }
     SetContainer new_container= malloc(sizeof(*new_container));
     if(!new_container){
         return AS_OUT_OF_MEMORY;
@@ -220,13 +338,14 @@ AmountSetResult asRegister(AmountSet set, ASElement element){
         return AS_OUT_OF_MEMORY;
     }
     new_container->next_container=NULL;
-    set->size_of_Set=set->size_of_Set+1; //added an element to the AmountSet
+    //added an element to the AmountSet
+    set->store->size_of_Set=set->store->size_of_Set+1;
 
-    if(!(set->first_AS_container->next_container)){
-        set->first_AS_container->next_container=new_container;
+    if(!(set->store->first_AS_container->next_container)){
+        set->store->first_AS_container->next_container=new_container;
         return  AS_SUCCESS;
     }
-    SetContainer tmp= set->first_AS_container;
+    SetContainer tmp= set->store->first_AS_container;
     while(tmp->next_container){
         if(set->compareElements((tmp->next_container)->element,element)>0){
             new_container->next_container=tmp->next_container;
@@ -248,7 +367,10 @@ AmountSetResult asChangeAmount(AmountSet set, ASElement element,
     if(!asContains(set,element)){
         return AS_ITEM_DOES_NOT_EXIST;
     }
-    SetContainer tmp = set->first_AS_container->next_container;
+    if(!makeStoreExclusive(set)){
+        return AS_OUT_OF_MEMORY;
+    }
+    SetContainer tmp = set->store->first_AS_container->next_container;
     while (tmp){
         if(set->compareElements(tmp->element,element)==ELEMENTS_ARE_EQUAL){
             if((tmp->quantity)+amount<MIN_AMOUNT){
@@ -272,7 +394,10 @@ AmountSetResult asDelete(AmountSet set, ASElement element){
     if(!asContains(set,element)){
         return AS_ITEM_DOES_NOT_EXIST;
     }
-    SetContainer tmp1= set->first_AS_container;
+    if(!makeStoreExclusive(set)){
+        return AS_OUT_OF_MEMORY;
+    }
+    SetContainer tmp1= set->store->first_AS_container;
     SetContainer tmp2=NULL;
 
     while (set->compareElements(tmp1->next_container->element,element)
@@ -285,7 +410,7 @@ AmountSetResult asDelete(AmountSet set, ASElement element){
     set->freeElement(tmp1->next_container->element);
     free(tmp1->next_container);
     tmp1->next_container=tmp2;
-    set->size_of_Set=(set->size_of_Set)-1;
+    set->store->size_of_Set=(set->store->size_of_Set)-1;
     return AS_SUCCESS;
 }
 
@@ -293,17 +418,26 @@ AmountSetResult asClear(AmountSet set){
     if(!set){
         return AS_NULL_ARGUMENT;
     }
-    freeElements(set);
-    set->size_of_Set=0;
+    set->iterator=NULL;
+    if(__atomic_load_n(&set->store->references,__ATOMIC_ACQUIRE)==1){
+        freeElements(set,set->store);
+        return AS_SUCCESS;
+    }
+    // a shared store is left to the other sets, instead of being copied
+    SetStore empty_store=createStore();
+    if(!empty_store){
+        return AS_OUT_OF_MEMORY;
+    }
+    releaseStore(set);
+    set->store=empty_store;
     return AS_SUCCESS;
 }
 
 ASElement asGetFirst(AmountSet set){
-    if( !set || !(set ->first_AS_container)
-                       || !(set->first_AS_container->next_container)){
+    if( !set || !(set->store->first_AS_container->next_container)){
         return NULL;
     }
-    set->iterator=set->first_AS_container->next_container;
+    set->iterator=set->store->first_AS_container->next_container;
     return set->iterator->element;
 }
 
@@ -314,3 +448,54 @@ ASElement asGetNext(AmountSet set){
     set->iterator=set->iterator->next_container;
     return set->iterator->element;
 }
+
+
+ASCursor asCursorFirst(AmountSet set){
+    if(!set){
+        return NULL;
+    }
+    return set->store->first_AS_container->next_container;
+}
+
+ASCursor asCursorNext(ASCursor cursor){
+    if(!cursor){
+        return NULL;
+    }
+    return cursor->next_container;
+}
+
+ASElement asCursorGetElement(ASCursor cursor){
+    if(!cursor){
+        return NULL;
+    }
+    return cursor->element;
+}
+
+AmountSetResult asCursorGetAmount(ASCursor cursor, double *outAmount){
+    if(!cursor || !outAmount){
+        return AS_NULL_ARGUMENT;
+    }
+    __atomic_load(&cursor->quantity,outAmount,__ATOMIC_ACQUIRE);
+    return AS_SUCCESS;
+}
+
+AmountSetResult asCursorChangeAmount(ASCursor cursor, const double amount){
+    if(!cursor){
+        return AS_NULL_ARGUMENT;
+    }
+    if((cursor->quantity)+amount<MIN_AMOUNT){
+        return AS_INSUFFICIENT_AMOUNT;
+    }
+    cursor->quantity=cursor->quantity+amount;
+    return AS_SUCCESS;
+}
+
+bool asCursorCompareAndSwapAmount(ASCursor cursor, double *expected,
+                                  const double desired){
+    if(!cursor || !expected){
+        return false;
+    }
+    double new_amount=desired;
+    return __atomic_compare_exchange(&cursor->quantity,expected,&new_amount,
+            false,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE);
+}
\ No newline at end of file
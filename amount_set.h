@@ -17,7 +17,9 @@
  * The following functions are available:
  *   asCreate           - Creates a new empty set
  *   asDestroy          - Deletes an existing set and frees all resources
- *   asCopy             - Copies an existing set
+ *   asCopy             - Copies an existing set, in constant time
+ *   asCopyDeep         - Copies an existing set and all its elements
+ *   asDetach           - Stops a copied set from sharing its elements
  *   asGetSize          - Returns the size of the set
  *   asContains         - Checks if an element exists in the set
  *   asGetAmount         - Returns the amount of an element in the set
@@ -30,11 +32,27 @@
  *   asGetNext          - Advances the internal iterator to the next element
  *                        and returns it.
  *   AS_FOREACH         - A macro for iterating over the set's elements
+ *   asCursorFirst      - Returns an external cursor to the first element
+ *   asCursorNext       - Returns a cursor to the element after a given cursor
+ *   asCursorGetElement - Returns the element a cursor points to
+ *   asCursorGetAmount  - Returns the amount of the element a cursor points to
+ *   asCursorChangeAmount - Changes the amount of the element a cursor points to
+ *   asCursorCompareAndSwapAmount - Atomically replaces the amount of the
+ *                      element a cursor points to, if it was not changed
+ *   AS_CURSOR_FOREACH  - A macro for iterating over the set with a cursor
  */
 
 /** Type for defining the set */
 typedef struct AmountSet_t *AmountSet;
 
+/**
+ * Type for an external position inside a set.
+ * A cursor is independent of the set's internal iterator, so several cursors
+ * (on the same set or on different sets) can be used at the same time.
+ * A cursor stays valid as long as its element is not deleted from the set.
+ */
+typedef struct set_Container *ASCursor;
+
 /** Type used for returning error codes from amount set functions */
 typedef enum AmountSetResult_t {
     AS_SUCCESS = 0,
@@ -91,7 +109,17 @@ void asDestroy(AmountSet set);
 /**
  * asCopy: Creates a copy of target set.
  *
- * Iterator values for both sets are undefined after this operation.
+ * The copy shares the elements of set until one of the sets is changed: the
+ * first call to asRegister, asChangeAmount, asDelete or asDetach on either set
+ * copies its elements then, and may fail for lack of memory. So copying a set
+ * takes constant time, and a copy that is only read, or is destroyed before it
+ * is changed, is never copied. Reading a set never copies it, so the elements
+ * and cursors a set that shares its elements returns must not be used to
+ * change it - call asDetach first. A set that shares its elements must not be
+ * changed while another thread uses one of the sets.
+ *
+ * The iterator of the copy is undefined after this operation. The iterator of
+ * the target set is unchanged, so a set can be copied while it is iterated.
  *
  * @param set - Target set.
  * @return
@@ -100,6 +128,41 @@ void asDestroy(AmountSet set);
  */
 AmountSet asCopy(AmountSet set);
 
+/**
+ * asCopyDeep: Creates a copy of target set, and copies all its elements right
+ * away.
+ *
+ * Unlike a copy made by asCopy, such a copy never shares its elements, so it
+ * is suitable for a copy that several threads read at the same time, or for a
+ * set that is changed in place while it is copied.
+ * The iterator of the copy is undefined after this operation. The iterator of
+ * the target set is unchanged.
+ *
+ * @param set - Target set.
+ * @return
+ *     NULL if a NULL was sent or a memory allocation failed.
+ *     An amount set containing copies of the elements (and amounts) of set,
+ *     otherwise.
+ */
+AmountSet asCopyDeep(AmountSet set);
+
+/**
+ * asDetach: Makes sure a set does not share its elements with a copy
+ * (@see asCopy), by copying them if it does.
+ *
+ * Call this before changing the elements or amounts of a set through the
+ * elements and cursors it returns, if the set may have been copied by asCopy.
+ * Cursors returned before this operation are not valid after it.
+ *
+ * @param set - Target set.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_OUT_OF_MEMORY - if the set shares its elements, and copying them
+ *         failed. The set still shares its elements then.
+ *     AS_SUCCESS - if the set does not share its elements.
+ */
+AmountSetResult asDetach(AmountSet set);
+
 /**
  * asGetSize: Returns the number of elements in a set.
  *
@@ -167,6 +230,7 @@ AmountSetResult asGetAmount(AmountSet set, ASElement element, double *outAmount)
  * @return
  *     AS_NULL_ARGUMENT - if a NULL argument was passed.
  *     AS_ITEM_ALREADY_EXISTS - if an equal element already exists in the set.
+ *     AS_OUT_OF_MEMORY - if a memory allocation failed.
  *     AS_SUCCESS - if the element was added successfully.
  */
 AmountSetResult asRegister(AmountSet set, ASElement element);
@@ -184,6 +248,8 @@ AmountSetResult asRegister(AmountSet set, ASElement element);
  * @return
  *     AS_NULL_ARGUMENT - if a NULL argument was passed.
  *     AS_ITEM_DOES_NOT_EXIST - if the element doesn't exist in the set.
+ *     AS_OUT_OF_MEMORY - if the set shares its elements (@see asCopy), and
+ *         copying them failed.
  *     AS_INSUFFICIENT_AMOUNT - if amount is negative and the element's amount
  *         in the set is less than the amount that needs to be decreased (i.e.,
  *         if the change will result in a negative amount for the element in the
@@ -209,6 +275,8 @@ AmountSetResult asChangeAmount(AmountSet set, ASElement element, const double am
  * @return
  *     AS_NULL_ARGUMENT - if a NULL argument was passed.
  *     AS_ITEM_DOES_NOT_EXIST - if the element doesn't exist in the set.
+ *     AS_OUT_OF_MEMORY - if the set shares its elements (@see asCopy), and
+ *         copying them failed.
  *     AS_SUCCESS - if the element was deleted successfully.
  */
 AmountSetResult asDelete(AmountSet set, ASElement element);
@@ -222,6 +290,8 @@ AmountSetResult asDelete(AmountSet set, ASElement element);
  * @param set - Target set to delete all elements from.
  * @return
  *     AS_NULL_ARGUMENT - if a NULL pointer was sent.
+ *     AS_OUT_OF_MEMORY - if the set shares its elements (@see asCopy), and
+ *         allocating a new empty set failed.
  *     AS_SUCCESS - Otherwise.
  */
 AmountSetResult asClear(AmountSet set);
@@ -259,4 +329,104 @@ ASElement asGetNext(AmountSet set);
  */
 #define AS_FOREACH(type, iterator, set) for(type iterator = (type) asGetFirst(set) ;iterator ;iterator = asGetNext(set))
 
+/**
+ * asCursorFirst: Returns a cursor to the first element in the set.
+ *
+ * Several threads may call this function on the same set at the same time, as
+ * long as it is not changed meanwhile. The cursor stays valid until the set is
+ * changed.
+ * Iterator's state is unchanged after this operation.
+ *
+ * @param set - The set to get a cursor into.
+ * @return
+ *     NULL if a NULL pointer was sent or the set is empty.
+ *     A cursor to the first element of the set otherwise.
+ */
+ASCursor asCursorFirst(AmountSet set);
+
+/**
+ * asCursorNext: Returns a cursor to the element that follows the element
+ * pointed to by the given cursor.
+ *
+ * Iterator's state is unchanged after this operation.
+ *
+ * @param cursor - A valid cursor into a set.
+ * @return
+ *     NULL if a NULL pointer was sent or the cursor points to the last element.
+ *     A cursor to the next element of the set otherwise.
+ */
+ASCursor asCursorNext(ASCursor cursor);
+
+/**
+ * asCursorGetElement: Returns the element pointed to by a cursor.
+ *
+ * @param cursor - A valid cursor into a set.
+ * @return
+ *     NULL if a NULL pointer was sent.
+ *     The element pointed to by the cursor otherwise.
+ */
+ASElement asCursorGetElement(ASCursor cursor);
+
+/**
+ * asCursorGetAmount: Returns the amount of the element pointed to by a cursor.
+ *
+ * Unlike asGetAmount, no search is done - the operation takes constant time.
+ *
+ * @param cursor - A valid cursor into a set.
+ * @param outAmount - Pointer to the location where the amount is returned, in
+ *     case of success. In case of failure, the contents of outAmount are
+ *     unchanged.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_SUCCESS - if the amount was returned successfully.
+ */
+AmountSetResult asCursorGetAmount(ASCursor cursor, double *outAmount);
+
+/**
+ * asCursorChangeAmount: Increase or decrease the amount of the element pointed
+ * to by a cursor.
+ *
+ * Behaves like asChangeAmount, but takes constant time. If the set may share
+ * its elements (@see asCopy), asDetach must be called before the cursor is
+ * taken.
+ * Iterator's state is unchanged after this operation.
+ *
+ * @param cursor - A valid cursor into a set.
+ * @param amount - How much to change the element's amount.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_INSUFFICIENT_AMOUNT - if the change will result in a negative amount
+ *         for the element in the set.
+ *     AS_SUCCESS - if the element's amount was changed successfully.
+ */
+AmountSetResult asCursorChangeAmount(ASCursor cursor, const double amount);
+
+/**
+ * asCursorCompareAndSwapAmount: Atomically sets the amount of the element
+ * pointed to by a cursor, only if it still equals an expected amount.
+ *
+ * Several threads may call this function and asCursorGetAmount or asGetAmount
+ * on the same set at the same time, as long as no other function changes the
+ * set meanwhile. The new amount is not checked, so it is up to the caller to
+ * keep it from being negative. If the set may share its elements
+ * (@see asCopy), asDetach must be called before the cursor is taken.
+ *
+ * @param cursor - A valid cursor into a set.
+ * @param expected - Pointer to the amount the element is expected to have.
+ *     If the element has another amount, it is written there instead.
+ * @param desired - The new amount of the element.
+ * @return
+ *     false - if a NULL argument was passed, or the element's amount was not
+ *         the expected one.
+ *     true - if the element's amount was changed successfully.
+ */
+bool asCursorCompareAndSwapAmount(ASCursor cursor, double *expected,
+                                  const double desired);
+
+/**
+ * Macro for iterating over a set with a cursor.
+ * Declares a new cursor for the loop. The set's internal iterator is not used.
+ */
+#define AS_CURSOR_FOREACH(cursor, set) for(ASCursor cursor = asCursorFirst(set) ;cursor ;cursor = asCursorNext(cursor))
+
 #endif /* AMOUNT_SET_H_ */
@@ -11,5 +11,8 @@ int main() {
     RUN_TEST(testContains);
     RUN_TEST(testGetAmount);
     RUN_TEST(testIteration);
+    RUN_TEST(testCursor);
+    RUN_TEST(testCursorCompareAndSwap);
+    RUN_TEST(testCopyOnWrite);
     return 0;
 }
\ No newline at end of file
@@ -138,3 +138,95 @@ bool testIteration() {
     asDestroy(set);
     return true;
 }
+
+bool testCursor() {
+    AmountSet set = asCreate(copyInt, freeInt, compareInts);
+    addElements(set);
+    int lastId = -1;
+    double amount = -1.0;
+    AS_CURSOR_FOREACH(cursor, set) {
+        int *currId = asCursorGetElement(cursor);
+        ASSERT_OR_DESTROY(lastId < (*currId));
+        lastId = *currId;
+        if (*currId == 2) {
+            ASSERT_OR_DESTROY(asCursorGetAmount(cursor, &amount) == AS_SUCCESS);
+            ASSERT_OR_DESTROY(-0.001 < amount - 10.5 && amount - 10.5 < 0.001);
+            ASSERT_OR_DESTROY(asCursorChangeAmount(cursor, -11) == AS_INSUFFICIENT_AMOUNT);
+            ASSERT_OR_DESTROY(asCursorChangeAmount(cursor, -0.5) == AS_SUCCESS);
+        }
+    }
+    ASSERT_OR_DESTROY(lastId == 7);
+    int x = 2;
+    ASSERT_OR_DESTROY(asGetAmount(set, &x, &amount) == AS_SUCCESS);
+    ASSERT_OR_DESTROY(-0.001 < amount - 10 && amount - 10 < 0.001);
+    ASSERT_OR_DESTROY(asCursorFirst(NULL) == NULL);
+    asDestroy(set);
+    return true;
+}
+
+bool testCursorCompareAndSwap() {
+    AmountSet set = asCreate(copyInt, freeInt, compareInts);
+    addElements(set);
+    ASCursor cursor = asCursorNext(asCursorNext(asCursorFirst(set)));
+    ASSERT_OR_DESTROY(*(int *)asCursorGetElement(cursor) == 2);
+    double expected = 0;
+    ASSERT_OR_DESTROY(!asCursorCompareAndSwapAmount(cursor, &expected, 3));
+    ASSERT_OR_DESTROY(expected == 10.5);
+    ASSERT_OR_DESTROY(asCursorCompareAndSwapAmount(cursor, &expected, 3));
+    int x = 2;
+    double amount = -1.0;
+    ASSERT_OR_DESTROY(asGetAmount(set, &x, &amount) == AS_SUCCESS);
+    ASSERT_OR_DESTROY(amount == 3);
+    ASSERT_OR_DESTROY(!asCursorCompareAndSwapAmount(NULL, &expected, 3));
+    ASSERT_OR_DESTROY(!asCursorCompareAndSwapAmount(cursor, NULL, 3));
+    asDestroy(set);
+    return true;
+}
+
+static int copiedInts = 0;
+
+static ASElement countedCopyInt(ASElement number) {
+    copiedInts++;
+    return copyInt(number);
+}
+
+bool testCopyOnWrite() {
+    AmountSet set = asCreate(countedCopyInt, freeInt, compareInts);
+    addElements(set);
+    copiedInts = 0;
+    AmountSet copy = asCopy(set);
+    AmountSet deepCopy = asCopyDeep(set);
+    ASSERT_TEST_WITH_FREE(copy != NULL && deepCopy != NULL,
+                          asDestroy(deepCopy); destroyAmountSets(set, copy));
+    /* the copy shares the elements until one of the sets is changed */
+    int x = 2;
+    double amount = -1.0;
+    bool shared = copiedInts == 7 && asGetSize(copy) == 7 &&
+                  asGetAmount(copy, &x, &amount) == AS_SUCCESS &&
+                  copiedInts == 7;
+    bool changed = asChangeAmount(set, &x, 1) == AS_SUCCESS && copiedInts == 14 &&
+                   asGetAmount(copy, &x, &amount) == AS_SUCCESS &&
+                   -0.001 < amount - 10.5 && amount - 10.5 < 0.001;
+    /* a copy made during an iteration goes on from the same element, and
+     * reading the sets does not copy their elements */
+    int iterated = 0;
+    AS_FOREACH(int*, currId, copy) {
+        if (iterated++ == 1) {
+            asDestroy(deepCopy);
+            deepCopy = asCopy(copy);
+        }
+    }
+    bool iteratedAll = iterated == 7 && copiedInts == 14 &&
+                       asCursorFirst(deepCopy) != NULL && copiedInts == 14 &&
+                       asDetach(deepCopy) == AS_SUCCESS && copiedInts == 21 &&
+                       asDetach(deepCopy) == AS_SUCCESS && copiedInts == 21 &&
+                       asDetach(NULL) == AS_NULL_ARGUMENT &&
+                       asClear(deepCopy) == AS_SUCCESS &&
+                       asGetSize(deepCopy) == 0 && asGetSize(copy) == 7;
+    asDestroy(deepCopy);
+    destroyAmountSets(set, copy);
+    ASSERT_TEST(shared);
+    ASSERT_TEST(changed);
+    ASSERT_TEST(iteratedAll);
+    return true;
+}
@@ -12,5 +12,8 @@ bool testGetSize();
 bool testContains();
 bool testGetAmount();
 bool testIteration();
+bool testCursor();
+bool testCursorCompareAndSwap();
+bool testCopyOnWrite();
 
 #endif /* AMOUNST_SET_TESTS_H_ */
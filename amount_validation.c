@@ -0,0 +1,74 @@
+#include "amount_validation.h"
+
+#define IN_RANGE_OF_MISTAKE 0.001
+#define STEPS_OF_INTEGER 1.0
+#define STEPS_OF_HALF_INTEGER 2.0
+/** 2^52, every double at least as large is a whole number, and adding it to a
+ * smaller non-negative double and subtracting it back rounds that double to
+ * the nearest whole number */
+#define SMALLEST_WHOLE_ONLY 4503599627370496.0
+
+/**
+ * isNearStep: checks whether an amount is within IN_RANGE_OF_MISTAKE of a
+ *             whole number of steps. The nearest step is found by rounding
+ *             instead of by casting to int, so the check holds for every double,
+ *             and the conditions below compile to selects, not branches.
+ *             The magnitude is rounded rather than the signed amount, so the
+ *             sum stays below 2^53, where doubles are still 1 apart.
+ *
+ * @param amount - The amount to check.
+ * @param steps_per_unit - The number of steps in a unit, 1 or 2.
+ *
+ * @return:
+ *      true if the amount is within IN_RANGE_OF_MISTAKE of a step, or too
+ *      large to be anything but a step. false otherwise, and for NaN.
+ */
+static bool isNearStep(const double amount, const double steps_per_unit){
+    double scaled=amount*steps_per_unit;
+    double magnitude=scaled<0 ? -scaled : scaled;
+    bool whole_only=magnitude>=SMALLEST_WHOLE_ONLY;
+    // large amounts are not rounded, the rounding constant does not fit them
+    double small=whole_only ? 0 : magnitude;
+    double nearest_step=(small+SMALLEST_WHOLE_ONLY)-SMALLEST_WHOLE_ONLY;
+    double distance=(magnitude-nearest_step)/steps_per_unit;
+    distance=distance<0 ? -distance : distance;
+    return whole_only | (distance<=IN_RANGE_OF_MISTAKE);
+}
+
+/**
+ * getStepsPerUnit: returns the number of valid steps in a unit of an amount
+ *                  type that is not MATAMAZOM_ANY_AMOUNT.
+ *
+ * @param amountType - The type of amount.
+ *
+ * @return:
+ *      1 for MATAMAZOM_INTEGER_AMOUNT, 2 for MATAMAZOM_HALF_INTEGER_AMOUNT.
+ */
+static double getStepsPerUnit(const MatamazomAmountType amountType){
+    return amountType==MATAMAZOM_HALF_INTEGER_AMOUNT ? STEPS_OF_HALF_INTEGER :
+            STEPS_OF_INTEGER;
+}
+
+bool mtmIsAmountValid(const MatamazomAmountType amountType, const double amount){
+    if(amountType==MATAMAZOM_ANY_AMOUNT){
+        return true;
+    }
+    return isNearStep(amount,getStepsPerUnit(amountType));
+}
+
+void mtmValidateAmounts(const MatamazomAmountType amountType,
+                        const double *amounts, const int n, bool *valid){
+    if(!amounts || !valid){
+        return;
+    }
+    if(amountType==MATAMAZOM_ANY_AMOUNT){
+        for(int i=0;i<n;i++){
+            valid[i]=true;
+        }
+        return;
+    }
+    double steps_per_unit=getStepsPerUnit(amountType);
+    for(int i=0;i<n;i++){
+        valid[i]=isNearStep(amounts[i],steps_per_unit);
+    }
+}
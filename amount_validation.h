@@ -0,0 +1,35 @@
+#ifndef AMOUNT_VALIDATION_H_
+#define AMOUNT_VALIDATION_H_
+
+#include <stdbool.h>
+#include "matamazom.h"
+
+/**
+ * mtmIsAmountValid: check whether an amount is consistent with an amount type,
+ * as described in MatamazomAmountType.
+ *
+ * Any double is accepted: every amount from 2^52 on (in absolute value) is a
+ * whole number, and NaN is only valid for MATAMAZOM_ANY_AMOUNT. The check has
+ * no branches that depend on the amount.
+ *
+ * @param amountType - the type of amount the product may receive.
+ * @param amount - the amount to check.
+ * @return
+ *     true if the amount is valid for the amount type, false otherwise.
+ */
+bool mtmIsAmountValid(const MatamazomAmountType amountType, const double amount);
+
+/**
+ * mtmValidateAmounts: check a whole array of amounts of the same amount type,
+ * as mtmIsAmountValid checks every one of them.
+ *
+ * @param amountType - the type of amount the product may receive.
+ * @param amounts - the n amounts to check.
+ * @param n - the number of amounts.
+ * @param valid - an array of n flags, that is set to whether every amount is
+ *     valid.
+ */
+void mtmValidateAmounts(const MatamazomAmountType amountType,
+                        const double *amounts, const int n, bool *valid);
+
+#endif /* AMOUNT_VALIDATION_H_ */
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include "amount_validation.h"
+
+#define AMOUNTS_NUMBER 4096
+#define ROUNDS_NUMBER 2000
+
+/**
+ * A microbenchmark of the amount validation: every amount type is timed once
+ * with mtmIsAmountValid called for every amount, and once with
+ * mtmValidateAmounts called for the whole array. Half of the amounts are valid
+ * integers, and the rest are random, so the results can not be predicted.
+ */
+
+static double secondsSince(clock_t start){
+    return (double)(clock()-start)/CLOCKS_PER_SEC;
+}
+
+int main(){
+    static double amounts[AMOUNTS_NUMBER];
+    static bool valid[AMOUNTS_NUMBER];
+    srand(39);
+    for(int i=0;i<AMOUNTS_NUMBER;i++){
+        double random=((double)rand()/RAND_MAX-0.5)*2000;
+        amounts[i]=i%2==0 ? (double)(int)random : random;
+    }
+    const char* names[]={"integer","half integer","any"};
+    long long valid_number=0;
+    for(MatamazomAmountType type=MATAMAZOM_INTEGER_AMOUNT;
+                                type<=MATAMAZOM_ANY_AMOUNT;type++){
+        clock_t start=clock();
+        for(int round=0;round<ROUNDS_NUMBER;round++){
+            for(int i=0;i<AMOUNTS_NUMBER;i++){
+                valid_number+=mtmIsAmountValid(type,amounts[i]);
+            }
+        }
+        double scalar_seconds=secondsSince(start);
+        start=clock();
+        for(int round=0;round<ROUNDS_NUMBER;round++){
+            mtmValidateAmounts(type,amounts,AMOUNTS_NUMBER,valid);
+            valid_number+=valid[round%AMOUNTS_NUMBER];
+        }
+        double array_seconds=secondsSince(start);
+        double amounts_number=(double)AMOUNTS_NUMBER*ROUNDS_NUMBER;
+        printf("%-12s  one by one: %.2f ns/amount  array: %.2f ns/amount\n",
+               names[type],scalar_seconds*1e9/amounts_number,
+               array_seconds*1e9/amounts_number);
+    }
+    printf("(%lld valid)\n",valid_number);
+    return 0;
+}
@@ -1,27 +1,301 @@
+#define _POSIX_C_SOURCE 200112L
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <float.h>
+#include <pthread.h>
 #include "amount_set.h"
 #include "matamazom.h"
 #include "set.h"
 #include "matamazom_print.h"
+#include "amount_validation.h"
 
-#define IN_RANGE_OF_MISTAKE 0.001
 #define COMPARE_EQUAL 0
 #define COMPARE_LARGER (-1)
 #define COMPARE_SMALLER 1
-#define INTEGER 1
-#define HALF_INTEGER (0.5)
-#define UNIT 1
+#define QUANTITY_SCALE 1000000LL
+#define UNIT QUANTITY_SCALE
+#define QUANTITY_TOLERANCE 1000LL
+#define QUANTITY_LIMIT 9007199254740992LL
+#define MATAMAZOM_SHARDS_NUMBER 16
+#define ORDER_STRIPES_NUMBER 16
+#define PARALLEL_THREADS_NUMBER 4
+#define PARALLEL_CHUNK_SIZE 64
+#define VALIDATION_CHUNK_SIZE 64
+#define SHARD_HASH_MULTIPLIER 2654435761u
+#define SHARD_HASH_SHIFT 16
+#define PRICE_CACHE_SIZE 8
+#define PRODUCT_TREE_MAX_HEIGHT 48
 
-struct Matamazom_t {
-    AmountSet  list_of_products;
+/**
+ * Quantity
+ *
+ * Amounts of products and incomes are kept as whole numbers of millionths, so
+ * they are validated, compared and summed exactly. Amounts are kept in the
+ * AmountSets as doubles holding those whole numbers, which is exact up to
+ * QUANTITY_LIMIT.
+ */
+typedef long long Quantity;
+
+/**
+ * ProductState
+ *
+ * This is an internal struct implemented to be used by the reports of the
+ * Matamazom warehouse. A product as a report sees it: what changes about a
+ * product is kept here, and the rest is read from the product itself.
+ *
+ * @param product - The product. Its name, id and additional info never change.
+ * @param amount - The amount of the product, in millionths.
+ * @param income - The income of the product, in millionths.
+ * @param unit_price - The price of a single unit of the product.
+ */
+typedef struct product_state{
+    struct product* product;
+    Quantity amount;
+    Quantity income;
+    double unit_price;
+}ProductState;
+
+/**
+ * ProductChange
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse.
+ * A product of a shard that changed since the snapshot of the shard was last
+ * brought up to date.
+ *
+ * @param id - The id of the product.
+ * @param cursor - The product in the shard, or NULL if it was cleared.
+ * @param state - The product as the snapshot sees it, once the change is
+ * taken from the shard.
+ */
+typedef struct product_change{
+    unsigned int id;
+    ASCursor cursor;
+    ProductState state;
+}ProductChange;
+
+/**
+ * Shard
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse.
+ * The products of a warehouse are partitioned between its shards by a hash of
+ * their id.
+ *
+ * @param list_of_products - An AmountSet of the products of the shard and
+ * their amounts.
+ * @param lock - Only used in MATAMAZOM_CONCURRENT mode. Held for reading by
+ * operations that only read the shard, and for writing by everything else.
+ * @param orders_lock - Only used in MATAMAZOM_CONCURRENT mode. Held while the
+ * orders of a product of the shard change by an operation that only holds the
+ * shard's lock for reading.
+ * @param snapshot - The products of the shard as the latest report or version
+ * saw them (@see ProductNode), or NULL if there were none.
+ * @param snapshot_stale - true if the snapshot could not be brought up to
+ * date, so it is taken again from all the products of the shard.
+ * @param tracked - true once a report or version took a snapshot of the
+ * shard, so the changes of its products are recorded from then on.
+ * @param changes - The products that changed since the snapshot was brought
+ * up to date, each of them once, in the order they first changed.
+ * @param changes_number - The number of changes.
+ * @param changes_capacity - The number of changes there is room for.
+ * @param changes_lost - true if a change could not be recorded, so the
+ * snapshot is taken again from all the products of the shard.
+ * @param changes_lock - Only used in MATAMAZOM_CONCURRENT mode. Held while a
+ * change is recorded by an operation that only holds the shard's lock for
+ * reading.
+ */
+typedef struct shard{
+    AmountSet list_of_products;
+    pthread_rwlock_t lock;
+    pthread_mutex_t orders_lock;
+    struct product_node* snapshot;
+    bool snapshot_stale;
+    bool tracked;
+    ProductChange* changes;
+    int changes_number;
+    int changes_capacity;
+    bool changes_lost;
+    pthread_mutex_t changes_lock;
+}*Shard;
+
+/**
+ * OrderStripe
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse.
+ * The open orders of a warehouse are partitioned between its order stripes by
+ * their id.
+ *
+ * @param set_of_orders - A Set of the open orders of the stripe.
+ * @param lock - Only used in MATAMAZOM_CONCURRENT mode. Held while the Set is
+ * searched or changed.
+ */
+typedef struct order_stripe{
     Set set_of_orders;
+    pthread_mutex_t lock;
+}*OrderStripe;
+
+/**
+ * ChangeFeed
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse.
+ * A ring of the last events that were published about the changes of the
+ * warehouse. The event with sequence s is kept at events[s % capacity], until
+ * it is overwritten by the event with sequence s + capacity.
+ *
+ * @param events - The ring of events.
+ * @param capacity - The number of events the ring keeps.
+ * @param next_sequence - The sequence of the next event, which is the number
+ * of events that were published.
+ * @param lock - Only used in MATAMAZOM_CONCURRENT mode. Held while an event is
+ * published or read. It is taken after all the other locks.
+ */
+typedef struct change_feed{
+    MtmEvent* events;
+    unsigned int capacity;
+    unsigned long long next_sequence;
+    pthread_mutex_t lock;
+}*ChangeFeed;
+
+/**
+ * Matamazom_t
+ *
+ * @param shards - The shards holding the products of the warehouse. Only the
+ * first shards_number shards are used.
+ * @param shards_number - The number of shards in use. 1 unless the warehouse
+ * is in MATAMAZOM_SHARDED mode.
+ * @param order_stripes - The stripes holding the open orders. Only the first
+ * order_stripes_number stripes are used.
+ * @param order_stripes_number - The number of order stripes in use. 1 unless
+ * the warehouse is in MATAMAZOM_CONCURRENT mode.
+ * @param current_order_id - The id of the last order that was created.
+ * @param prices_epoch - Increased whenever the prices of a product are
+ * invalidated, which makes the totals of all the orders dirty.
+ * @param reserve_stock - true if the warehouse is in MATAMAZOM_RESERVE_STOCK
+ * mode.
+ * @param concurrent - true if the warehouse is in MATAMAZOM_CONCURRENT mode.
+ * @param change_feed - The change feed of the warehouse, or NULL if it is not
+ * enabled.
+ * @param snapshots_lock - Only used in MATAMAZOM_CONCURRENT mode. Held while
+ * the snapshots of the shards are brought up to date.
+ *
+ * In MATAMAZOM_CONCURRENT mode, locks are always taken in this order: order
+ * stripes in ascending order, then orders, then the snapshots lock, then
+ * shards in ascending order, then the orders lock of a shard, then the changes
+ * lock of a shard, then the change feed.
+ * An order is only locked while holding the lock of its stripe, so removing an
+ * order from its stripe waits for everyone that uses it.
+ */
+struct Matamazom_t {
+    struct shard shards[MATAMAZOM_SHARDS_NUMBER];
+    int shards_number;
+    struct order_stripe order_stripes[ORDER_STRIPES_NUMBER];
+    int order_stripes_number;
     unsigned  int current_order_id;
+    unsigned int prices_epoch;
+    bool reserve_stock;
+    bool concurrent;
+    ChangeFeed change_feed;
+    pthread_mutex_t snapshots_lock;
 };
 
+/**
+ * PriceCacheEntry
+ *
+ * This is an internal struct implemented to be used by the PriceCache.
+ *
+ * @param amount - The amount that was priced, in millionths.
+ * @param price - The price the product's price function returned for it.
+ * @param used - true if the entry holds a price.
+ */
+typedef struct price_cache_entry{
+    Quantity amount;
+    double price;
+    bool used;
+}PriceCacheEntry;
+
+/**
+ * PriceCache
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse.
+ * It remembers the prices of the amounts of a cacheable product that were
+ * recently priced. It is shared by all the copies of the product (in the
+ * warehouse, in orders and in snapshots), and freed with the last of them.
+ *
+ * @param entries - The remembered prices.
+ * @param next_entry - The entry the next price is kept in, entries are
+ * replaced in turn.
+ * @param references - The number of copies of the product that share it.
+ * @param generation - Increased whenever the cache is invalidated, so a price
+ * that was computed before an invalidation is not kept after it.
+ * @param lock - Held while the entries are used, since several threads may
+ * price the product at the same time.
+ */
+typedef struct price_cache{
+    PriceCacheEntry entries[PRICE_CACHE_SIZE];
+    int next_entry;
+    int references;
+    unsigned int generation;
+    pthread_mutex_t lock;
+}*PriceCache;
+
+/**
+ * PriceTiers
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse.
+ * It holds the built-in pricing rule of a product as a table of tiers: every
+ * unit of an amount is priced by the tier it falls in. A linear rule has a
+ * single tier, and "buy N get M free" has a free tier between two paid ones.
+ * Tiers that are not used start at DBL_MAX.
+ *
+ * @param starts - The amount every tier starts from, in ascending order. The
+ * first tier starts from 0.
+ * @param unit_prices - The price of a unit in every tier.
+ */
+typedef struct price_tiers{
+    double starts[MTM_PRICE_RULE_MAX_TIERS];
+    double unit_prices[MTM_PRICE_RULE_MAX_TIERS];
+}PriceTiers;
+
+/** Tiers that price every amount at 0 */
+static const PriceTiers NO_PRICE_TIERS={{0,DBL_MAX,DBL_MAX,DBL_MAX},
+                                        {0,0,0,0}};
+
+/**
+ * InlineData
+ *
+ * This is an internal union implemented to be used by the Matamazom warehouse.
+ * It holds small custom data of a product inside the product, aligned for any
+ * type the data may be made of.
+ */
+typedef union inline_data{
+    double number;
+    long long integer;
+    void* pointer;
+    unsigned char bytes[MTM_INLINE_DATA_SIZE];
+}InlineData;
+
+/**
+ * OrderIndex
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse.
+ * The open orders that have a product, so the product is removed from them
+ * without looking at the other orders.
+ *
+ * @param orders - The orders, as kept in their stripes, sorted by id.
+ * @param size - The number of orders.
+ * @param capacity - The number of orders there is room for.
+ */
+typedef struct order_index{
+    struct order** orders;
+    int size;
+    int capacity;
+}OrderIndex;
+
+/** An index of no orders */
+static const OrderIndex NO_ORDERS={NULL,0,0};
+
 /**
  * Product
  *
@@ -31,28 +305,92 @@ struct Matamazom_t {
  *  @param name - The name of the product.
  *  @param id - A unique identifier to represent the product.
  *  @param income- The total income that the warehouse made by selling this
- *  product.
+ *  product, in millionths.
+ *  @param reserved - The amount of the product that is reserved by open orders,
+ *  in millionths.
+ *  only used in MATAMAZOM_RESERVE_STOCK mode, by the product kept in the
+ *  warehouse.
  *  @param free_function - A pointer to a function to be used to
  *  free additional info.
  *  @param copy_function - A pointer to a function to be used to
  *  copy additional info.
  *  @param get_price_function - A pointer to a function to be used to
  *  get the price of the prodcut.
+ *  @param price_cache - The prices of the product that were already computed,
+ *  or NULL if its price function was not declared cacheable.
+ *  @param unit_price - The price of a single unit of the product, computed
+ *  when the product is added and when its prices are invalidated, for the
+ *  reports that print it.
+ *  @param priced_by_rule - true if the product is priced by a built-in rule
+ *  instead of by get_price_function, which is NULL then.
+ *  @param price_tiers - The built-in rule of the product, if it has one.
+ *  @param get_price_batch_function - A pointer to a function that prices many
+ *  amounts at once, or NULL. If it is not NULL, it prices the product instead
+ *  of get_price_function, which is NULL then.
  *  @param additional info - A pointer to product's additional info.
+ *  @param data_inline - true if the additional info is kept in inline_data,
+ *  and is copied and freed with the product itself. free_function and
+ *  copy_function are NULL then.
+ *  @param inline_data - The additional info of the product, if it is inline.
+ *  @param orders - The open orders that have the product. Only used by the
+ *  product kept in the warehouse, the copies of a product have no orders.
+ *  @param references - The number of holders of the product: its set, and the
+ *  snapshots that share it. The product is freed with the last of them.
+ *  @param change_index - The place of the product in the changes of its shard
+ *  plus one, or 0 if it did not change since the snapshot was brought up to
+ *  date.
  *  @param amount_type - The type of amount that the product may recieve from
  *  the user - INTEGER, HALF_INTEGER or ALL.
  */
 typedef struct product{
     char* name;
     unsigned int id;
-    double income;
+    Quantity income;
+    Quantity reserved;
     MtmFreeData free_function;
     MtmCopyData copy_function;
     MtmProductData additional_info;
     MatamazomAmountType amount_type;
     MtmGetProductPrice  get_price_function;
+    PriceCache price_cache;
+    double unit_price;
+    bool priced_by_rule;
+    PriceTiers price_tiers;
+    MtmGetProductPriceBatch get_price_batch_function;
+    bool data_inline;
+    InlineData inline_data;
+    OrderIndex orders;
+    int references;
+    int change_index;
 }*Product;
 
+/**
+ * ProductNode
+ *
+ * This is an internal struct implemented to be used by the reports of the
+ * Matamazom warehouse. The snapshot of a shard is a balanced search tree of
+ * the states of its products by id, that is never changed once it is built:
+ * a change to a product builds new nodes on the path to it, and shares the
+ * rest of the nodes with the previous snapshot. So snapshots only take memory
+ * for what changed between them, and never copy the products themselves.
+ *
+ * @param state - The product, as the snapshot sees it. A reference is held to
+ * the product.
+ * @param left - The subtree of the products with smaller ids.
+ * @param right - The subtree of the products with larger ids.
+ * @param height - The height of the subtree of the node.
+ * @param size - The number of products in the subtree of the node.
+ * @param references - The number of snapshots and nodes that hold the node.
+ */
+typedef struct product_node{
+    ProductState state;
+    struct product_node* left;
+    struct product_node* right;
+    int height;
+    int size;
+    int references;
+}*ProductNode;
+
 /**
  * Order
  *
@@ -62,10 +400,23 @@ typedef struct product{
  * @param list_of_order_products - An AmountSet of products to keep the
  * products of the order.
  * @param id - A unique identifier to represent the order.
+ * @param lock - Only used in MATAMAZOM_CONCURRENT mode. Held by every
+ * operation that uses the order.
+ * @param total - The total price of the order, in millionths. Every change to
+ * a line of the order adds the difference between the new and the old price of
+ * the line to it.
+ * @param total_dirty - true if total must be computed again from all the lines,
+ * e.g. after a product was removed from the order.
+ * @param prices_epoch - The prices_epoch of the warehouse when total was
+ * computed. If the warehouse's epoch is different, total is dirty as well.
  */
 typedef struct order{
     AmountSet list_of_order_products;
     unsigned int id;
+    pthread_mutex_t lock;
+    Quantity total;
+    bool total_dirty;
+    unsigned int prices_epoch;
 }*Order;
 
 /**
@@ -109,14 +460,63 @@ static int compareProductsForAmountSet(ASElement element1, ASElement element2)
 }
 
 /**
- * freeProducts: frees the data the product has (name and addintional_info)
- * then frees the memory that was allocated for the product.
+ * createPriceCache: creates an empty price cache, with a single reference.
+ *
+ * @return
+ *     NULL - if a memory allocation failed.
+ *     A new price cache otherwise.
+ */
+static PriceCache createPriceCache(){
+    PriceCache cache=malloc(sizeof(*cache));
+    if(!cache){
+        return NULL;
+    }
+    if(pthread_mutex_init(&cache->lock,NULL) != 0){
+        free(cache);
+        return NULL;
+    }
+    for(int i=0;i<PRICE_CACHE_SIZE;i++){
+        cache->entries[i].used=false;
+    }
+    cache->next_entry=0;
+    cache->references=1;
+    cache->generation=0;
+    return cache;
+}
+
+/**
+ * releasePriceCache: drops a reference to a price cache, and frees it once it
+ *                    is not referenced anymore.
+ *
+ * @param cache - The cache to release. If it is NULL nothing is done.
+ */
+static void releasePriceCache(PriceCache cache){
+    if(!cache){
+        return;
+    }
+    if(__atomic_sub_fetch(&cache->references,1,__ATOMIC_ACQ_REL)==0){
+        pthread_mutex_destroy(&cache->lock);
+        free(cache);
+    }
+}
+
+/**
+ * freeProducts: drops a reference to a product. The last reference frees the
+ * data the product has (name and addintional_info) then frees the memory that
+ * was allocated for the product.
  *
  * @param product - The product its data needs to be freed.
  */
 static void freeProduct(Product product){
+    if(__atomic_sub_fetch(&product->references,1,__ATOMIC_ACQ_REL)>0){
+        return;
+    }
+    releasePriceCache(product->price_cache);
+    free(product->orders.orders);
     free(product->name);
-    product->free_function(product->additional_info);
+    if(!product->data_inline && product->additional_info){
+        product->free_function(product->additional_info);
+    }
     free(product);
 }
 
@@ -147,6 +547,13 @@ static Product copyProduct(Product product){
     if(!new_product){
         return NULL;
     }
+    new_product->references=1;
+    new_product->change_index=0;
+    new_product->price_cache=NULL;
+    new_product->data_inline=product->data_inline;
+    new_product->additional_info=NULL;
+    new_product->orders=NO_ORDERS;
+    new_product->free_function=product->free_function;
     new_product->name=malloc(strlen(product->name)+1);
     if(!new_product->name){
         freeProduct(new_product);
@@ -156,11 +563,26 @@ static Product copyProduct(Product product){
     new_product->id=product->id;
     new_product->amount_type=product->amount_type;
     new_product->income=product->income;
+    new_product->reserved=product->reserved;
     new_product->copy_function=product->copy_function;
-    new_product->free_function=product->free_function;
     new_product->get_price_function=product->get_price_function;
-    new_product->additional_info=
-            product->copy_function(product->additional_info);
+    new_product->unit_price=product->unit_price;
+    new_product->priced_by_rule=product->priced_by_rule;
+    new_product->price_tiers=product->price_tiers;
+    new_product->get_price_batch_function=product->get_price_batch_function;
+    // all the copies of a product share its cache
+    new_product->price_cache=product->price_cache;
+    if(new_product->price_cache){
+        __atomic_add_fetch(&new_product->price_cache->references,1,
+                __ATOMIC_RELAXED);
+    }
+    if(product->data_inline){
+        new_product->inline_data=product->inline_data;
+        new_product->additional_info=new_product->inline_data.bytes;
+    } else{
+        new_product->additional_info=
+                product->copy_function(product->additional_info);
+    }
     return new_product;
 }
 
@@ -233,6 +655,7 @@ static void freeOrder(Order order){
         return;
     }
     asDestroy(order->list_of_order_products);
+    pthread_mutex_destroy(&order->lock);
     free(order);
 }
 
@@ -273,12 +696,19 @@ static Order copyOrder(Order order){
     if(!new_Order){
         return NULL;
     }
+    if(pthread_mutex_init(&new_Order->lock,NULL) != 0){
+        free(new_Order);
+        return NULL;
+    }
     new_Order->list_of_order_products=asCopy(order->list_of_order_products);
     if(!new_Order->list_of_order_products){
         freeOrder(new_Order);
         return NULL;
     }
     new_Order->id=order->id;
+    new_Order->total=order->total;
+    new_Order->total_dirty=order->total_dirty;
+    new_Order->prices_epoch=order->prices_epoch;
     return new_Order;
 }
 
@@ -315,7 +745,8 @@ static SetElement copyOrderForSet(SetElement element){
  */
  static Product getProductFromId(AmountSet set, unsigned int productId){
     Product wanted_product = NULL;
-    AS_FOREACH(Product,currentProduct,set){
+    AS_CURSOR_FOREACH(cursor,set){
+        Product currentProduct = asCursorGetElement(cursor);
         if(currentProduct->id == productId){
             wanted_product = currentProduct;
             break;
@@ -327,6 +758,79 @@ static SetElement copyOrderForSet(SetElement element){
     return wanted_product;
 }
 
+/**
+ * findInOrderIndex: finds where an order is, or would be, in an order index,
+ *                   by a binary search.
+ *
+ * @param index - The index to search.
+ * @param orderId - The id of the order.
+ *
+ * @return:
+ *      The position of the first order in the index whose id is not smaller
+ *      than orderId.
+ */
+static int findInOrderIndex(const OrderIndex* index, unsigned int orderId){
+    int low=0;
+    int high=index->size;
+    while(low<high){
+        int middle=low+(high-low)/2;
+        if(index->orders[middle]->id<orderId){
+            low=middle+1;
+        } else{
+            high=middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * addToOrderIndex: adds an order to an order index, if it is not there yet.
+ *
+ * @param index - The index to add to.
+ * @param order - The order, as kept in its stripe.
+ *
+ * @return:
+ *      false - if an allocation failed. The index is not changed then.
+ *      true - otherwise.
+ */
+static bool addToOrderIndex(OrderIndex* index, Order order){
+    int position=findInOrderIndex(index,order->id);
+    if(position<index->size && index->orders[position]==order){
+        return true;
+    }
+    if(index->size==index->capacity){
+        int capacity=index->capacity>0 ? 2*index->capacity : 4;
+        Order* orders=realloc(index->orders,sizeof(*orders)*capacity);
+        if(!orders){
+            return false;
+        }
+        index->orders=orders;
+        index->capacity=capacity;
+    }
+    // new orders have the largest ids, so this rarely moves anything
+    memmove(index->orders+position+1,index->orders+position,
+            sizeof(*index->orders)*(index->size-position));
+    index->orders[position]=order;
+    index->size++;
+    return true;
+}
+
+/**
+ * removeFromOrderIndex: removes an order from an order index, if it is there.
+ *
+ * @param index - The index to remove from.
+ * @param orderId - The id of the order.
+ */
+static void removeFromOrderIndex(OrderIndex* index, unsigned int orderId){
+    int position=findInOrderIndex(index,orderId);
+    if(position==index->size || index->orders[position]->id!=orderId){
+        return;
+    }
+    memmove(index->orders+position,index->orders+position+1,
+            sizeof(*index->orders)*(index->size-position-1));
+    index->size--;
+}
+
 /**
  * checkIfNameIsValid: receives a name and determines whether it is valid.
  *
@@ -355,60 +859,234 @@ static bool checkIfNameIsValid(const char* name){
 }
 
 /**
- * absOfNumber
- * * @return:
- * the absolute value of the number the function receives
+ * toQuantity: converts an amount received from the user to millionths.
+ *
+ * @param amount - The amount to convert.
+ * @param quantity - Set to the amount in millionths, rounded to the nearest one.
+ *
+ * @return:
+ *      false - if the amount is too large to be kept exactly, or is not a
+ *          number.
+ *      true - otherwise.
+ */
+static bool toQuantity(const double amount, Quantity* quantity){
+    double scaled=amount*QUANTITY_SCALE;
+    if(!(scaled>=-QUANTITY_LIMIT && scaled<=QUANTITY_LIMIT)){
+        return false;
+    }
+    *quantity=(Quantity)(scaled<0 ? scaled-0.5 : scaled+0.5);
+    return true;
+}
+
+/**
+ * fromQuantity: converts an amount in millionths to the amount the user sees.
+ *
+ * @param quantity - The amount in millionths.
+ *
+ * @return:
+ *      The amount in units.
+ */
+static double fromQuantity(const Quantity quantity){
+    return (double)quantity/QUANTITY_SCALE;
+}
+
+/**
+ * priceToQuantity: converts a price returned by the user to millionths, so it
+ *                  can be added to an income. Prices that are too large are
+ *                  cut to the largest quantity.
+ *
+ * @param price - The price to convert.
+ *
+ * @return:
+ *      The price in millionths.
+ */
+static Quantity priceToQuantity(const double price){
+    Quantity quantity;
+    if(toQuantity(price,&quantity)){
+        return quantity;
+    }
+    return price<0 ? -QUANTITY_LIMIT : QUANTITY_LIMIT;
+}
+
+/**
+ * getQuantityOfCursor: returns the amount of the product a cursor points to.
+ *
+ * @param cursor - A cursor to a product in an AmountSet.
+ *
+ * @return:
+ *      The amount of the product, in millionths.
+ */
+static Quantity getQuantityOfCursor(ASCursor cursor){
+    double amount;
+    asCursorGetAmount(cursor,&amount);
+    return (Quantity)amount;
+}
+
+/**
+ * priceByTiers: returns the price of an amount by a built-in pricing rule.
+ *               Every tier is evaluated, and the conditions compile to
+ *               selects, so the same instructions price any amount by any
+ *               rule.
+ *
+ * @param tiers - The rule to price by.
+ * @param amount - The amount to price.
+ *
+ * @return
+ *     The price of the amount.
+ */
+static double priceByTiers(const PriceTiers* tiers, const double amount){
+    double price=0;
+    for(int i=0;i<MTM_PRICE_RULE_MAX_TIERS;i++){
+        double end=i+1<MTM_PRICE_RULE_MAX_TIERS ? tiers->starts[i+1] : DBL_MAX;
+        double amount_in_tier=(amount<end ? amount : end)-tiers->starts[i];
+        price=price+(amount_in_tier>0 ? amount_in_tier : 0)*
+                tiers->unit_prices[i];
+    }
+    return price;
+}
+
+/**
+ * makePriceTiers: compiles a built-in pricing rule received from the user to
+ *                 a table of tiers.
+ *
+ * @param rule - The rule to compile.
+ * @param tiers - Set to the tiers of the rule.
+ *
+ * @return
+ *     false - if the rule is not valid, as described in MtmPriceRule.
+ *     true - otherwise.
  */
+static bool makePriceTiers(const MtmPriceRule* rule, PriceTiers* tiers){
+    *tiers=NO_PRICE_TIERS;
+    switch(rule->type){
+        case MTM_PRICE_RULE_LINEAR:
+            tiers->unit_prices[0]=rule->unitPrice;
+            return true;
+        case MTM_PRICE_RULE_BUY_GET_FREE:
+            if(!(rule->paidAmount>=0 && rule->freeAmount>=0)){
+                return false;
+            }
+            tiers->unit_prices[0]=rule->unitPrice;
+            tiers->starts[1]=rule->paidAmount;
+            tiers->starts[2]=rule->paidAmount+rule->freeAmount;
+            tiers->unit_prices[2]=rule->unitPrice;
+            return true;
+        case MTM_PRICE_RULE_TIERED:
+            if(rule->tiersNumber<1 ||
+                    rule->tiersNumber>MTM_PRICE_RULE_MAX_TIERS ||
+                    rule->tierStarts[0]!=0){
+                return false;
+            }
+            for(int i=0;i<rule->tiersNumber;i++){
+                if(i>0 && !(rule->tierStarts[i]>rule->tierStarts[i-1])){
+                    return false;
+                }
+                tiers->starts[i]=rule->tierStarts[i];
+                tiers->unit_prices[i]=rule->tierUnitPrices[i];
+            }
+            return true;
+    }
+    return false;
+}
 
 /**
- * absOfNumber: calculates the absolute value of a number.
+ * getPriceOfProduct: returns the price of an amount of a product. The price of
+ *                    a cacheable product is only computed once for every
+ *                    amount, as long as it stays in the cache.
  *
- * @param number - the number that we wish to get its absolute value.
+ * @param product - The product to price.
+ * @param amount - The amount to price, in millionths.
  *
  * @return
- *      The absolute value of the number.
+ *     The price of the amount of the product.
+ */
+static double getPriceOfProduct(Product product, const Quantity amount){
+    if(product->priced_by_rule){
+        return priceByTiers(&product->price_tiers,fromQuantity(amount));
+    }
+    if(product->get_price_batch_function){
+        double amount_of_product=fromQuantity(amount);
+        double price;
+        product->get_price_batch_function(&product->additional_info,
+                &amount_of_product,1,&price);
+        return price;
+    }
+    PriceCache cache=product->price_cache;
+    if(!cache){
+        return product->get_price_function(product->additional_info,
+                fromQuantity(amount));
+    }
+    pthread_mutex_lock(&cache->lock);
+    for(int i=0;i<PRICE_CACHE_SIZE;i++){
+        PriceCacheEntry* entry=&cache->entries[i];
+        if(entry->used && entry->amount==amount){
+            double price=entry->price;
+            pthread_mutex_unlock(&cache->lock);
+            return price;
+        }
+    }
+    unsigned int generation=cache->generation;
+    pthread_mutex_unlock(&cache->lock);
+    // the price function is not called under the lock, it may be slow
+    double price=product->get_price_function(product->additional_info,
+            fromQuantity(amount));
+    pthread_mutex_lock(&cache->lock);
+    // the prices may have been invalidated while this one was computed
+    if(cache->generation==generation){
+        PriceCacheEntry* entry=&cache->entries[cache->next_entry];
+        entry->amount=amount;
+        entry->price=price;
+        entry->used=true;
+        cache->next_entry=(cache->next_entry+1)%PRICE_CACHE_SIZE;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return price;
+}
+
+/**
+ * invalidatePriceCache: forgets all the prices kept in a price cache, and the
+ *                       prices that are being computed for it meanwhile.
+ *
+ * @param cache - The cache to clear. If it is NULL nothing is done.
  */
-static double absOfNumber(double number){
-    if(number<0){
-        return -number;
+static void invalidatePriceCache(PriceCache cache){
+    if(!cache){
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    for(int i=0;i<PRICE_CACHE_SIZE;i++){
+        cache->entries[i].used=false;
     }
-    return number;
+    cache->generation++;
+    pthread_mutex_unlock(&cache->lock);
 }
 
 /**
- * checkIfAmountIsValid: receives an amount and determines whether it is valid.
+ * checkIfQuantityIsValid: receives an amount kept by the warehouse and
+ *                         determines whether it is valid, the same way
+ *                         mtmIsAmountValid does for amounts received from
+ *                         the user.
  *
  * @param amountType - The type of amount that can be inserted.
- * @param amount - The amount to be checked.
+ * @param amount - The amount to be checked, in millionths.
  *
  * @return:
  *      false - if the amount is not valid, which means it is inconsistent with
  *          the amount type.
  *      otherwise - true.
  */
-static bool checkIfAmountIsValid(MatamazomAmountType amountType,
-                                                        const double amount){
+static bool checkIfQuantityIsValid(MatamazomAmountType amountType,
+                                   const Quantity amount){
     if(amountType==MATAMAZOM_ANY_AMOUNT){
         return true;
     }
-    int completeValue;
-    if(amount>=0){
-        completeValue=(int)amount;
-    } else{
-        completeValue=(int)amount - INTEGER;
-    }
-
-    if(absOfNumber((amount-completeValue))<=IN_RANGE_OF_MISTAKE||
-            absOfNumber((completeValue + INTEGER)-amount)<=IN_RANGE_OF_MISTAKE){
-        return true;
-    }
-    double complete_value_and_half=(double)completeValue + HALF_INTEGER;
-    if(amountType==MATAMAZOM_HALF_INTEGER_AMOUNT){
-        if(absOfNumber((complete_value_and_half-amount))<=IN_RANGE_OF_MISTAKE){
-            return true;
-        }
+    Quantity step=amountType==MATAMAZOM_INTEGER_AMOUNT ? QUANTITY_SCALE :
+            QUANTITY_SCALE/2;
+    Quantity remainder=amount%step;
+    if(remainder<0){
+        remainder=remainder+step;
     }
-    return false;
+    return remainder<=QUANTITY_TOLERANCE || step-remainder<=QUANTITY_TOLERANCE;
 }
 
 /**
@@ -422,312 +1100,2983 @@ static void printNoBestSellingProduct(FILE *output){
 }
 
 /**
- * getTotalPriceOfOrder: receives an order and returns how much is needed to be
- *                       paid for it.
+ * Type of function for evaluating a chunk of the items of a ParallelJob.
  *
- * @param order - The order that its price is requested.
- *
- * @return:
- *      A number that represents the price needed to be paid for the order.
+ * @param context - The context of the job.
+ * @param first - The index of the first item of the chunk.
+ * @param end - The index after the last item of the chunk.
  */
-static double getTotalPriceOfOrder(Order order){
-    double total_price_of_order=0;
-    double price_of_product=0;
-    double amount_of_product_in_order;
-    AS_FOREACH(Product,current_product,order->list_of_order_products){
-        asGetAmount(order->list_of_order_products,current_product,
-                &amount_of_product_in_order);
-        price_of_product=current_product->get_price_function
-                (current_product->additional_info,amount_of_product_in_order);
-        total_price_of_order=total_price_of_order+price_of_product;
-    }
-    return total_price_of_order;
-}
+typedef void (*EvaluateChunk)(void* context, int first, int end);
 
 /**
- * printProductsOfAmountSet: receives an AmountSet, then prints the details of
- *                           the products in it, such as their names, amounts,
- *                           prices etc.
+ * ParallelWorker
+ *
+ * This is an internal struct implemented to be used by a ParallelJob. Every
+ * worker owns a range of chunks of items. It takes chunks from the start of
+ * its own range, and once it is empty, steals chunks from the end of the
+ * ranges of the other workers.
+ *
+ * @param lock - Held while the range is changed.
+ * @param first_chunk - The first chunk that was not taken yet.
+ * @param end_chunk - The chunk after the last chunk that was not taken yet.
+ * @param job - The job the worker is part of.
+ * @param index - The index of the worker in the job.
+ */
+typedef struct parallel_worker{
+    pthread_mutex_t lock;
+    int first_chunk;
+    int end_chunk;
+    struct parallel_job* job;
+    int index;
+}ParallelWorker;
 
- * @param set - The AmountSet which we want to print its products' price.
- * @param per_unit - a boolean variable to determine wheter we would like to
- *          print the total price of all of the products, or just the price per
- *          a single unit of the product.
- * @param output - A pointer to the output file the the printing will happen in.
+/**
+ * ParallelJob
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse
+ * to evaluate many independent items by several threads. The items are split
+ * into chunks of PARALLEL_CHUNK_SIZE items.
+ *
+ * @param context - The context passed to evaluate.
+ * @param evaluate - The function that evaluates a chunk.
+ * @param items_number - The number of items.
+ * @param workers - The workers of the job.
+ * @param workers_number - The number of workers.
  */
-static void printProductsOfAmountSet(AmountSet set,
-                                     const bool per_unit, FILE *output){
-    AS_FOREACH(Product,current_product,set) {
-        double amount_of_current_product;
-        double price_of_product;
-        asGetAmount(set, current_product, &amount_of_current_product);
-        if(per_unit == true) {
-            price_of_product = current_product->get_price_function(
-                    current_product->additional_info, UNIT);
-        } else{
-            price_of_product = current_product->
-                    get_price_function(current_product->additional_info,
-                            amount_of_current_product);
-        }
-        mtmPrintProductDetails(current_product->name, current_product->id,
-                amount_of_current_product, price_of_product, output);
-    }
-}
+typedef struct parallel_job{
+    void* context;
+    EvaluateChunk evaluate;
+    int items_number;
+    ParallelWorker workers[PARALLEL_THREADS_NUMBER];
+    int workers_number;
+}ParallelJob;
 
 /**
- * getOrderFromId: receives a Set and an id, and returns a pointer
- *                   to the order with the same id in the received Ser.
+ * takeChunk: takes the next chunk of a worker, from its own range if it is not
+ *            empty, or from the range of another worker otherwise.
  *
- * @param set - The AmountSet in which the product will be looked for.
- * @param productId - The id of the desired product.
+ * @param worker - The worker that takes the chunk.
  *
  * @return:
- *      NULL - if there is no order with the given id in the set.
- *      A pointer to the desired order (the product with the same id
- *      as received).
+ *      -1 - if all the chunks were taken.
+ *      The index of the chunk otherwise.
  */
-static Order getOrderFromId(Set set, unsigned int orderId){
-    Order wanted_order = NULL;
-
-    SET_FOREACH(Order,currentOrder,set){
-        if(currentOrder->id == orderId){
-            wanted_order = currentOrder;
+static int takeChunk(ParallelWorker* worker){
+    ParallelJob* job=worker->job;
+    for(int i=0;i<job->workers_number;i++){
+        ParallelWorker* victim=
+                &job->workers[(worker->index+i)%job->workers_number];
+        int chunk=-1;
+        pthread_mutex_lock(&victim->lock);
+        if(victim->first_chunk < victim->end_chunk){
+            if(victim == worker){
+                chunk=victim->first_chunk++;
+            } else{
+                chunk=--victim->end_chunk;
+            }
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if(chunk>=0){
+            return chunk;
         }
     }
-    if(wanted_order == NULL){
-        return NULL;
-    }
-    return wanted_order;
+    return -1;
 }
 
 /**
- * checkIfOrderIsValid: receives an order and determines whether it is valid.
+ * runParallelWorker: evaluates chunks until there are none left.
+ *                    A thread routine for pthread_create.
  *
- * @param matamazom - The matamazom warehouse that the order is in.
- * @param order - The order to be checked.
+ * @param argument - The ParallelWorker to run.
  *
  * @return:
- *      false - if there is a product in the order with a larger amount than its
- *          amount in the matamazom warehouse.
- *      true - if the amount of all of the products in the order is valid.
+ *      NULL.
  */
-static bool checkIfOrderIsValid(Matamazom matamazom, Order order) {
-    double amount_in_matamazom;
-    double amount_in_order;
-    AS_FOREACH(Product, orderProduct, order->list_of_order_products) {
-        asGetAmount(matamazom->list_of_products,orderProduct,
-                &amount_in_matamazom);
-        asGetAmount(order->list_of_order_products,orderProduct,
-                &amount_in_order);
-        if(amount_in_order>amount_in_matamazom){
-            return false;
+static void* runParallelWorker(void* argument){
+    ParallelWorker* worker=argument;
+    ParallelJob* job=worker->job;
+    int chunk;
+    while((chunk=takeChunk(worker))>=0){
+        int end=(chunk+1)*PARALLEL_CHUNK_SIZE;
+        if(end>job->items_number){
+            end=job->items_number;
         }
+        job->evaluate(job->context,chunk*PARALLEL_CHUNK_SIZE,end);
+    }
+    return NULL;
+}
+
+/**
+ * runParallelJob: evaluates all the chunks of items, by the calling thread and
+ *                 up to max_workers-1 more threads.
+ *
+ * @param context - The context passed to evaluate.
+ * @param evaluate - The function that evaluates a chunk.
+ * @param items_number - The number of items.
+ * @param max_workers - The largest number of threads to use, up to
+ *     PARALLEL_THREADS_NUMBER.
+ */
+static void runParallelJob(void* context, EvaluateChunk evaluate,
+                           int items_number, int max_workers){
+    ParallelJob job;
+    job.context=context;
+    job.evaluate=evaluate;
+    job.items_number=items_number;
+    int chunks_number=(items_number+PARALLEL_CHUNK_SIZE-1)/PARALLEL_CHUNK_SIZE;
+    job.workers_number=chunks_number<max_workers ? chunks_number : max_workers;
+    for(int i=0;i<job.workers_number;i++){
+        ParallelWorker* worker=&job.workers[i];
+        pthread_mutex_init(&worker->lock,NULL);
+        worker->first_chunk=chunks_number*i/job.workers_number;
+        worker->end_chunk=chunks_number*(i+1)/job.workers_number;
+        worker->job=&job;
+        worker->index=i;
+    }
+    // a worker whose thread could not be created is left to be stolen from
+    pthread_t threads[PARALLEL_THREADS_NUMBER];
+    bool started[PARALLEL_THREADS_NUMBER];
+    for(int i=1;i<job.workers_number;i++){
+        started[i]=pthread_create(&threads[i],NULL,runParallelWorker,
+                &job.workers[i]) == 0;
+    }
+    if(job.workers_number>0){
+        runParallelWorker(&job.workers[0]);
+    }
+    for(int i=1;i<job.workers_number;i++){
+        if(started[i]){
+            pthread_join(threads[i],NULL);
+        }
+    }
+    for(int i=0;i<job.workers_number;i++){
+        pthread_mutex_destroy(&job.workers[i].lock);
+    }
+}
+
+/**
+ * priceBatchProducts: prices the amounts of the products that have a batch
+ *                     price function. All the amounts of the products that
+ *                     share a batch function are passed to it in one call.
+ *
+ * @param products - The products to price.
+ * @param amounts - The amount of every product.
+ * @param n - The number of products, at most PARALLEL_CHUNK_SIZE.
+ * @param prices - Set to the price of every product that has a batch price
+ *     function. The other prices are not changed.
+ */
+static void priceBatchProducts(const Product* products, const double* amounts,
+                               int n, double* prices){
+    bool priced[PARALLEL_CHUNK_SIZE];
+    for(int i=0;i<n;i++){
+        priced[i]=!products[i]->get_price_batch_function;
+    }
+    MtmProductData batch_data[PARALLEL_CHUNK_SIZE];
+    double batch_amounts[PARALLEL_CHUNK_SIZE];
+    double batch_prices[PARALLEL_CHUNK_SIZE];
+    int batch_indexes[PARALLEL_CHUNK_SIZE];
+    for(int i=0;i<n;i++){
+        if(priced[i]){
+            continue;
+        }
+        MtmGetProductPriceBatch batch_function=
+                products[i]->get_price_batch_function;
+        int batch_size=0;
+        for(int j=i;j<n;j++){
+            if(!priced[j] &&
+                    products[j]->get_price_batch_function==batch_function){
+                batch_data[batch_size]=products[j]->additional_info;
+                batch_amounts[batch_size]=amounts[j];
+                batch_indexes[batch_size]=j;
+                priced[j]=true;
+                batch_size++;
+            }
+        }
+        batch_function(batch_data,batch_amounts,batch_size,batch_prices);
+        for(int j=0;j<batch_size;j++){
+            prices[batch_indexes[j]]=batch_prices[j];
+        }
+    }
+}
+
+/**
+ * priceProducts: prices amounts of products. The products with a built-in
+ *                pricing rule are priced together by a single loop, and the
+ *                products with a batch price function by a call for every
+ *                function. Only the others are priced one by one.
+ *
+ * @param products - The products to price.
+ * @param quantities - The amount of every product, in millionths.
+ * @param n - The number of products, at most PARALLEL_CHUNK_SIZE.
+ * @param prices - Set to the price of every product.
+ */
+static void priceProducts(const Product* products, const Quantity* quantities,
+                          int n, double* prices){
+    const PriceTiers* tiers[PARALLEL_CHUNK_SIZE];
+    double amounts[PARALLEL_CHUNK_SIZE];
+    for(int i=0;i<n;i++){
+        Product product=products[i];
+        amounts[i]=fromQuantity(quantities[i]);
+        prices[i]=0;
+        if(product->priced_by_rule){
+            tiers[i]=&product->price_tiers;
+        } else{
+            tiers[i]=&NO_PRICE_TIERS;
+            if(!product->get_price_batch_function){
+                prices[i]=getPriceOfProduct(product,quantities[i]);
+            }
+        }
+    }
+    priceBatchProducts(products,amounts,n,prices);
+    for(int i=0;i<n;i++){
+        prices[i]=prices[i]+priceByTiers(tiers[i],amounts[i]);
+    }
+}
+
+/**
+ * priceChunkOfLines: prices the next lines of an order.
+ *
+ * @param cursor - A pointer to a cursor to the first line to price. It is
+ *     advanced past the priced lines.
+ * @param lines_number - The number of lines to price, at most
+ *     PARALLEL_CHUNK_SIZE.
+ * @param prices - Set to the price of every line.
+ */
+static void priceChunkOfLines(ASCursor* cursor, int lines_number,
+                              double* prices){
+    Product products[PARALLEL_CHUNK_SIZE];
+    Quantity quantities[PARALLEL_CHUNK_SIZE];
+    for(int i=0;i<lines_number;i++){
+        products[i]=asCursorGetElement(*cursor);
+        quantities[i]=getQuantityOfCursor(*cursor);
+        *cursor=asCursorNext(*cursor);
+    }
+    priceProducts(products,quantities,lines_number,prices);
+}
+
+/**
+ * sumPrices: sums the prices of lines, each rounded to millionths, so the sum
+ *            is exact and does not depend on the order the lines are summed in.
+ *
+ * @param prices - The prices to sum.
+ * @param prices_number - The number of prices.
+ *
+ * @return:
+ *      The sum of the prices, in millionths.
+ */
+static Quantity sumPrices(const double* prices, int prices_number){
+    Quantity sum=0;
+    for(int i=0;i<prices_number;i++){
+        sum=sum+priceToQuantity(prices[i]);
+    }
+    return sum;
+}
+
+/**
+ * LinePricesContext
+ *
+ * This is an internal struct implemented to be used by getTotalPriceOfOrder,
+ * as the context of a ParallelJob.
+ *
+ * @param lines - Cursors to the lines of the order.
+ * @param prices - Set to the price of every line.
+ */
+typedef struct line_prices_context{
+    ASCursor* lines;
+    double* prices;
+}LinePricesContext;
+
+/**
+ * priceLines: an EvaluateChunk function that prices a chunk of order lines,
+ *             of at most PARALLEL_CHUNK_SIZE lines.
+ *
+ * @param context - The LinePricesContext of the job.
+ * @param first - The index of the first line of the chunk.
+ * @param end - The index after the last line of the chunk.
+ */
+static void priceLines(void* context, int first, int end){
+    LinePricesContext* prices_context=context;
+    ASCursor cursor=prices_context->lines[first];
+    priceChunkOfLines(&cursor,end-first,prices_context->prices+first);
+}
+
+/**
+ * getTotalPriceOfOrder: receives an order and computes how much is needed to be
+ *                       paid for it from all its lines. The prices of the lines
+ *                       are summed exactly, so the total is the same whether
+ *                       they were computed by one thread or by several.
+ *
+ * @param order - The order that its price is requested.
+ * @param parallel - true if the lines may be priced by several threads.
+ *
+ * @return:
+ *      The price needed to be paid for the order, in millionths.
+ */
+static Quantity getTotalPriceOfOrder(Order order, bool parallel){
+    int lines_number=asGetSize(order->list_of_order_products);
+    if(parallel && lines_number>PARALLEL_CHUNK_SIZE){
+        LinePricesContext context;
+        context.lines=malloc(sizeof(*context.lines)*lines_number);
+        context.prices=malloc(sizeof(*context.prices)*lines_number);
+        if(context.lines && context.prices){
+            int index=0;
+            AS_CURSOR_FOREACH(cursor,order->list_of_order_products){
+                context.lines[index++]=cursor;
+            }
+            runParallelJob(&context,priceLines,lines_number,
+                    PARALLEL_THREADS_NUMBER);
+            Quantity total_price_of_order=
+                    sumPrices(context.prices,lines_number);
+            free(context.lines);
+            free(context.prices);
+            return total_price_of_order;
+        }
+        free(context.lines);
+        free(context.prices);
+    }
+    Quantity total_price_of_order=0;
+    ASCursor cursor=asCursorFirst(order->list_of_order_products);
+    for(int first=0;first<lines_number;first=first+PARALLEL_CHUNK_SIZE){
+        int chunk_size=lines_number-first < PARALLEL_CHUNK_SIZE ?
+                lines_number-first : PARALLEL_CHUNK_SIZE;
+        double prices[PARALLEL_CHUNK_SIZE];
+        priceChunkOfLines(&cursor,chunk_size,prices);
+        total_price_of_order=total_price_of_order+sumPrices(prices,chunk_size);
+    }
+    return total_price_of_order;
+}
+
+/**
+ * getOrderTotal: returns the total price of an order. The total is kept in the
+ *                order, and is only computed from all the lines if it is
+ *                dirty. The order must be locked.
+ *
+ * @param matamazom - The warehouse of the order.
+ * @param order - The order that its price is requested.
+ * @param parallel - true if the lines may be priced by several threads.
+ *
+ * @return:
+ *      The price needed to be paid for the order, in millionths.
+ */
+static Quantity getOrderTotal(Matamazom matamazom, Order order,
+                              bool parallel){
+    unsigned int prices_epoch=__atomic_load_n(&matamazom->prices_epoch,
+            __ATOMIC_ACQUIRE);
+    if(order->total_dirty || order->prices_epoch!=prices_epoch){
+        order->total=getTotalPriceOfOrder(order,parallel);
+        order->total_dirty=false;
+        order->prices_epoch=prices_epoch;
+    }
+    return order->total;
+}
+
+/**
+ * printProductState: prints the details of a product as a report sees it,
+ *                    with the price of a single unit.
+ *
+ * @param state - The product to print.
+ * @param output - A pointer to the output file the the printing will happen in.
+ */
+static void printProductState(const ProductState* state, FILE *output){
+    mtmPrintProductDetails(state->product->name, state->product->id,
+            fromQuantity(state->amount), state->unit_price, output);
+}
+
+/**
+ * printProductOfCursor: prints the details of the product a cursor points at.
+ *
+ * @param cursor - The cursor of the product to print.
+ * @param per_unit - print the price of a single unit instead of the price of
+ *          the whole amount.
+ * @param output - A pointer to the output file the the printing will happen in.
+ */
+static void printProductOfCursor(ASCursor cursor,
+                                 const bool per_unit, FILE *output){
+    Product current_product=asCursorGetElement(cursor);
+    Quantity amount_of_current_product=getQuantityOfCursor(cursor);
+    double price_of_product;
+    if(per_unit == true) {
+        price_of_product = current_product->unit_price;
+    } else{
+        price_of_product = getPriceOfProduct(current_product,
+                amount_of_current_product);
+    }
+    mtmPrintProductDetails(current_product->name, current_product->id,
+            fromQuantity(amount_of_current_product), price_of_product, output);
+}
+
+/**
+ * printProductsOfAmountSet: receives an AmountSet, then prints the details of
+ *                           the products in it, such as their names, amounts,
+ *                           prices etc.
+
+ * @param set - The AmountSet which we want to print its products' price.
+ * @param per_unit - a boolean variable to determine wheter we would like to
+ *          print the total price of all of the products, or just the price per
+ *          a single unit of the product.
+ * @param output - A pointer to the output file the the printing will happen in.
+ */
+static void printProductsOfAmountSet(AmountSet set,
+                                     const bool per_unit, FILE *output){
+    AS_CURSOR_FOREACH(cursor,set) {
+        printProductOfCursor(cursor, per_unit, output);
+    }
+}
+
+/**
+ * getOrderFromId: receives a Set and an id, and returns a pointer
+ *                   to the order with the same id in the received Ser.
+ *
+ * @param set - The AmountSet in which the product will be looked for.
+ * @param productId - The id of the desired product.
+ *
+ * @return:
+ *      NULL - if there is no order with the given id in the set.
+ *      A pointer to the desired order (the product with the same id
+ *      as received).
+ */
+static Order getOrderFromId(Set set, unsigned int orderId){
+    Order wanted_order = NULL;
+
+    SET_FOREACH(Order,currentOrder,set){
+        if(currentOrder->id == orderId){
+            wanted_order = currentOrder;
+            break;
+        }
+    }
+    if(wanted_order == NULL){
+        return NULL;
+    }
+    return wanted_order;
+}
+
+/**
+ * getShardIndex: returns the index of the shard that holds the product with
+ *                the given id.
+ *
+ * @param matamazom - The matamazom warehouse.
+ * @param productId - The id of the product.
+ *
+ * @return:
+ *      The index of the shard of the product.
+ */
+static int getShardIndex(Matamazom matamazom, unsigned int productId){
+    return (int)(((productId*SHARD_HASH_MULTIPLIER)>>SHARD_HASH_SHIFT)
+            %(unsigned int)matamazom->shards_number);
+}
+
+/**
+ * getProductsOfShard: returns the AmountSet that holds the product with the
+ *                     given id, whether the product exists or not.
+ *
+ * @param matamazom - The matamazom warehouse.
+ * @param productId - The id of the product.
+ *
+ * @return:
+ *      The AmountSet of the shard of the product.
+ */
+static AmountSet getProductsOfShard(Matamazom matamazom,
+                                    unsigned int productId){
+    return matamazom->shards[getShardIndex(matamazom,productId)]
+            .list_of_products;
+}
+
+/**
+ * advanceToProduct: receives a cursor into a set of products sorted by id, and
+ *                   advances it to the first product whose id is not smaller
+ *                   than the given id.
+ *
+ * @param cursor - The cursor to start advancing from.
+ * @param productId - The id of the desired product.
+ *
+ * @return:
+ *      NULL - if all of the products from the cursor onwards have a smaller id.
+ *      A cursor to the first product with an id that is equal or larger than
+ *      the given id.
+ */
+static ASCursor advanceToProduct(ASCursor cursor, unsigned int productId){
+    while(cursor &&
+          ((Product)asCursorGetElement(cursor))->id < productId){
+        cursor=asCursorNext(cursor);
+    }
+    return cursor;
+}
+
+/**
+ * ShardCursors
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse.
+ * It holds one cursor into every shard, so the products of all the shards can
+ * be walked together in ascending id order.
+ *
+ * @param cursors - A cursor into every shard in use.
+ * @param shards_number - The number of shards in use.
+ */
+typedef struct shard_cursors{
+    ASCursor cursors[MATAMAZOM_SHARDS_NUMBER];
+    int shards_number;
+}ShardCursors;
+
+/**
+ * startShardCursors: sets every cursor to the first product of its shard.
+ *
+ * @param matamazom - The matamazom warehouse to walk.
+ * @param cursors - The cursors to set.
+ */
+static void startShardCursors(Matamazom matamazom, ShardCursors* cursors){
+    cursors->shards_number=matamazom->shards_number;
+    for(int i=0;i<matamazom->shards_number;i++){
+        cursors->cursors[i]=
+                asCursorFirst(matamazom->shards[i].list_of_products);
+    }
+}
+
+/**
+ * seekProduct: advances the cursor of the product's shard to the product with
+ *              the given id. As long as the ids sought are ascending, every
+ *              shard is walked at most once.
+ *
+ * @param matamazom - The matamazom warehouse that is walked.
+ * @param cursors - The cursors of the walk.
+ * @param productId - The id of the desired product.
+ *
+ * @return:
+ *      NULL - if there is no product with the given id in the warehouse.
+ *      A cursor to the desired product otherwise.
+ */
+static ASCursor seekProduct(Matamazom matamazom, ShardCursors* cursors,
+                            unsigned int productId){
+    int index=getShardIndex(matamazom,productId);
+    cursors->cursors[index]=advanceToProduct(cursors->cursors[index],productId);
+    ASCursor cursor=cursors->cursors[index];
+    if(!cursor || ((Product)asCursorGetElement(cursor))->id != productId){
+        return NULL;
+    }
+    return cursor;
+}
+
+/**
+ * nextProduct: returns the product with the smallest id that was not returned
+ *              yet, and advances the walk past it.
+ *
+ * @param cursors - The cursors of the walk.
+ *
+ * @return:
+ *      NULL - if all the products were returned.
+ *      A cursor to the next product in ascending id order otherwise.
+ */
+static ASCursor nextProduct(ShardCursors* cursors){
+    int smallest=-1;
+    for(int i=0;i<cursors->shards_number;i++){
+        if(cursors->cursors[i] && (smallest<0 ||
+            ((Product)asCursorGetElement(cursors->cursors[i]))->id <
+            ((Product)asCursorGetElement(cursors->cursors[smallest]))->id)){
+            smallest=i;
+        }
+    }
+    if(smallest<0){
+        return NULL;
+    }
+    ASCursor cursor=cursors->cursors[smallest];
+    cursors->cursors[smallest]=asCursorNext(cursor);
+    return cursor;
+}
+
+/**
+ * Macro for walking over all the products of a warehouse in ascending id order.
+ * Declares a new cursor for the loop.
+ */
+#define PRODUCTS_FOREACH(cursor, walk, matamazom) \
+    startShardCursors(matamazom, walk); \
+    for(ASCursor cursor = nextProduct(walk) ;cursor ;cursor = nextProduct(walk))
+
+/**
+ * retainNode: adds a reference to a node of a snapshot.
+ *
+ * @param node - The node, or NULL for an empty tree.
+ *
+ * @return:
+ *      The node.
+ */
+static ProductNode retainNode(ProductNode node){
+    if(node){
+        __atomic_add_fetch(&node->references,1,__ATOMIC_RELAXED);
+    }
+    return node;
+}
+
+/**
+ * releaseNode: drops a reference to a node of a snapshot, and frees the node
+ *              and drops its references once it is not referenced anymore.
+ *
+ * @param node - The node, or NULL for an empty tree.
+ */
+static void releaseNode(ProductNode node){
+    while(node && __atomic_sub_fetch(&node->references,1,__ATOMIC_ACQ_REL)==0){
+        ProductNode right=node->right;
+        releaseNode(node->left);
+        freeProduct(node->state.product);
+        free(node);
+        node=right;
+    }
+}
+
+/**
+ * getHeightOfNode: returns the height of a tree of a snapshot.
+ *
+ * @param node - The root of the tree, or NULL for an empty tree.
+ *
+ * @return:
+ *      The height of the tree, 0 if it is empty.
+ */
+static int getHeightOfNode(ProductNode node){
+    return node ? node->height : 0;
+}
+
+/**
+ * getSizeOfNode: returns the number of products in a tree of a snapshot.
+ *
+ * @param node - The root of the tree, or NULL for an empty tree.
+ *
+ * @return:
+ *      The number of products in the tree.
+ */
+static int getSizeOfNode(ProductNode node){
+    return node ? node->size : 0;
+}
+
+/**
+ * createNode: creates a node of a snapshot over two subtrees. The node takes
+ *             over the references of the caller to the subtrees, even if it
+ *             cannot be created.
+ *
+ * @param state - The product of the node. A reference is added to it.
+ * @param left - The subtree of the products with smaller ids.
+ * @param right - The subtree of the products with larger ids.
+ * @param failed - Set to true if an allocation failed. If it is already true,
+ *     nothing is created.
+ *
+ * @return:
+ *      NULL - if an allocation failed.
+ *      The new node otherwise, with a single reference.
+ */
+static ProductNode createNode(const ProductState* state, ProductNode left,
+                              ProductNode right, bool* failed){
+    ProductNode node=*failed ? NULL : malloc(sizeof(*node));
+    if(!node){
+        *failed=true;
+        releaseNode(left);
+        releaseNode(right);
+        return NULL;
+    }
+    node->state=*state;
+    __atomic_add_fetch(&node->state.product->references,1,__ATOMIC_RELAXED);
+    node->left=left;
+    node->right=right;
+    int left_height=getHeightOfNode(left);
+    int right_height=getHeightOfNode(right);
+    node->height=(left_height>right_height ? left_height : right_height)+1;
+    node->size=getSizeOfNode(left)+getSizeOfNode(right)+1;
+    node->references=1;
+    return node;
+}
+
+/**
+ * balanceNodes: creates a node of a snapshot over two subtrees whose heights
+ *               differ by two at most, and rotates it so the heights of the
+ *               subtrees of every new node differ by one at most. Takes over
+ *               the references of the caller to the subtrees, as createNode
+ *               does.
+ *
+ * @param state - The product of the node.
+ * @param left - The subtree of the products with smaller ids.
+ * @param right - The subtree of the products with larger ids.
+ * @param failed - Set to true if an allocation failed.
+ *
+ * @return:
+ *      NULL - if an allocation failed.
+ *      The balanced tree otherwise.
+ */
+static ProductNode balanceNodes(const ProductState* state, ProductNode left,
+                                ProductNode right, bool* failed){
+    int left_height=getHeightOfNode(left);
+    int right_height=getHeightOfNode(right);
+    if(*failed || (left_height<=right_height+1 &&
+                   right_height<=left_height+1)){
+        return createNode(state,left,right,failed);
+    }
+    ProductNode result;
+    if(left_height>right_height){
+        if(getHeightOfNode(left->left)>=getHeightOfNode(left->right)){
+            result=createNode(&left->state,retainNode(left->left),
+                    createNode(state,retainNode(left->right),right,failed),
+                    failed);
+        } else{
+            ProductNode middle=left->right;
+            result=createNode(&middle->state,
+                    createNode(&left->state,retainNode(left->left),
+                            retainNode(middle->left),failed),
+                    createNode(state,retainNode(middle->right),right,failed),
+                    failed);
+        }
+        releaseNode(left);
+        return result;
+    }
+    if(getHeightOfNode(right->right)>=getHeightOfNode(right->left)){
+        result=createNode(&right->state,
+                createNode(state,left,retainNode(right->left),failed),
+                retainNode(right->right),failed);
+    } else{
+        ProductNode middle=right->left;
+        result=createNode(&middle->state,
+                createNode(state,left,retainNode(middle->left),failed),
+                createNode(&right->state,retainNode(middle->right),
+                        retainNode(right->right),failed),
+                failed);
+    }
+    releaseNode(right);
+    return result;
+}
+
+/**
+ * putNode: returns a snapshot tree with a product set to a given state, that
+ *          shares all the nodes that are not on the path to the product with
+ *          the given tree.
+ *
+ * @param node - The root of the tree. It is not changed.
+ * @param state - The new state of the product, which may not be in the tree.
+ * @param failed - Set to true if an allocation failed.
+ *
+ * @return:
+ *      NULL - if the tree is empty or an allocation failed.
+ *      The root of the new tree otherwise, with a reference for the caller.
+ */
+static ProductNode putNode(ProductNode node, const ProductState* state,
+                           bool* failed){
+    if(!node){
+        return createNode(state,NULL,NULL,failed);
+    }
+    unsigned int id=state->product->id;
+    unsigned int node_id=node->state.product->id;
+    if(id<node_id){
+        return balanceNodes(&node->state,putNode(node->left,state,failed),
+                retainNode(node->right),failed);
+    }
+    if(id>node_id){
+        return balanceNodes(&node->state,retainNode(node->left),
+                putNode(node->right,state,failed),failed);
+    }
+    return createNode(state,retainNode(node->left),retainNode(node->right),
+            failed);
+}
+
+/**
+ * removeSmallestNode: returns a snapshot tree without the product with the
+ *                     smallest id in a given tree, as putNode does.
+ *
+ * @param node - The root of the tree, which is not empty. It is not changed.
+ * @param failed - Set to true if an allocation failed.
+ *
+ * @return:
+ *      The root of the new tree, with a reference for the caller.
+ */
+static ProductNode removeSmallestNode(ProductNode node, bool* failed){
+    if(!node->left){
+        return retainNode(node->right);
+    }
+    return balanceNodes(&node->state,removeSmallestNode(node->left,failed),
+            retainNode(node->right),failed);
+}
+
+/**
+ * removeNode: returns a snapshot tree without a product, as putNode does.
+ *
+ * @param node - The root of the tree. It is not changed.
+ * @param id - The id of the product, which may not be in the tree.
+ * @param failed - Set to true if an allocation failed.
+ *
+ * @return:
+ *      The root of the new tree, with a reference for the caller.
+ */
+static ProductNode removeNode(ProductNode node, unsigned int id, bool* failed){
+    if(!node){
+        return NULL;
+    }
+    unsigned int node_id=node->state.product->id;
+    if(id<node_id){
+        return balanceNodes(&node->state,removeNode(node->left,id,failed),
+                retainNode(node->right),failed);
+    }
+    if(id>node_id){
+        return balanceNodes(&node->state,retainNode(node->left),
+                removeNode(node->right,id,failed),failed);
+    }
+    if(!node->left || !node->right){
+        return retainNode(node->left ? node->left : node->right);
+    }
+    ProductNode smallest=node->right;
+    while(smallest->left){
+        smallest=smallest->left;
+    }
+    return balanceNodes(&smallest->state,retainNode(node->left),
+            removeSmallestNode(node->right,failed),failed);
+}
+
+/**
+ * buildNodes: builds a balanced snapshot tree of products.
+ *
+ * @param changes - The products, in ascending id order.
+ * @param first - The index of the first product of the tree.
+ * @param end - The index after the last product of the tree.
+ * @param failed - Set to true if an allocation failed.
+ *
+ * @return:
+ *      NULL - if there are no products or an allocation failed.
+ *      The root of the tree otherwise, with a reference for the caller.
+ */
+static ProductNode buildNodes(const ProductChange* changes, int first, int end,
+                              bool* failed){
+    if(first>=end){
+        return NULL;
+    }
+    int middle=first+(end-first)/2;
+    ProductNode left=buildNodes(changes,first,middle,failed);
+    ProductNode right=buildNodes(changes,middle+1,end,failed);
+    return createNode(&changes[middle].state,left,right,failed);
+}
+
+/**
+ * InventoryView
+ *
+ * This is an internal struct implemented to be used by the reports of the
+ * Matamazom warehouse. It holds the products of every shard as the report
+ * sees them.
+ *
+ * @param list_of_products - The products of every shard in use, if they are
+ * read directly.
+ * @param snapshots - The snapshot of every shard in use, if the products are
+ * read from snapshots. A reference is held to each of them.
+ * @param shards_number - The number of shards in use.
+ * @param pinned - true if the products are read from snapshots.
+ * @param locked - true if the shards are locked for the report.
+ */
+typedef struct inventory_view{
+    AmountSet list_of_products[MATAMAZOM_SHARDS_NUMBER];
+    ProductNode snapshots[MATAMAZOM_SHARDS_NUMBER];
+    int shards_number;
+    bool pinned;
+    bool locked;
+}InventoryView;
+
+/**
+ * NodePath
+ *
+ * This is an internal struct implemented to be used by ViewWalk. The nodes of
+ * a snapshot tree that are still to be walked, with the next one on top.
+ * The height of a balanced tree of 2^32 products is smaller than
+ * PRODUCT_TREE_MAX_HEIGHT.
+ *
+ * @param nodes - The nodes.
+ * @param depth - The number of nodes.
+ */
+typedef struct node_path{
+    ProductNode nodes[PRODUCT_TREE_MAX_HEIGHT];
+    int depth;
+}NodePath;
+
+/**
+ * ViewWalk
+ *
+ * This is an internal struct implemented to be used by the reports of the
+ * Matamazom warehouse. It walks the products of all the shards of a view
+ * together in ascending id order.
+ *
+ * @param view - The view that is walked.
+ * @param cursors - A cursor into every shard, if the products are read
+ * directly.
+ * @param paths - A path into the snapshot of every shard, if the products are
+ * read from snapshots.
+ * @param current - The product that was returned last.
+ */
+typedef struct view_walk{
+    const InventoryView* view;
+    ASCursor cursors[MATAMAZOM_SHARDS_NUMBER];
+    NodePath paths[MATAMAZOM_SHARDS_NUMBER];
+    ProductState current;
+}ViewWalk;
+
+/**
+ * pushSmallerNodes: pushes a node to a path, and then the nodes on the way to
+ *                   the product with the smallest id in its subtree that is not
+ *                   smaller than a given id.
+ *
+ * @param path - The path.
+ * @param node - The node, or NULL.
+ * @param low_id - The smallest id to walk.
+ */
+static void pushSmallerNodes(NodePath* path, ProductNode node,
+                             unsigned int low_id){
+    while(node){
+        if(node->state.product->id>=low_id){
+            path->nodes[path->depth++]=node;
+            node=node->left;
+        } else{
+            node=node->right;
+        }
+    }
+}
+
+/**
+ * startViewWalk: sets every shard of a walk to its first product whose id is
+ *                not smaller than a given id. A snapshot is searched in
+ *                logarithmic time, and a shard that is read directly is walked
+ *                up to the product.
+ *
+ * @param view - The view to walk.
+ * @param walk - The walk to start.
+ * @param low_id - The smallest id to walk.
+ */
+static void startViewWalk(const InventoryView* view, ViewWalk* walk,
+                          unsigned int low_id){
+    walk->view=view;
+    for(int i=0;i<view->shards_number;i++){
+        if(view->pinned){
+            walk->paths[i].depth=0;
+            pushSmallerNodes(&walk->paths[i],view->snapshots[i],low_id);
+        } else{
+            walk->cursors[i]=advanceToProduct(
+                    asCursorFirst(view->list_of_products[i]),low_id);
+        }
+    }
+}
+
+/**
+ * getNextOfShard: returns the next product of a shard in a walk.
+ *
+ * @param walk - The walk.
+ * @param index - The index of the shard.
+ *
+ * @return:
+ *      NULL - if all the products of the shard were walked.
+ *      The next product of the shard otherwise.
+ */
+static Product getNextOfShard(const ViewWalk* walk, int index){
+    if(walk->view->pinned){
+        const NodePath* path=&walk->paths[index];
+        return path->depth>0 ?
+                path->nodes[path->depth-1]->state.product : NULL;
+    }
+    return walk->cursors[index] ? asCursorGetElement(walk->cursors[index]) :
+            NULL;
+}
+
+/**
+ * nextViewProduct: returns the product with the smallest id that was not
+ *                  returned yet, and advances the walk past it.
+ *
+ * @param walk - The walk.
+ *
+ * @return:
+ *      NULL - if all the products were returned.
+ *      The next product in ascending id order otherwise, until the walk
+ *      advances again.
+ */
+static const ProductState* nextViewProduct(ViewWalk* walk){
+    int smallest=-1;
+    for(int i=0;i<walk->view->shards_number;i++){
+        Product product=getNextOfShard(walk,i);
+        if(product && (smallest<0 ||
+                product->id < getNextOfShard(walk,smallest)->id)){
+            smallest=i;
+        }
+    }
+    if(smallest<0){
+        return NULL;
+    }
+    if(walk->view->pinned){
+        NodePath* path=&walk->paths[smallest];
+        ProductNode node=path->nodes[--path->depth];
+        pushSmallerNodes(path,node->right,0);
+        walk->current=node->state;
+    } else{
+        ASCursor cursor=walk->cursors[smallest];
+        Product product=asCursorGetElement(cursor);
+        walk->current.product=product;
+        walk->current.amount=getQuantityOfCursor(cursor);
+        walk->current.income=product->income;
+        walk->current.unit_price=product->unit_price;
+        walk->cursors[smallest]=asCursorNext(cursor);
+    }
+    return &walk->current;
+}
+
+/**
+ * nextViewProductInRange: returns the product with the smallest id that was
+ *                         not returned yet, as nextViewProduct does, if its id
+ *                         is not larger than a given id.
+ *
+ * @param walk - The walk.
+ * @param high_id - The largest id to walk.
+ *
+ * @return:
+ *      NULL - if all the products up to high_id were returned.
+ *      The next product in ascending id order otherwise.
+ */
+static const ProductState* nextViewProductInRange(ViewWalk* walk,
+                                                  unsigned int high_id){
+    const ProductState* product=nextViewProduct(walk);
+    if(!product || product->product->id > high_id){
+        return NULL;
+    }
+    return product;
+}
+
+/**
+ * Macro for walking over all the products a report sees, in ascending id
+ * order. Declares a new product for the loop.
+ */
+#define VIEW_PRODUCTS_FOREACH(product, walk, view) \
+    startViewWalk(view, walk, 0); \
+    for(const ProductState* product = nextViewProduct(walk) ;product ; \
+        product = nextViewProduct(walk))
+
+/**
+ * Macro for walking over the products a report sees whose ids are between
+ * low_id and high_id, in ascending id order. Declares a new product for the
+ * loop.
+ */
+#define VIEW_RANGE_FOREACH(product, walk, view, low_id, high_id) \
+    startViewWalk(view, walk, low_id); \
+    for(const ProductState* product = nextViewProductInRange(walk, high_id) ; \
+        product ;product = nextViewProductInRange(walk, high_id))
+
+/**
+ * checkIfOrderIsValid: receives an order and determines whether it is valid.
+ *                      Both the order and the warehouse are sorted by id, so
+ *                      they are walked together in a single pass.
+ *
+ * @param matamazom - The matamazom warehouse that the order is in.
+ * @param order - The order to be checked.
+ *
+ * @return:
+ *      false - if there is a product in the order with a larger amount than its
+ *          amount in the matamazom warehouse.
+ *      true - if the amount of all of the products in the order is valid.
+ */
+static bool checkIfOrderIsValid(Matamazom matamazom, Order order) {
+    ShardCursors warehouse_cursors;
+    startShardCursors(matamazom,&warehouse_cursors);
+    AS_CURSOR_FOREACH(order_cursor, order->list_of_order_products) {
+        Product orderProduct=asCursorGetElement(order_cursor);
+        ASCursor warehouse_cursor=seekProduct(matamazom,&warehouse_cursors,
+                orderProduct->id);
+        if(!warehouse_cursor){
+            return false;
+        }
+        if(getQuantityOfCursor(order_cursor)>
+                getQuantityOfCursor(warehouse_cursor)){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * releaseOrderProducts: receives an order that is removed from the warehouse,
+ *                       removes it from the order indexes of its products and
+ *                       releases the amounts it reserved in the warehouse. The
+ *                       shards of the order must be locked for writing.
+ *
+ * @param matamazom - The matamazom warehouse that the order is in.
+ * @param order - The order that is removed.
+ */
+static void releaseOrderProducts(Matamazom matamazom, Order order) {
+    ShardCursors warehouse_cursors;
+    startShardCursors(matamazom,&warehouse_cursors);
+    AS_CURSOR_FOREACH(order_cursor, order->list_of_order_products) {
+        Product orderProduct=asCursorGetElement(order_cursor);
+        ASCursor warehouse_cursor=seekProduct(matamazom,&warehouse_cursors,
+                orderProduct->id);
+        if(warehouse_cursor){
+            Product warehouse_product=asCursorGetElement(warehouse_cursor);
+            removeFromOrderIndex(&warehouse_product->orders,order->id);
+            if(matamazom->reserve_stock){
+                warehouse_product->reserved=warehouse_product->reserved
+                        -getQuantityOfCursor(order_cursor);
+            }
+        }
+    }
+}
+
+/**
+ * getOrderStripe: returns the stripe that holds the order with the given id,
+ *                 whether the order exists or not.
+ *
+ * @param matamazom - The matamazom warehouse.
+ * @param orderId - The id of the order.
+ *
+ * @return:
+ *      The stripe of the order.
+ */
+static OrderStripe getOrderStripe(Matamazom matamazom, unsigned int orderId){
+    return &matamazom->order_stripes[orderId %
+            (unsigned int)matamazom->order_stripes_number];
+}
+
+/**
+ * lockOrderStripe: locks an order stripe. Does nothing unless the warehouse is
+ *                  in MATAMAZOM_CONCURRENT mode.
+ *
+ * @param matamazom - The warehouse of the stripe.
+ * @param stripe - The stripe to lock.
+ */
+static void lockOrderStripe(Matamazom matamazom, OrderStripe stripe){
+    if(matamazom->concurrent){
+        pthread_mutex_lock(&stripe->lock);
+    }
+}
+
+/**
+ * unlockOrderStripe: releases a lock taken by lockOrderStripe.
+ *
+ * @param matamazom - The warehouse of the stripe.
+ * @param stripe - The stripe to unlock.
+ */
+static void unlockOrderStripe(Matamazom matamazom, OrderStripe stripe){
+    if(matamazom->concurrent){
+        pthread_mutex_unlock(&stripe->lock);
+    }
+}
+
+/**
+ * lockAllOrderStripes: locks all the order stripes of a warehouse, in
+ *                      ascending order.
+ *
+ * @param matamazom - The warehouse to lock.
+ */
+static void lockAllOrderStripes(Matamazom matamazom){
+    for(int i=0;i<matamazom->order_stripes_number;i++){
+        lockOrderStripe(matamazom,&matamazom->order_stripes[i]);
+    }
+}
+
+/**
+ * unlockAllOrderStripes: releases a lock taken by lockAllOrderStripes.
+ *
+ * @param matamazom - The warehouse to unlock.
+ */
+static void unlockAllOrderStripes(Matamazom matamazom){
+    for(int i=matamazom->order_stripes_number-1;i>=0;i--){
+        unlockOrderStripe(matamazom,&matamazom->order_stripes[i]);
+    }
+}
+
+/**
+ * lockOrder: locks an order. The lock of the order's stripe must be held.
+ *
+ * @param matamazom - The warehouse of the order.
+ * @param order - The order to lock.
+ */
+static void lockOrder(Matamazom matamazom, Order order){
+    if(matamazom->concurrent){
+        pthread_mutex_lock(&order->lock);
+    }
+}
+
+/**
+ * unlockOrder: releases a lock taken by lockOrder.
+ *
+ * @param matamazom - The warehouse of the order.
+ * @param order - The order to unlock.
+ */
+static void unlockOrder(Matamazom matamazom, Order order){
+    if(matamazom->concurrent){
+        pthread_mutex_unlock(&order->lock);
+    }
+}
+
+/**
+ * findAndLockOrder: finds an order and locks it. The stripe of the order is
+ *                   only locked during the search, so operations on orders
+ *                   of the same stripe do not wait for each other.
+ *
+ * @param matamazom - The warehouse of the order.
+ * @param orderId - The id of the desired order.
+ *
+ * @return:
+ *      NULL - if there is no order with the given id.
+ *      The locked order otherwise. It must be released with unlockOrder.
+ */
+static Order findAndLockOrder(Matamazom matamazom, unsigned int orderId){
+    OrderStripe stripe=getOrderStripe(matamazom,orderId);
+    lockOrderStripe(matamazom,stripe);
+    Order order=getOrderFromId(stripe->set_of_orders,orderId);
+    if(order){
+        lockOrder(matamazom,order);
+    }
+    unlockOrderStripe(matamazom,stripe);
+    return order;
+}
+
+/**
+ * lockShard: locks a shard of a warehouse. Several readers may hold the lock
+ *            together. Does nothing unless the warehouse is in
+ *            MATAMAZOM_CONCURRENT mode.
+ *
+ * @param matamazom - The warehouse of the shard.
+ * @param index - The index of the shard.
+ * @param for_writing - true if the shard is going to be changed.
+ */
+static void lockShard(Matamazom matamazom, int index, bool for_writing){
+    if(!matamazom->concurrent){
+        return;
+    }
+    if(for_writing){
+        pthread_rwlock_wrlock(&matamazom->shards[index].lock);
+    } else{
+        pthread_rwlock_rdlock(&matamazom->shards[index].lock);
+    }
+}
+
+/**
+ * unlockShard: releases a lock taken by lockShard.
+ *
+ * @param matamazom - The warehouse of the shard.
+ * @param index - The index of the shard.
+ */
+static void unlockShard(Matamazom matamazom, int index){
+    if(matamazom->concurrent){
+        pthread_rwlock_unlock(&matamazom->shards[index].lock);
+    }
+}
+
+/**
+ * lockOrdersOfShard: locks the order indexes of the products of a shard. The
+ *                    shard must be locked for reading. Does nothing unless
+ *                    the warehouse is in MATAMAZOM_CONCURRENT mode.
+ *
+ * @param matamazom - The warehouse of the shard.
+ * @param index - The index of the shard.
+ */
+static void lockOrdersOfShard(Matamazom matamazom, int index){
+    if(matamazom->concurrent){
+        pthread_mutex_lock(&matamazom->shards[index].orders_lock);
+    }
+}
+
+/**
+ * unlockOrdersOfShard: releases a lock taken by lockOrdersOfShard.
+ *
+ * @param matamazom - The warehouse of the shard.
+ * @param index - The index of the shard.
+ */
+static void unlockOrdersOfShard(Matamazom matamazom, int index){
+    if(matamazom->concurrent){
+        pthread_mutex_unlock(&matamazom->shards[index].orders_lock);
+    }
+}
+
+/**
+ * lockAllShards: locks all the shards of a warehouse, in ascending order.
+ *
+ * @param matamazom - The warehouse to lock.
+ * @param for_writing - true if the shards are going to be changed.
+ */
+static void lockAllShards(Matamazom matamazom, bool for_writing){
+    for(int i=0;i<matamazom->shards_number;i++){
+        lockShard(matamazom,i,for_writing);
+    }
+}
+
+/**
+ * unlockAllShards: releases a lock taken by lockAllShards.
+ *
+ * @param matamazom - The warehouse to unlock.
+ */
+static void unlockAllShards(Matamazom matamazom){
+    for(int i=matamazom->shards_number-1;i>=0;i--){
+        unlockShard(matamazom,i);
+    }
+}
+
+/**
+ * lockShardsOfOrder: locks, in ascending order, every shard that holds a
+ *                    product of the given order.
+ *
+ * @param matamazom - The warehouse of the order.
+ * @param order - The order whose shards are locked.
+ * @param locked - An array of MATAMAZOM_SHARDS_NUMBER flags, that is set to
+ *     the shards that were locked, to be passed later to unlockShardsOfOrder.
+ */
+static void lockShardsOfOrder(Matamazom matamazom, Order order, bool* locked){
+    for(int i=0;i<matamazom->shards_number;i++){
+        locked[i]=false;
+    }
+    AS_CURSOR_FOREACH(order_cursor, order->list_of_order_products){
+        locked[getShardIndex(matamazom,
+                ((Product)asCursorGetElement(order_cursor))->id)]=true;
+    }
+    for(int i=0;i<matamazom->shards_number;i++){
+        if(locked[i]){
+            lockShard(matamazom,i,true);
+        }
+    }
+}
+
+/**
+ * unlockShardsOfOrder: releases a lock taken by lockShardsOfOrder.
+ *
+ * @param matamazom - The warehouse of the order.
+ * @param locked - The flags set by lockShardsOfOrder.
+ */
+static void unlockShardsOfOrder(Matamazom matamazom, const bool* locked){
+    for(int i=matamazom->shards_number-1;i>=0;i--){
+        if(locked[i]){
+            unlockShard(matamazom,i);
+        }
+    }
+}
+
+/**
+ * addProductChange: adds a product to the changes of its shard. If there is no
+ *                   room for it and no more can be allocated, the changes are
+ *                   marked as lost instead. The changes of the shard must be
+ *                   locked.
+ *
+ * @param shard - The shard of the product.
+ * @param id - The id of the product.
+ * @param cursor - A cursor to the product in the shard, or NULL if it was
+ *     cleared.
+ *
+ * @return:
+ *      NULL - if the changes were lost.
+ *      The added change otherwise.
+ */
+static ProductChange* addProductChange(Shard shard, unsigned int id,
+                                       ASCursor cursor){
+    if(shard->changes_lost){
+        return NULL;
+    }
+    if(shard->changes_number==shard->changes_capacity){
+        int capacity=shard->changes_capacity>0 ?
+                2*shard->changes_capacity : PARALLEL_CHUNK_SIZE;
+        ProductChange* changes=realloc(shard->changes,
+                sizeof(*changes)*capacity);
+        if(!changes){
+            shard->changes_lost=true;
+            return NULL;
+        }
+        shard->changes=changes;
+        shard->changes_capacity=capacity;
+    }
+    ProductChange* change=&shard->changes[shard->changes_number++];
+    change->id=id;
+    change->cursor=cursor;
+    return change;
+}
+
+/**
+ * markProductChanged: records that a product changed in a way that reports can
+ *                     see, so the next report or version brings the snapshot
+ *                     of its shard up to date with it. The shard must be
+ *                     locked.
+ *
+ * @param matamazom - The warehouse of the product.
+ * @param cursor - A cursor to the product that changed in the warehouse.
+ */
+static void markProductChanged(Matamazom matamazom, ASCursor cursor){
+    Product product=asCursorGetElement(cursor);
+    Shard shard=&matamazom->shards[getShardIndex(matamazom,product->id)];
+    if(!shard->tracked){
+        return;
+    }
+    // amounts change under a read lock, so the changes have a lock of their own
+    if(matamazom->concurrent){
+        pthread_mutex_lock(&shard->changes_lock);
+    }
+    if(product->change_index==0 &&
+       addProductChange(shard,product->id,cursor)){
+        product->change_index=shard->changes_number;
+    }
+    if(matamazom->concurrent){
+        pthread_mutex_unlock(&shard->changes_lock);
+    }
+}
+
+/**
+ * markProductCleared: records that a product is about to be cleared from the
+ *                     warehouse, as markProductChanged does. The shard must be
+ *                     locked for writing.
+ *
+ * @param matamazom - The warehouse of the product.
+ * @param product - The product that is cleared.
+ */
+static void markProductCleared(Matamazom matamazom, Product product){
+    Shard shard=&matamazom->shards[getShardIndex(matamazom,product->id)];
+    if(!shard->tracked){
+        return;
+    }
+    if(product->change_index>0){
+        shard->changes[product->change_index-1].cursor=NULL;
+        product->change_index=0;
+    } else{
+        addProductChange(shard,product->id,NULL);
+    }
+}
+
+/**
+ * publishEvent: publishes a change of the warehouse in its change feed, if it
+ *               is enabled. The locks that keep the changed product or order
+ *               from changing again must be held, so the events of every
+ *               product and order are published in the order they happened.
+ *
+ * @param matamazom - The warehouse that changed.
+ * @param type - The kind of change.
+ * @param product_id - The id of the changed product, if there is one.
+ * @param order_id - The id of the changed order, if there is one.
+ * @param amount - The amount of the event, in millionths.
+ */
+static void publishEvent(Matamazom matamazom, const MtmEventType type,
+                         const unsigned int product_id,
+                         const unsigned int order_id, const Quantity amount){
+    ChangeFeed feed=__atomic_load_n(&matamazom->change_feed,__ATOMIC_ACQUIRE);
+    if(!feed){
+        return;
+    }
+    if(matamazom->concurrent){
+        pthread_mutex_lock(&feed->lock);
+    }
+    MtmEvent* event=&feed->events[feed->next_sequence % feed->capacity];
+    event->sequence=feed->next_sequence;
+    event->type=type;
+    event->productId=product_id;
+    event->orderId=order_id;
+    event->amount=fromQuantity(amount);
+    feed->next_sequence++;
+    if(matamazom->concurrent){
+        pthread_mutex_unlock(&feed->lock);
+    }
+}
+
+/**
+ * ShardChanges
+ *
+ * This is an internal struct implemented to be used by pinInventoryView.
+ * The products of a shard that were taken while the shards were locked, to
+ * bring its snapshot up to date once they are not.
+ *
+ * @param changes - The changed products in the order they first changed, or
+ * all the products of the shard in ascending id order if the snapshot is
+ * rebuilt. A reference is held to every product that was not cleared.
+ * @param changes_number - The number of changes.
+ * @param rebuild - true if the snapshot is rebuilt from all the products.
+ */
+typedef struct shard_changes{
+    ProductChange* changes;
+    int changes_number;
+    bool rebuild;
+}ShardChanges;
+
+/**
+ * takeProductState: takes the state of a product a cursor points to, and adds
+ *                   a reference to the product.
+ *
+ * @param cursor - A cursor to a product of a shard.
+ * @param state - Set to the state of the product.
+ */
+static void takeProductState(ASCursor cursor, ProductState* state){
+    Product product=asCursorGetElement(cursor);
+    __atomic_add_fetch(&product->references,1,__ATOMIC_RELAXED);
+    state->product=product;
+    state->amount=getQuantityOfCursor(cursor);
+    state->income=product->income;
+    state->unit_price=product->unit_price;
+}
+
+/**
+ * takeShardChanges: takes the products of a shard that changed since its
+ *                   snapshot was brought up to date, and starts recording the
+ *                   changes anew. If the changes are not known, all the
+ *                   products of the shard are taken instead. The shard must be
+ *                   locked for writing.
+ *
+ * @param matamazom - The warehouse of the shard.
+ * @param index - The index of the shard.
+ * @param taken - Set to the taken products.
+ *
+ * @return:
+ *      false - if an allocation failed. Nothing was taken then.
+ *      true - otherwise.
+ */
+static bool takeShardChanges(Matamazom matamazom, int index,
+                             ShardChanges* taken){
+    Shard shard=&matamazom->shards[index];
+    taken->rebuild=!shard->tracked || shard->changes_lost ||
+            shard->snapshot_stale;
+    if(taken->rebuild){
+        int size=asGetSize(shard->list_of_products);
+        taken->changes=malloc(sizeof(*taken->changes)*(size>0 ? size : 1));
+        if(!taken->changes){
+            return false;
+        }
+        taken->changes_number=0;
+        AS_CURSOR_FOREACH(cursor,shard->list_of_products){
+            ProductChange* change=&taken->changes[taken->changes_number++];
+            change->id=((Product)asCursorGetElement(cursor))->id;
+            change->cursor=cursor;
+            takeProductState(cursor,&change->state);
+        }
+        for(int i=0;i<shard->changes_number;i++){
+            if(shard->changes[i].cursor){
+                Product product=asCursorGetElement(shard->changes[i].cursor);
+                product->change_index=0;
+            }
+        }
+        shard->changes_number=0;
+        shard->changes_lost=false;
+        shard->tracked=true;
+        return true;
+    }
+    // the changes are handed over as they are, and a new array is allocated
+    // for the next ones when they come
+    taken->changes=shard->changes;
+    taken->changes_number=shard->changes_number;
+    shard->changes=NULL;
+    shard->changes_number=0;
+    shard->changes_capacity=0;
+    for(int i=0;i<taken->changes_number;i++){
+        ProductChange* change=&taken->changes[i];
+        if(change->cursor){
+            takeProductState(change->cursor,&change->state);
+            change->state.product->change_index=0;
+        } else{
+            change->state.product=NULL;
+        }
+    }
+    return true;
+}
+
+/**
+ * applyShardChanges: brings the snapshot of a shard up to date with the
+ *                    products that were taken from it, and releases them. If
+ *                    an allocation fails, the snapshot is kept as it was and
+ *                    marked as stale. The snapshots must be locked.
+ *
+ * @param matamazom - The warehouse of the shard.
+ * @param index - The index of the shard.
+ * @param taken - The products that were taken by takeShardChanges.
+ *
+ * @return:
+ *      false - if an allocation failed.
+ *      true - otherwise.
+ */
+static bool applyShardChanges(Matamazom matamazom, int index,
+                              ShardChanges* taken){
+    Shard shard=&matamazom->shards[index];
+    bool failed=false;
+    ProductNode snapshot;
+    if(taken->rebuild){
+        snapshot=buildNodes(taken->changes,0,taken->changes_number,&failed);
+    } else{
+        snapshot=retainNode(shard->snapshot);
+        for(int i=0;i<taken->changes_number && !failed;i++){
+            ProductChange* change=&taken->changes[i];
+            ProductNode next=change->state.product ?
+                    putNode(snapshot,&change->state,&failed) :
+                    removeNode(snapshot,change->id,&failed);
+            releaseNode(snapshot);
+            snapshot=next;
+        }
+    }
+    if(failed){
+        releaseNode(snapshot);
+        shard->snapshot_stale=true;
+    } else{
+        releaseNode(shard->snapshot);
+        shard->snapshot=snapshot;
+        shard->snapshot_stale=false;
+    }
+    for(int i=0;i<taken->changes_number;i++){
+        if(taken->changes[i].state.product){
+            freeProduct(taken->changes[i].state.product);
+        }
+    }
+    free(taken->changes);
+    return !failed;
+}
+
+/**
+ * pinInventoryView: brings the snapshots of all the shards of a warehouse up
+ *                   to date, in every mode, for a view that is read after the
+ *                   warehouse goes on changing. The shards are only locked
+ *                   while the products that changed since the last snapshot
+ *                   are taken, and the snapshots are built after they are
+ *                   unlocked.
+ *
+ * @param matamazom - The warehouse to view.
+ * @param view - The view to prepare. It must be closed with
+ *     closeInventoryView, even if pinning failed.
+ *
+ * @return:
+ *      false - if an allocation failed.
+ *      true - otherwise.
+ */
+static bool pinInventoryView(Matamazom matamazom, InventoryView* view){
+    view->shards_number=matamazom->shards_number;
+    view->pinned=true;
+    view->locked=false;
+    ShardChanges taken[MATAMAZOM_SHARDS_NUMBER];
+    int taken_number=0;
+    if(matamazom->concurrent){
+        pthread_mutex_lock(&matamazom->snapshots_lock);
+    }
+    // the products of every shard are taken while all the shards are locked,
+    // so together the snapshots show the warehouse at a single moment
+    lockAllShards(matamazom,true);
+    while(taken_number<view->shards_number &&
+          takeShardChanges(matamazom,taken_number,&taken[taken_number])){
+        taken_number++;
+    }
+    unlockAllShards(matamazom);
+    bool pinned=taken_number==view->shards_number;
+    for(int i=0;i<taken_number;i++){
+        pinned=applyShardChanges(matamazom,i,&taken[i]) && pinned;
+    }
+    for(int i=0;i<view->shards_number;i++){
+        view->list_of_products[i]=NULL;
+        view->snapshots[i]=pinned ?
+                retainNode(matamazom->shards[i].snapshot) : NULL;
+    }
+    if(matamazom->concurrent){
+        pthread_mutex_unlock(&matamazom->snapshots_lock);
+    }
+    return pinned;
+}
+
+/**
+ * openInventoryView: prepares the products of a warehouse for a report.
+ *
+ * In MATAMAZOM_CONCURRENT mode the report reads snapshots of the shards, so
+ * it needs no lock while it runs (@see pinInventoryView). If a snapshot
+ * cannot be brought up to date, the shards stay locked for reading until the
+ * report ends instead.
+ *
+ * @param matamazom - The warehouse to report.
+ * @param view - The view to prepare. It must be closed with
+ *     closeInventoryView.
+ */
+static void openInventoryView(Matamazom matamazom, InventoryView* view){
+    if(matamazom->concurrent && pinInventoryView(matamazom,view)){
+        return;
+    }
+    view->shards_number=matamazom->shards_number;
+    view->pinned=false;
+    view->locked=matamazom->concurrent;
+    for(int i=0;i<view->shards_number;i++){
+        view->list_of_products[i]=matamazom->shards[i].list_of_products;
+        view->snapshots[i]=NULL;
+    }
+    if(view->locked){
+        lockAllShards(matamazom,false);
+    }
+}
+
+/**
+ * closeInventoryView: releases what openInventoryView or pinInventoryView
+ *                     took.
+ *
+ * @param matamazom - The reported warehouse.
+ * @param view - The view to close.
+ */
+static void closeInventoryView(Matamazom matamazom, InventoryView* view){
+    for(int i=0;i<view->shards_number;i++){
+        releaseNode(view->snapshots[i]);
+    }
+    if(view->locked){
+        unlockAllShards(matamazom);
+    }
+}
+
+/**
+ * ShipRequest
+ *
+ * This is an internal struct implemented to be used by mtmShipOrders.
+ * It keeps a requested order id together with its place in the request, so the
+ * requests can be sorted by order id and still be answered in place.
+ *
+ * @param order_id - The id of the order to ship.
+ * @param position - The index of the request in the received arrays.
+ */
+typedef struct ship_request{
+    unsigned int order_id;
+    int position;
+}ShipRequest;
+
+/**
+ * compareShipRequests: a compare function for qsort, that sorts ship requests
+ *                      by order id, and requests of the same order by their
+ *                      position.
+ *
+ * @param element1 - a pointer to the first request to be compared.
+ * @param element2 - a pointer to the second request to be compared.
+ *
+ * @return:
+ *      A negative number, zero or a positive number if the first request
+ *      should come before, is equal to or should come after the second one.
+ */
+static int compareShipRequests(const void* element1, const void* element2){
+    const ShipRequest* request1=element1;
+    const ShipRequest* request2=element2;
+    if(request1->order_id != request2->order_id){
+        return request1->order_id > request2->order_id ?
+                                            COMPARE_SMALLER : COMPARE_LARGER;
+    }
+    return request1->position - request2->position;
+}
+
+/**
+ * findCatalogIndex: receives the warehouse products as an array sorted by id,
+ *                   and finds the index of the product with the given id
+ *                   using binary search.
+ *
+ * @param catalog - An array of cursors to the warehouse products.
+ * @param size - The number of products in the array.
+ * @param productId - The id of the desired product.
+ *
+ * @return:
+ *      -1 - if there is no product with the given id in the array.
+ *      The index of the desired product otherwise.
+ */
+static int findCatalogIndex(ASCursor* catalog, int size, unsigned int productId){
+    int low=0;
+    int high=size-1;
+    while(low<=high){
+        int middle=low+(high-low)/2;
+        unsigned int middle_id=((Product)asCursorGetElement(catalog[middle]))->id;
+        if(middle_id == productId){
+            return middle;
+        }
+        if(middle_id < productId){
+            low=middle+1;
+        } else{
+            high=middle-1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * createShard: creates an empty shard in a warehouse.
+ *
+ * @param matamazom - The warehouse of the shard.
+ * @param index - The index of the shard.
+ *
+ * @return:
+ *      false - if an allocation failed.
+ *      true - if the shard was created successfully.
+ */
+static bool createShard(Matamazom matamazom, int index){
+    Shard shard=&matamazom->shards[index];
+    shard->list_of_products=asCreate(copyProductForAmountSet,
+            freeProductForAmountSet,compareProductsForAmountSet);
+    if(!shard->list_of_products){
+        return false;
+    }
+    if(matamazom->concurrent && pthread_rwlock_init(&shard->lock,NULL) != 0){
+        asDestroy(shard->list_of_products);
+        return false;
+    }
+    if(matamazom->concurrent &&
+            pthread_mutex_init(&shard->orders_lock,NULL) != 0){
+        pthread_rwlock_destroy(&shard->lock);
+        asDestroy(shard->list_of_products);
+        return false;
+    }
+    if(matamazom->concurrent &&
+            pthread_mutex_init(&shard->changes_lock,NULL) != 0){
+        pthread_mutex_destroy(&shard->orders_lock);
+        pthread_rwlock_destroy(&shard->lock);
+        asDestroy(shard->list_of_products);
+        return false;
+    }
+    shard->snapshot=NULL;
+    shard->snapshot_stale=false;
+    shard->tracked=false;
+    shard->changes=NULL;
+    shard->changes_number=0;
+    shard->changes_capacity=0;
+    shard->changes_lost=false;
+    return true;
+}
+
+/**
+ * destroyShards: frees the first shards of a warehouse.
+ *
+ * @param matamazom - The warehouse of the shards.
+ * @param shards_number - The number of shards to free.
+ */
+static void destroyShards(Matamazom matamazom, int shards_number){
+    for(int i=0;i<shards_number;i++){
+        if(matamazom->concurrent){
+            pthread_rwlock_destroy(&matamazom->shards[i].lock);
+            pthread_mutex_destroy(&matamazom->shards[i].orders_lock);
+            pthread_mutex_destroy(&matamazom->shards[i].changes_lock);
+        }
+        releaseNode(matamazom->shards[i].snapshot);
+        free(matamazom->shards[i].changes);
+        asDestroy(matamazom->shards[i].list_of_products);
+    }
+}
+
+/**
+ * createOrderStripe: creates an empty order stripe in a warehouse.
+ *
+ * @param matamazom - The warehouse of the stripe.
+ * @param index - The index of the stripe.
+ *
+ * @return:
+ *      false - if an allocation failed.
+ *      true - if the stripe was created successfully.
+ */
+static bool createOrderStripe(Matamazom matamazom, int index){
+    OrderStripe stripe=&matamazom->order_stripes[index];
+    stripe->set_of_orders=setCreate(copyOrderForSet,freeOrderForSet,
+            compareOrdersForSet);
+    if(!stripe->set_of_orders){
+        return false;
+    }
+    if(matamazom->concurrent && pthread_mutex_init(&stripe->lock,NULL) != 0){
+        setDestroy(stripe->set_of_orders);
+        return false;
     }
     return true;
 }
 
-Matamazom matamazomCreate(){
-    Matamazom warehouse=malloc(sizeof(*warehouse));
-    if(!warehouse){
-        return NULL;
+/**
+ * destroyOrderStripes: destroys the first order stripes of a warehouse, and
+ *                      the orders in them.
+ *
+ * @param matamazom - The warehouse of the stripes.
+ * @param stripes_number - The number of stripes to destroy.
+ */
+static void destroyOrderStripes(Matamazom matamazom, int stripes_number){
+    for(int i=0;i<stripes_number;i++){
+        if(matamazom->concurrent){
+            pthread_mutex_destroy(&matamazom->order_stripes[i].lock);
+        }
+        setDestroy(matamazom->order_stripes[i].set_of_orders);
+    }
+}
+
+/**
+ * findProductCursor: returns a cursor to a product of a warehouse.
+ *
+ * @param matamazom - The warehouse of the product.
+ * @param id - The id of the desired product.
+ *
+ * @return:
+ *      NULL - if there is no product with the given id in the warehouse.
+ *      A cursor to the desired product otherwise.
+ */
+static ASCursor findProductCursor(Matamazom matamazom, unsigned int id){
+    ASCursor cursor=advanceToProduct(
+            asCursorFirst(getProductsOfShard(matamazom,id)),id);
+    if(!cursor || ((Product)asCursorGetElement(cursor))->id != id){
+        return NULL;
+    }
+    return cursor;
+}
+
+/**
+ * destroyChangeFeed: frees a change feed.
+ *
+ * @param feed - The feed to free, or NULL.
+ */
+static void destroyChangeFeed(ChangeFeed feed){
+    if(!feed){
+        return;
+    }
+    pthread_mutex_destroy(&feed->lock);
+    free(feed->events);
+    free(feed);
+}
+
+Matamazom matamazomCreate(){
+    return matamazomCreateWithMode(MATAMAZOM_DEFAULT_MODE);
+}
+
+Matamazom matamazomCreateWithMode(const unsigned int modeFlags){
+    Matamazom warehouse=malloc(sizeof(*warehouse));
+    if(!warehouse){
+        return NULL;
+    }
+    warehouse->current_order_id=0;
+    warehouse->prices_epoch=0;
+    warehouse->change_feed=NULL;
+    warehouse->reserve_stock=(modeFlags & MATAMAZOM_RESERVE_STOCK) != 0;
+    warehouse->concurrent=
+            (modeFlags & (MATAMAZOM_CONCURRENT | MATAMAZOM_SHARDED)) != 0;
+    warehouse->shards_number=
+            (modeFlags & MATAMAZOM_SHARDED) ? MATAMAZOM_SHARDS_NUMBER : 1;
+    for(int i=0;i<warehouse->shards_number;i++){
+        if(!createShard(warehouse,i)){
+            destroyShards(warehouse,i);
+            free(warehouse);
+            return NULL;
+        }
+    }
+    warehouse->order_stripes_number=
+            warehouse->concurrent ? ORDER_STRIPES_NUMBER : 1;
+    for(int i=0;i<warehouse->order_stripes_number;i++){
+        if(!createOrderStripe(warehouse,i)){
+            destroyOrderStripes(warehouse,i);
+            destroyShards(warehouse,warehouse->shards_number);
+            free(warehouse);
+            return NULL;
+        }
+    }
+    if(warehouse->concurrent &&
+            pthread_mutex_init(&warehouse->snapshots_lock,NULL) != 0){
+        destroyOrderStripes(warehouse,warehouse->order_stripes_number);
+        destroyShards(warehouse,warehouse->shards_number);
+        free(warehouse);
+        return NULL;
+    }
+    return warehouse;
+}
+
+void matamazomDestroy(Matamazom matamazom){
+    if(!matamazom){
+        return;
+    }
+    destroyOrderStripes(matamazom,matamazom->order_stripes_number);
+    destroyShards(matamazom,matamazom->shards_number);
+    if(matamazom->concurrent){
+        pthread_mutex_destroy(&matamazom->snapshots_lock);
+    }
+    destroyChangeFeed(matamazom->change_feed);
+    free(matamazom);
+}
+
+static MatamazomResult addNewProduct(Matamazom matamazom, const unsigned int id,
+                                       const char *name, const double amount,
+                                       const MatamazomAmountType amountType,
+                                       const MtmProductData customData,
+                                       MtmCopyData copyData, MtmFreeData freeData,
+                                       MtmGetProductPrice prodPrice,
+                                       const MtmPriceFlags priceFlags,
+                                       const MtmPriceRule* priceRule,
+                                       MtmGetProductPriceBatch prodPriceBatch,
+                                       const size_t inlineDataSize){
+    bool data_inline=inlineDataSize>0;
+    if(!matamazom || !name ||!customData ||
+                            (!data_inline && (!copyData ||!freeData)) ||
+                            (!prodPrice && !priceRule && !prodPriceBatch)){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    if(inlineDataSize>MTM_INLINE_DATA_SIZE){
+        return MATAMAZOM_INVALID_DATA_SIZE;
+    }
+    if(!checkIfNameIsValid(name)){
+        return MATAMAZOM_INVALID_NAME;
+    }
+    Quantity quantity;
+    if(!mtmIsAmountValid(amountType,amount)||amount<0||
+            !toQuantity(amount,&quantity)){
+        return MATAMAZOM_INVALID_AMOUNT;
+    }
+    PriceTiers price_tiers=NO_PRICE_TIERS;
+    if(priceRule && !makePriceTiers(priceRule,&price_tiers)){
+        return MATAMAZOM_INVALID_AMOUNT;
+    }
+    Product new_product=malloc(sizeof(*new_product));
+    if(!new_product){
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    new_product->id=id;
+    new_product->references=1;
+    new_product->change_index=0;
+    new_product->price_cache=NULL;
+    new_product->orders=NO_ORDERS;
+    new_product->priced_by_rule=priceRule!=NULL;
+    new_product->price_tiers=price_tiers;
+    new_product->get_price_batch_function=prodPriceBatch;
+    new_product->data_inline=data_inline;
+    new_product->additional_info=NULL;
+    new_product->free_function=freeData;
+
+    new_product->name=malloc(strlen(name)+1);
+    if(!new_product->name){
+        freeProduct(new_product);
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    strcpy(new_product->name,name);
+    new_product->copy_function=copyData;
+    new_product->get_price_function=prodPrice;
+    new_product->income=0;
+    new_product->reserved=0;
+    if(data_inline){
+        memset(&new_product->inline_data,0,sizeof(new_product->inline_data));
+        memcpy(new_product->inline_data.bytes,customData,inlineDataSize);
+        new_product->additional_info=new_product->inline_data.bytes;
+    } else{
+        new_product->additional_info=copyData(customData);
+    }
+    if(!new_product->additional_info){
+        freeProduct(new_product);
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    new_product->amount_type=amountType;
+    if((priceFlags & MTM_PRICE_CACHEABLE) && prodPrice){
+        new_product->price_cache=createPriceCache();
+        if(!new_product->price_cache){
+            freeProduct(new_product);
+            return MATAMAZOM_OUT_OF_MEMORY;
+        }
+    }
+    new_product->unit_price=getPriceOfProduct(new_product,UNIT);
+    AmountSet shard_products=getProductsOfShard(matamazom,id);
+    AmountSetResult registerNewProduct=asRegister(shard_products,new_product);
+    if (registerNewProduct==AS_ITEM_ALREADY_EXISTS){
+        freeProduct(new_product);
+        return MATAMAZOM_PRODUCT_ALREADY_EXIST;
+    } else if(registerNewProduct==AS_OUT_OF_MEMORY){
+        freeProduct(new_product);
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    asChangeAmount(shard_products,new_product,(double)quantity);
+    markProductChanged(matamazom,findProductCursor(matamazom,id));
+    publishEvent(matamazom,MTM_EVENT_PRODUCT_CREATED,id,0,quantity);
+    freeProduct(new_product); //because asRegister makes a newCopy
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmNewProduct(Matamazom matamazom, const unsigned int id,
+                                const char *name, const double amount,
+                                const MatamazomAmountType amountType,
+                                const MtmProductData customData,
+                                MtmCopyData copyData, MtmFreeData freeData,
+                                MtmGetProductPrice prodPrice){
+    return mtmNewProductWithFlags(matamazom, id, name, amount, amountType,
+            customData, copyData, freeData, prodPrice, MTM_PRICE_DEFAULT);
+}
+
+MatamazomResult mtmNewProductWithFlags(Matamazom matamazom,
+                                       const unsigned int id, const char *name,
+                                       const double amount,
+                                       const MatamazomAmountType amountType,
+                                       const MtmProductData customData,
+                                       MtmCopyData copyData,
+                                       MtmFreeData freeData,
+                                       MtmGetProductPrice prodPrice,
+                                       const MtmPriceFlags priceFlags){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    int shard_index=getShardIndex(matamazom,id);
+    lockShard(matamazom,shard_index,true);
+    MatamazomResult result=addNewProduct(matamazom, id, name, amount,
+            amountType, customData, copyData, freeData, prodPrice, priceFlags,
+            NULL, NULL, 0);
+    unlockShard(matamazom,shard_index);
+    return result;
+}
+
+MatamazomResult mtmNewProductWithRule(Matamazom matamazom,
+                                      const unsigned int id, const char *name,
+                                      const double amount,
+                                      const MatamazomAmountType amountType,
+                                      const MtmProductData customData,
+                                      MtmCopyData copyData,
+                                      MtmFreeData freeData,
+                                      const MtmPriceRule *priceRule){
+    if(!matamazom || !priceRule){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    int shard_index=getShardIndex(matamazom,id);
+    lockShard(matamazom,shard_index,true);
+    MatamazomResult result=addNewProduct(matamazom, id, name, amount,
+            amountType, customData, copyData, freeData, NULL,
+            MTM_PRICE_DEFAULT, priceRule, NULL, 0);
+    unlockShard(matamazom,shard_index);
+    return result;
+}
+
+MatamazomResult mtmNewProductWithBatchPrice(Matamazom matamazom,
+                                        const unsigned int id, const char *name,
+                                        const double amount,
+                                        const MatamazomAmountType amountType,
+                                        const MtmProductData customData,
+                                        MtmCopyData copyData,
+                                        MtmFreeData freeData,
+                                        MtmGetProductPriceBatch prodPriceBatch){
+    if(!matamazom || !prodPriceBatch){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    int shard_index=getShardIndex(matamazom,id);
+    lockShard(matamazom,shard_index,true);
+    MatamazomResult result=addNewProduct(matamazom, id, name, amount,
+            amountType, customData, copyData, freeData, NULL,
+            MTM_PRICE_DEFAULT, NULL, prodPriceBatch, 0);
+    unlockShard(matamazom,shard_index);
+    return result;
+}
+
+MatamazomResult mtmNewProductWithInlineData(Matamazom matamazom,
+                                        const unsigned int id, const char *name,
+                                        const double amount,
+                                        const MatamazomAmountType amountType,
+                                        const void *customData,
+                                        const size_t dataSize,
+                                        MtmGetProductPrice prodPrice){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    if(dataSize==0){
+        return MATAMAZOM_INVALID_DATA_SIZE;
+    }
+    int shard_index=getShardIndex(matamazom,id);
+    lockShard(matamazom,shard_index,true);
+    MatamazomResult result=addNewProduct(matamazom, id, name, amount,
+            amountType, (MtmProductData)customData, NULL, NULL, prodPrice,
+            MTM_PRICE_DEFAULT, NULL, NULL, dataSize);
+    unlockShard(matamazom,shard_index);
+    return result;
+}
+
+/**
+ * checkAmountChange: checks whether an amount can be added to the amount of a
+ *                    product of the warehouse, as described in
+ *                    mtmChangeProductAmount, without changing anything.
+ *
+ * @param matamazom - The warehouse of the product.
+ * @param product - The product in the warehouse.
+ * @param original_amount - The amount of the product before the change, in
+ *     millionths.
+ * @param amount - The amount to add to the product.
+ * @param amount_is_valid - Whether the amount is valid for the amount type of
+ *     the product.
+ * @param new_amount - Set to the amount of the product after the change, if
+ *     it is allowed.
+ *
+ * @return:
+ *      The result of the change, as described in mtmChangeProductAmount.
+ */
+static MatamazomResult checkAmountChange(Matamazom matamazom, Product product,
+                                         const Quantity original_amount,
+                                         const double amount,
+                                         const bool amount_is_valid,
+                                         Quantity* new_amount){
+    Quantity change;
+    if(!amount_is_valid || !toQuantity(amount,&change)){
+        return MATAMAZOM_INVALID_AMOUNT;
+    }
+    Quantity changed_amount=original_amount + change;
+    if(changed_amount>QUANTITY_LIMIT ||
+            !checkIfQuantityIsValid(product->amount_type,changed_amount)){
+        return MATAMAZOM_INVALID_AMOUNT;
+    }
+    if(changed_amount<0){
+        return MATAMAZOM_INSUFFICIENT_AMOUNT;
+    }
+    if(matamazom->reserve_stock && amount<0 &&
+                                    changed_amount<product->reserved){
+        return MATAMAZOM_INSUFFICIENT_AMOUNT;
+    }
+    *new_amount=changed_amount;
+    return MATAMAZOM_SUCCESS;
+}
+
+/**
+ * changeAmountOfCursor: applies several changes to the amount of a product of
+ *                       the warehouse one after the other, as described in
+ *                       mtmChangeProductAmount. The changes are coalesced, so
+ *                       the amount is only written once, with the amount the
+ *                       last successful change left.
+ *
+ * @param matamazom - The warehouse of the product.
+ * @param cursor - A cursor to the product in the warehouse.
+ * @param amounts - The amounts to add to the product, in order.
+ * @param n - The number of changes.
+ * @param results - Set to the result of every change.
+ */
+static void changeAmountOfCursor(Matamazom matamazom, ASCursor cursor,
+                                 const double* amounts, const int n,
+                                 MatamazomResult* results){
+    Product wantedProduct=asCursorGetElement(cursor);
+    // other threads may change the amount meanwhile, so the new amount is
+    // only written if the amount it was computed from is still there
+    double  originalAmount;
+    asCursorGetAmount(cursor,&originalAmount);
+    Quantity newAmount;
+    bool changed;
+    do{
+        newAmount=(Quantity)originalAmount;
+        changed=false;
+        // the amounts are validated a chunk at a time, before it is applied
+        for(int first=0;first<n;first=first+VALIDATION_CHUNK_SIZE){
+            int chunk_size=n-first<VALIDATION_CHUNK_SIZE ? n-first :
+                    VALIDATION_CHUNK_SIZE;
+            bool valid[VALIDATION_CHUNK_SIZE];
+            mtmValidateAmounts(wantedProduct->amount_type,amounts+first,
+                    chunk_size,valid);
+            for(int i=first;i<first+chunk_size;i++){
+                results[i]=checkAmountChange(matamazom,wantedProduct,
+                        newAmount,amounts[i],valid[i-first],&newAmount);
+                changed=changed || results[i]==MATAMAZOM_SUCCESS;
+            }
+        }
+        if(!changed){
+            return;
+        }
+    } while(!asCursorCompareAndSwapAmount(cursor,&originalAmount,
+                                          (double)newAmount));
+    markProductChanged(matamazom,cursor);
+    publishEvent(matamazom,MTM_EVENT_STOCK_CHANGED,wantedProduct->id,0,
+            newAmount-(Quantity)originalAmount);
+}
+
+static MatamazomResult changeProductAmount(Matamazom matamazom,
+                                            const unsigned int id,
+                                            const double amount){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    ASCursor cursor=findProductCursor(matamazom,id);
+    if(!cursor){
+        return MATAMAZOM_PRODUCT_NOT_EXIST;
+    }
+    MatamazomResult result;
+    changeAmountOfCursor(matamazom,cursor,&amount,1,&result);
+    return result;
+}
+
+MatamazomResult mtmChangeProductAmount(Matamazom matamazom,
+                                        const unsigned int id,
+                                        const double amount){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    // the amount is changed atomically, so the shard is only locked against
+    // changes to its structure
+    int shard_index=getShardIndex(matamazom,id);
+    lockShard(matamazom,shard_index,false);
+    MatamazomResult result=changeProductAmount(matamazom, id, amount);
+    unlockShard(matamazom,shard_index);
+    return result;
+}
+
+static MatamazomResult changeProductAmountBatch(Matamazom matamazom,
+                                                const unsigned int id,
+                                                const double *amounts,
+                                                const int n,
+                                                MatamazomResult *results){
+    if(!matamazom || (n>0 && (!amounts || !results))){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    // the product is only looked up once for all of the changes
+    ASCursor cursor=findProductCursor(matamazom,id);
+    if(!cursor){
+        for(int i=0;i<n;i++){
+            results[i]=MATAMAZOM_PRODUCT_NOT_EXIST;
+        }
+        return MATAMAZOM_SUCCESS;
+    }
+    changeAmountOfCursor(matamazom,cursor,amounts,n,results);
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmChangeProductAmountBatch(Matamazom matamazom,
+                                            const unsigned int id,
+                                            const double *amounts, const int n,
+                                            MatamazomResult *results){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
     }
-    warehouse->list_of_products=
-            asCreate(copyProductForAmountSet,freeProductForAmountSet,
-                    compareProductsForAmountSet);
-    if(!warehouse->list_of_products){
-        free(warehouse);
-        return NULL;
+    int shard_index=getShardIndex(matamazom,id);
+    lockShard(matamazom,shard_index,false);
+    MatamazomResult result=changeProductAmountBatch(matamazom, id, amounts, n,
+            results);
+    unlockShard(matamazom,shard_index);
+    return result;
+}
+
+static MatamazomResult invalidatePrices(Matamazom matamazom,
+                                        const unsigned int id){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
     }
-    warehouse->set_of_orders=setCreate(copyOrderForSet,freeOrderForSet,
-            compareOrdersForSet);
-    if(!warehouse->set_of_orders){
-        asDestroy(warehouse->list_of_products);
-        free(warehouse);
-        return NULL;
+    ASCursor cursor=findProductCursor(matamazom,id);
+    if(!cursor){
+        return MATAMAZOM_PRODUCT_NOT_EXIST;
     }
-    warehouse->current_order_id=0;
-    return warehouse;
+    Product product=asCursorGetElement(cursor);
+    invalidatePriceCache(product->price_cache);
+    product->unit_price=getPriceOfProduct(product,UNIT);
+    markProductChanged(matamazom,cursor);
+    // the orders of the product are not known, so all the totals are dirty
+    __atomic_add_fetch(&matamazom->prices_epoch,1,__ATOMIC_RELEASE);
+    return MATAMAZOM_SUCCESS;
 }
 
-void matamazomDestroy(Matamazom matamazom){
+MatamazomResult mtmInvalidatePrices(Matamazom matamazom, const unsigned int id){
     if(!matamazom){
-        return;
+        return MATAMAZOM_NULL_ARGUMENT;
     }
-    setDestroy(matamazom->set_of_orders);
-    asDestroy(matamazom->list_of_products);
-    free(matamazom);
+    int shard_index=getShardIndex(matamazom,id);
+    lockShard(matamazom,shard_index,true);
+    MatamazomResult result=invalidatePrices(matamazom, id);
+    unlockShard(matamazom,shard_index);
+    return result;
 }
 
-MatamazomResult mtmNewProduct(Matamazom matamazom, const unsigned int id,
-                                const char *name, const double amount,
-                                const MatamazomAmountType amountType,
-                                const MtmProductData customData,
-                                MtmCopyData copyData, MtmFreeData freeData,
-                                MtmGetProductPrice prodPrice){
-    if(!matamazom || !name ||!customData ||!copyData ||!freeData ||!prodPrice){
+static MatamazomResult clearProduct(Matamazom matamazom, const unsigned int id){
+    if(!matamazom){
         return MATAMAZOM_NULL_ARGUMENT;
     }
-    if(!checkIfNameIsValid(name)){
-        return MATAMAZOM_INVALID_NAME;
+    int shard_index=getShardIndex(matamazom,id);
+    lockShard(matamazom,shard_index,true);
+    AmountSet shard_products=getProductsOfShard(matamazom,id);
+    Product wantedProduct =getProductFromId(shard_products,id);
+    if(wantedProduct==NULL){
+        unlockShard(matamazom,shard_index);
+        return MATAMAZOM_PRODUCT_NOT_EXIST;
     }
-    if(!checkIfAmountIsValid(amountType,amount)||amount<0){
-        return MATAMAZOM_INVALID_AMOUNT;
+    // only the orders of the product are visited. Orders are locked before
+    // shards, so the shard is let go while each order is locked. No order can
+    // be found meanwhile, and the product stays, but changes to orders that
+    // were found before may still add the product to them.
+    while(wantedProduct->orders.size>0){
+        Order current_order=
+                wantedProduct->orders.orders[wantedProduct->orders.size-1];
+        unlockShard(matamazom,shard_index);
+        lockOrder(matamazom,current_order);
+        lockShard(matamazom,shard_index,true);
+        if(asDelete(current_order->list_of_order_products,
+                (ASElement)wantedProduct)==AS_SUCCESS){
+            current_order->total_dirty=true;
+        }
+        removeFromOrderIndex(&wantedProduct->orders,current_order->id);
+        unlockOrder(matamazom,current_order);
     }
-    Product new_product=malloc(sizeof(*new_product));
-    if(!new_product){
-        return MATAMAZOM_OUT_OF_MEMORY;
+    markProductCleared(matamazom,wantedProduct);
+    asDelete(shard_products,(ASElement)wantedProduct);
+    publishEvent(matamazom,MTM_EVENT_PRODUCT_CLEARED,id,0,0);
+    unlockShard(matamazom,shard_index);
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmClearProduct(Matamazom matamazom, const unsigned int id){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
     }
-    new_product->id=id;
+    // no order can be found, and so get the product, until it is cleared
+    lockAllOrderStripes(matamazom);
+    MatamazomResult result=clearProduct(matamazom, id);
+    unlockAllOrderStripes(matamazom);
+    return result;
+}
 
-    new_product->name=malloc(strlen(name)+1);
-    if(!new_product->name){
-        freeProduct(new_product);
-        return MATAMAZOM_OUT_OF_MEMORY;
+static MatamazomResult printBestSelling(const InventoryView* view,
+                                        FILE *output){
+    if(!output){
+        return MATAMAZOM_NULL_ARGUMENT;
     }
-    strcpy(new_product->name,name);
-    new_product->copy_function=copyData;
-    new_product->free_function=freeData;
-    new_product->get_price_function=prodPrice;
-    new_product->income=0;
-    new_product->additional_info=copyData(customData);
-    if(!new_product->additional_info){
-        freeProduct(new_product);
-        return MATAMAZOM_OUT_OF_MEMORY;
+    Product bestSellingProduct=NULL;
+    Quantity max_income=0;
+    ViewWalk walk;
+    VIEW_PRODUCTS_FOREACH(current,&walk,view){
+        if(!bestSellingProduct){
+            bestSellingProduct=current->product;
+            max_income=current->income;
+        }
+        if(current->income > max_income){
+            bestSellingProduct=current->product;
+            max_income=current->income;
+        }
     }
-    new_product->amount_type=amountType;
-    AmountSetResult registerNewProduct=asRegister
-                                      (matamazom->list_of_products,new_product);
-    if (registerNewProduct==AS_ITEM_ALREADY_EXISTS){
-        freeProduct(new_product);
-        return MATAMAZOM_PRODUCT_ALREADY_EXIST;
-    } else if(registerNewProduct==AS_OUT_OF_MEMORY){
-        freeProduct(new_product);
+    if(!bestSellingProduct || max_income==0){
+        printNoBestSellingProduct(output);
+        return MATAMAZOM_SUCCESS;
+    }
+    fprintf(output,"Best Selling Product:\n");
+    mtmPrintIncomeLine(bestSellingProduct->name,bestSellingProduct->id,
+            fromQuantity(max_income),output);
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintBestSelling(Matamazom matamazom, FILE *output){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    InventoryView view;
+    openInventoryView(matamazom,&view);
+    MatamazomResult result=printBestSelling(&view, output);
+    closeInventoryView(matamazom,&view);
+    return result;
+}
+
+static MatamazomResult printFiltered(const InventoryView* view,
+                                        MtmFilterProduct customFilter,FILE *output){
+    if(!customFilter || !output){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    ViewWalk walk;
+    VIEW_PRODUCTS_FOREACH(current,&walk,view){
+        Product currentProduct=current->product;
+        if(customFilter(currentProduct->id,currentProduct->name,
+                        fromQuantity(current->amount),
+                        currentProduct->additional_info)){
+            printProductState(current,output);
+        }
+    }
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintFiltered(Matamazom matamazom,
+                                    MtmFilterProduct customFilter,FILE *output){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    InventoryView view;
+    openInventoryView(matamazom,&view);
+    MatamazomResult result=printFiltered(&view, customFilter, output);
+    closeInventoryView(matamazom,&view);
+    return result;
+}
+
+/**
+ * FilterContext
+ *
+ * This is an internal struct implemented to be used by
+ * mtmPrintFilteredParallel, as the context of a ParallelJob.
+ *
+ * @param products - The products to filter, in ascending id order.
+ * @param matches - Set to whether every product passed the filter.
+ * @param filter - The filter of the user.
+ */
+typedef struct filter_context{
+    ProductState* products;
+    bool* matches;
+    MtmFilterProduct filter;
+}FilterContext;
+
+/**
+ * filterProducts: an EvaluateChunk function that filters a chunk of products.
+ *
+ * @param context - The FilterContext of the job.
+ * @param first - The index of the first product of the chunk.
+ * @param end - The index after the last product of the chunk.
+ */
+static void filterProducts(void* context, int first, int end){
+    FilterContext* filter_context=context;
+    for(int i=first;i<end;i++){
+        const ProductState* state=&filter_context->products[i];
+        filter_context->matches[i]=filter_context->filter(state->product->id,
+                state->product->name,fromQuantity(state->amount),
+                state->product->additional_info);
+    }
+}
+
+static MatamazomResult printFilteredParallel(const InventoryView* view,
+                                             MtmFilterProduct customFilter,
+                                             FILE *output){
+    if(!customFilter || !output){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    int products_number=0;
+    for(int i=0;i<view->shards_number;i++){
+        products_number=products_number+(view->pinned ?
+                getSizeOfNode(view->snapshots[i]) :
+                asGetSize(view->list_of_products[i]));
+    }
+    FilterContext context;
+    context.filter=customFilter;
+    context.products=malloc(sizeof(*context.products)*(products_number+1));
+    context.matches=malloc(sizeof(*context.matches)*(products_number+1));
+    if(!context.products || !context.matches){
+        free(context.products);
+        free(context.matches);
+        return printFiltered(view, customFilter, output);
+    }
+    int index=0;
+    ViewWalk walk;
+    VIEW_PRODUCTS_FOREACH(current,&walk,view){
+        context.products[index++]=*current;
+    }
+    runParallelJob(&context,filterProducts,products_number,
+            PARALLEL_THREADS_NUMBER);
+    for(int i=0;i<products_number;i++){
+        if(context.matches[i]){
+            printProductState(&context.products[i],output);
+        }
+    }
+    free(context.products);
+    free(context.matches);
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintFilteredParallel(Matamazom matamazom,
+                                         MtmFilterProduct customFilter,
+                                         const bool filterIsThreadSafe,
+                                         FILE *output){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    InventoryView view;
+    openInventoryView(matamazom,&view);
+    MatamazomResult result=filterIsThreadSafe ?
+            printFilteredParallel(&view, customFilter, output) :
+            printFiltered(&view, customFilter, output);
+    closeInventoryView(matamazom,&view);
+    return result;
+}
+
+static MatamazomResult printInventory(const InventoryView* view, FILE *output){
+    if(!output){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    fprintf(output,"Inventory Status:\n");
+    ViewWalk walk;
+    VIEW_PRODUCTS_FOREACH(current,&walk,view){
+        printProductState(current, output);
+    }
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintInventory(Matamazom matamazom, FILE *output){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    InventoryView view;
+    openInventoryView(matamazom,&view);
+    MatamazomResult result=printInventory(&view, output);
+    closeInventoryView(matamazom,&view);
+    return result;
+}
+
+static MatamazomResult printInventoryRange(const InventoryView* view,
+                                           const unsigned int lowId,
+                                           const unsigned int highId,
+                                           FILE *output){
+    if(!output){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    fprintf(output,"Inventory Status:\n");
+    ViewWalk walk;
+    VIEW_RANGE_FOREACH(current,&walk,view,lowId,highId){
+        printProductState(current, output);
+    }
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintInventoryRange(Matamazom matamazom,
+                                       const unsigned int lowId,
+                                       const unsigned int highId,
+                                       FILE *output){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    // the range is always read from snapshots, which are searched in
+    // logarithmic time, and only read directly if they cannot be pinned
+    InventoryView view;
+    if(!pinInventoryView(matamazom,&view)){
+        closeInventoryView(matamazom,&view);
+        openInventoryView(matamazom,&view);
+    }
+    MatamazomResult result=printInventoryRange(&view, lowId, highId, output);
+    closeInventoryView(matamazom,&view);
+    return result;
+}
+
+/**
+ * printOrderWithTotal: prints an order, and the total price of it.
+ *
+ * @param order - The order to print.
+ * @param total - The total price of the order, in millionths.
+ * @param output - A pointer to the output file the the printing will happen in.
+ */
+static void printOrderWithTotal(Order order, const Quantity total,
+                                FILE *output){
+    mtmPrintOrderHeading(order->id, output);
+    printProductsOfAmountSet(order->list_of_order_products, false, output);
+    mtmPrintOrderSummary(fromQuantity(total), output);
+}
+
+static MatamazomResult printOrder(Matamazom matamazom, const unsigned int orderId,
+                                    FILE *output){
+    if (!matamazom || !output) {
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    Order current_order = findAndLockOrder(matamazom, orderId);
+    if (current_order == NULL) {
+        return MATAMAZOM_ORDER_NOT_EXIST;
+    }
+    Quantity total_price_of_order = getOrderTotal(matamazom, current_order,
+                                                    matamazom->concurrent);
+    printOrderWithTotal(current_order, total_price_of_order, output);
+    unlockOrder(matamazom, current_order);
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintOrder(Matamazom matamazom, const unsigned int orderId,
+                                FILE *output){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    MatamazomResult result=printOrder(matamazom, orderId, output);
+    return result;
+}
+
+MatamazomResult mtmGetOrderTotal(Matamazom matamazom,
+                                 const unsigned int orderId, double *outTotal){
+    if(!matamazom || !outTotal){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    Order wanted_order=findAndLockOrder(matamazom,orderId);
+    if(!wanted_order){
+        return MATAMAZOM_ORDER_NOT_EXIST;
+    }
+    *outTotal=fromQuantity(getOrderTotal(matamazom,wanted_order,
+            matamazom->concurrent));
+    unlockOrder(matamazom,wanted_order);
+    return MATAMAZOM_SUCCESS;
+}
+
+/**
+ * OrderTotalsContext
+ *
+ * This is an internal struct implemented to be used by mtmGetOpenOrdersTotal,
+ * as the context of a ParallelJob.
+ *
+ * @param matamazom - The warehouse of the orders.
+ * @param orders - The orders to price.
+ * @param totals - Set to the total price of every order, in millionths.
+ */
+typedef struct order_totals_context{
+    Matamazom matamazom;
+    Order* orders;
+    Quantity* totals;
+}OrderTotalsContext;
+
+/**
+ * priceOrders: an EvaluateChunk function that prices a chunk of orders.
+ *
+ * @param context - The OrderTotalsContext of the job.
+ * @param first - The index of the first order of the chunk.
+ * @param end - The index after the last order of the chunk.
+ */
+static void priceOrders(void* context, int first, int end){
+    OrderTotalsContext* totals_context=context;
+    for(int i=first;i<end;i++){
+        totals_context->totals[i]=getOrderTotal(totals_context->matamazom,
+                totals_context->orders[i],false);
+    }
+}
+
+/**
+ * compareOrdersById: a compare function for qsort, that sorts pointers to
+ *                    orders by ascending id.
+ *
+ * @param element1 - a pointer to the first order to be compared.
+ * @param element2 - a pointer to the second order to be compared.
+ *
+ * @return:
+ *      A negative number, zero or a positive number if the first order
+ *      should come before, is equal to or should come after the second one.
+ */
+static int compareOrdersById(const void* element1, const void* element2){
+    return compareOrders(*(Order const*)element1,*(Order const*)element2);
+}
+
+static MatamazomResult getOpenOrdersTotal(Matamazom matamazom,
+                                          double *outTotal){
+    if(!matamazom || !outTotal){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    int orders_number=0;
+    for(int i=0;i<matamazom->order_stripes_number;i++){
+        orders_number=orders_number+
+                setGetSize(matamazom->order_stripes[i].set_of_orders);
+    }
+    OrderTotalsContext context;
+    context.matamazom=matamazom;
+    context.orders=malloc(sizeof(*context.orders)*(orders_number+1));
+    context.totals=malloc(sizeof(*context.totals)*(orders_number+1));
+    if(!context.orders || !context.totals){
+        free(context.orders);
+        free(context.totals);
         return MATAMAZOM_OUT_OF_MEMORY;
     }
-    asChangeAmount(matamazom->list_of_products,new_product,amount);
-    freeProduct(new_product); //because asRegister makes a newCopy
+    int index=0;
+    for(int i=0;i<matamazom->order_stripes_number;i++){
+        SET_FOREACH(Order,current_order,
+                    matamazom->order_stripes[i].set_of_orders){
+            lockOrder(matamazom,current_order);
+            context.orders[index++]=current_order;
+        }
+    }
+    // the totals are summed in order of ids, however the orders are striped
+    qsort(context.orders,orders_number,sizeof(*context.orders),
+            compareOrdersById);
+    runParallelJob(&context,priceOrders,orders_number,
+            matamazom->concurrent ? PARALLEL_THREADS_NUMBER : 1);
+    Quantity total=0;
+    for(int i=0;i<orders_number;i++){
+        total=total+context.totals[i];
+    }
+    *outTotal=fromQuantity(total);
+    for(int i=0;i<orders_number;i++){
+        unlockOrder(matamazom,context.orders[i]);
+    }
+    free(context.orders);
+    free(context.totals);
     return MATAMAZOM_SUCCESS;
 }
 
-MatamazomResult mtmChangeProductAmount(Matamazom matamazom,
-                                        const unsigned int id,
-                                        const double amount){
+MatamazomResult mtmGetOpenOrdersTotal(Matamazom matamazom, double *outTotal){
     if(!matamazom){
         return MATAMAZOM_NULL_ARGUMENT;
     }
+    lockAllOrderStripes(matamazom);
+    MatamazomResult result=getOpenOrdersTotal(matamazom, outTotal);
+    unlockAllOrderStripes(matamazom);
+    return result;
+}
 
-    Product wantedProduct=getProductFromId(matamazom->list_of_products,id);
-    if(wantedProduct==NULL){
-        return MATAMAZOM_PRODUCT_NOT_EXIST;
+/**
+ * MatamazomVersion_t
+ *
+ * An unchanging version of a warehouse. The products are kept as snapshots of
+ * the shards, that share every product that did not change with the reports
+ * and the other versions (@see ProductNode). The open orders are copies, whose
+ * lines are shared with the orders of the warehouse until they change
+ * (@see asCopy).
+ *
+ * @param view - The products of the version, as seen by its reports.
+ * @param orders - Copies of the open orders, sorted by id.
+ * @param orders_number - The number of open orders.
+ */
+struct MatamazomVersion_t {
+    InventoryView view;
+    Order* orders;
+    int orders_number;
+};
+
+/**
+ * findVersionOrder: finds an order of a version by a binary search.
+ *
+ * @param version - The version to search.
+ * @param orderId - The id of the order.
+ *
+ * @return:
+ *      NULL - if the version has no open order with the given id.
+ *      The order otherwise.
+ */
+static Order findVersionOrder(MatamazomVersion version,
+                              const unsigned int orderId){
+    int low=0;
+    int high=version->orders_number-1;
+    while(low<=high){
+        int middle=low+(high-low)/2;
+        unsigned int middle_id=version->orders[middle]->id;
+        if(middle_id==orderId){
+            return version->orders[middle];
+        }
+        if(middle_id<orderId){
+            low=middle+1;
+        } else{
+            high=middle-1;
+        }
     }
-    
-    if(!checkIfAmountIsValid(wantedProduct->amount_type,amount)){
-        return MATAMAZOM_INVALID_AMOUNT;
+    return NULL;
+}
+
+/**
+ * copyOrdersOfVersion: copies all the open orders of a warehouse to a version,
+ *                      with their totals. All the order stripes and orders
+ *                      must be locked.
+ *
+ * @param matamazom - The warehouse of the orders.
+ * @param version - The version to copy the orders to. Its orders_number is
+ *     the number of copied orders, even if copying failed.
+ *
+ * @return:
+ *      false - if an allocation failed.
+ *      true - otherwise.
+ */
+static bool copyOrdersOfVersion(Matamazom matamazom, MatamazomVersion version){
+    for(int i=0;i<matamazom->order_stripes_number;i++){
+        SET_FOREACH(Order,current_order,
+                    matamazom->order_stripes[i].set_of_orders){
+            Quantity total=getOrderTotal(matamazom,current_order,false);
+            Order order_copy=copyOrder(current_order);
+            if(!order_copy){
+                return false;
+            }
+            order_copy->total=total;
+            order_copy->total_dirty=false;
+            version->orders[version->orders_number++]=order_copy;
+        }
+    }
+    qsort(version->orders,version->orders_number,sizeof(*version->orders),
+            compareOrdersById);
+    return true;
+}
+
+MatamazomVersion mtmCaptureVersion(Matamazom matamazom){
+    if(!matamazom){
+        return NULL;
+    }
+    MatamazomVersion version=malloc(sizeof(*version));
+    if(!version){
+        return NULL;
+    }
+    version->orders_number=0;
+    // the orders and the shards are locked together, so the version shows the
+    // warehouse as it was at a single moment
+    lockAllOrderStripes(matamazom);
+    int orders_number=0;
+    for(int i=0;i<matamazom->order_stripes_number;i++){
+        orders_number=orders_number+
+                setGetSize(matamazom->order_stripes[i].set_of_orders);
+        SET_FOREACH(Order,current_order,
+                    matamazom->order_stripes[i].set_of_orders){
+            lockOrder(matamazom,current_order);
+        }
+    }
+    bool captured=pinInventoryView(matamazom,&version->view);
+    version->orders=malloc(sizeof(*version->orders)*(orders_number+1));
+    captured=captured && version->orders &&
+            copyOrdersOfVersion(matamazom,version);
+    for(int i=0;i<matamazom->order_stripes_number;i++){
+        SET_FOREACH(Order,current_order,
+                    matamazom->order_stripes[i].set_of_orders){
+            unlockOrder(matamazom,current_order);
+        }
+    }
+    unlockAllOrderStripes(matamazom);
+    if(!captured){
+        mtmVersionDestroy(version);
+        return NULL;
+    }
+    return version;
+}
+
+void mtmVersionDestroy(MatamazomVersion version){
+    if(!version){
+        return;
     }
-    double  originalAmount;
-    asGetAmount(matamazom->list_of_products,wantedProduct,&originalAmount);
-    double newAmount=originalAmount + amount;
-    if(!checkIfAmountIsValid(wantedProduct->amount_type,newAmount)){
-        return MATAMAZOM_INVALID_AMOUNT;
+    for(int i=0;i<version->view.shards_number;i++){
+        releaseNode(version->view.snapshots[i]);
     }
-    if(newAmount<0){
-        return MATAMAZOM_INSUFFICIENT_AMOUNT;
+    for(int i=0;i<version->orders_number;i++){
+        freeOrder(version->orders[i]);
     }
-    asChangeAmount(matamazom->list_of_products,wantedProduct,amount);
-    return MATAMAZOM_SUCCESS;
+    free(version->orders);
+    free(version);
 }
 
-MatamazomResult mtmClearProduct(Matamazom matamazom, const unsigned int id){
-    if(!matamazom){
+MatamazomResult mtmVersionPrintInventory(MatamazomVersion version,
+                                         FILE *output){
+    if(!version){
         return MATAMAZOM_NULL_ARGUMENT;
     }
-    Product wantedProduct =getProductFromId(matamazom->list_of_products,id);
-    if(wantedProduct==NULL){
-        return MATAMAZOM_PRODUCT_NOT_EXIST;
+    return printInventory(&version->view, output);
+}
+
+MatamazomResult mtmVersionPrintOrder(MatamazomVersion version,
+                                     const unsigned int orderId, FILE *output){
+    if(!version || !output){
+        return MATAMAZOM_NULL_ARGUMENT;
     }
-    SET_FOREACH(Order,current_order,matamazom->set_of_orders){
-        asDelete(current_order->list_of_order_products,
-                (ASElement)wantedProduct);
+    Order order=findVersionOrder(version,orderId);
+    if(!order){
+        return MATAMAZOM_ORDER_NOT_EXIST;
     }
-    asDelete(matamazom->list_of_products,(ASElement)wantedProduct);
+    printOrderWithTotal(order, order->total, output);
     return MATAMAZOM_SUCCESS;
 }
 
-MatamazomResult mtmPrintBestSelling(Matamazom matamazom, FILE *output){
-    if(!matamazom|| !output){
+MatamazomResult mtmVersionPrintBestSelling(MatamazomVersion version,
+                                           FILE *output){
+    if(!version){
         return MATAMAZOM_NULL_ARGUMENT;
     }
-    Product bestSellingProduct=asGetFirst(matamazom->list_of_products);
-    if(!bestSellingProduct){
-        printNoBestSellingProduct(output);
-        return MATAMAZOM_SUCCESS;
-    }
-    double max_income=bestSellingProduct->income;
-    AS_FOREACH(Product,currentProduct,matamazom->list_of_products){
-        if((currentProduct->income)-(bestSellingProduct->income) >
-        IN_RANGE_OF_MISTAKE){
-            bestSellingProduct=currentProduct;
-            max_income=bestSellingProduct->income;
-        }
-    }
-    if(max_income==0){
-        printNoBestSellingProduct(output);
-        return MATAMAZOM_SUCCESS;
-    }
-    fprintf(output,"Best Selling Product:\n");
-    mtmPrintIncomeLine(bestSellingProduct->name,bestSellingProduct->id,
-            max_income,output);
-    return MATAMAZOM_SUCCESS;
+    return printBestSelling(&version->view, output);
 }
 
-MatamazomResult mtmPrintFiltered(Matamazom matamazom,
-                                    MtmFilterProduct customFilter,FILE *output){
-    if(!matamazom || !customFilter || !output){
+MatamazomResult mtmVersionPrintFiltered(MatamazomVersion version,
+                                        MtmFilterProduct customFilter,
+                                        FILE *output){
+    if(!version){
         return MATAMAZOM_NULL_ARGUMENT;
     }
-    double amount_Of_Product=0;
-    AS_FOREACH(Product,currentProduct,matamazom->list_of_products){
-        /*AmountSetResult result = */asGetAmount(matamazom->list_of_products,
-                currentProduct,&amount_Of_Product);
-        if(customFilter(currentProduct->id,currentProduct->name,
-                        amount_Of_Product,currentProduct->additional_info)){
-            mtmPrintProductDetails(currentProduct->name,currentProduct->id,
-                    amount_Of_Product,currentProduct->
-                    get_price_function(currentProduct->additional_info,UNIT),
-                    output);
-        }
+    return printFiltered(&version->view, customFilter, output);
+}
+
+/**
+ * MatamazomProductCursor_t
+ *
+ * A walk over the products of a warehouse in a range of ids, as they were when
+ * the walk started. The products are read from snapshots of the shards, like
+ * the products of a version.
+ *
+ * @param view - The products of the walk.
+ * @param walk - The walk over the view, at the next product.
+ * @param high_id - The largest id to walk.
+ */
+struct MatamazomProductCursor_t {
+    InventoryView view;
+    ViewWalk walk;
+    unsigned int high_id;
+};
+
+MatamazomProductCursor mtmProductCursorCreate(Matamazom matamazom,
+                                              const unsigned int lowId,
+                                              const unsigned int highId){
+    if(!matamazom){
+        return NULL;
     }
-    return MATAMAZOM_SUCCESS;
+    MatamazomProductCursor cursor=malloc(sizeof(*cursor));
+    if(!cursor){
+        return NULL;
+    }
+    if(!pinInventoryView(matamazom,&cursor->view)){
+        mtmProductCursorDestroy(cursor);
+        return NULL;
+    }
+    startViewWalk(&cursor->view,&cursor->walk,lowId);
+    cursor->high_id=highId;
+    return cursor;
 }
 
-MatamazomResult mtmPrintInventory(Matamazom matamazom, FILE *output){
-    if(!matamazom || !output){
-        return MATAMAZOM_NULL_ARGUMENT;
+void mtmProductCursorDestroy(MatamazomProductCursor cursor){
+    if(!cursor){
+        return;
     }
-    fprintf(output,"Inventory Status:\n");
-    printProductsOfAmountSet(matamazom->list_of_products, true, output);
-    return MATAMAZOM_SUCCESS;
+    for(int i=0;i<cursor->view.shards_number;i++){
+        releaseNode(cursor->view.snapshots[i]);
+    }
+    free(cursor);
 }
 
-MatamazomResult mtmPrintOrder(Matamazom matamazom, const unsigned int orderId,
-                                FILE *output) {
-    if (!matamazom || !output) {
-        return MATAMAZOM_NULL_ARGUMENT;
+bool mtmProductCursorNext(MatamazomProductCursor cursor,
+                          MtmProductInfo *outInfo){
+    if(!cursor || !outInfo){
+        return false;
     }
-    SET_FOREACH(Order, current_order, matamazom->set_of_orders) {
-        if (current_order->id == orderId) {
-            mtmPrintOrderHeading(orderId, output);
-            printProductsOfAmountSet(current_order->list_of_order_products,
-                                                        false,output);
-            double total_price_of_order = getTotalPriceOfOrder(current_order);
-            mtmPrintOrderSummary(total_price_of_order, output);
-            return MATAMAZOM_SUCCESS;
-        }
+    const ProductState* state=nextViewProductInRange(&cursor->walk,
+            cursor->high_id);
+    if(!state){
+        return false;
     }
-    return MATAMAZOM_ORDER_NOT_EXIST;
+    outInfo->id=state->product->id;
+    outInfo->name=state->product->name;
+    outInfo->amount=fromQuantity(state->amount);
+    outInfo->customData=state->product->additional_info;
+    return true;
 }
 
-unsigned int mtmCreateNewOrder(Matamazom matamazom){
+static unsigned int createNewOrder(Matamazom matamazom){
     if(!matamazom){
         return 0;
     }
@@ -736,18 +4085,32 @@ unsigned int mtmCreateNewOrder(Matamazom matamazom){
         return 0;
     }
 
+    if(pthread_mutex_init(&new_order->lock,NULL) != 0){
+        free(new_order);
+        return 0;
+    }
     new_order->list_of_order_products = asCreate(copyProductForAmountSet,
             freeProductForAmountSet,compareProductsForAmountSet);
     if(!new_order->list_of_order_products){
         freeOrder(new_order);
         return 0;
     }
+    new_order->total=0;
+    new_order->total_dirty=false;
+    new_order->prices_epoch=__atomic_load_n(&matamazom->prices_epoch,
+            __ATOMIC_ACQUIRE);
 
-    matamazom->current_order_id=matamazom->current_order_id+1;
-    new_order->id=matamazom->current_order_id;
+    new_order->id=__atomic_add_fetch(&matamazom->current_order_id,1,
+            __ATOMIC_RELAXED);
     // put the order in the specific matamazom
-    SetResult register_new_order = setAdd(matamazom->set_of_orders,
+    OrderStripe stripe=getOrderStripe(matamazom,new_order->id);
+    lockOrderStripe(matamazom,stripe);
+    SetResult register_new_order = setAdd(stripe->set_of_orders,
             (SetElement)new_order);
+    if(register_new_order == SET_SUCCESS){
+        publishEvent(matamazom,MTM_EVENT_ORDER_CREATED,0,new_order->id,0);
+    }
+    unlockOrderStripe(matamazom,stripe);
     if(register_new_order != SET_SUCCESS){
         freeOrder(new_order);
         return 0;
@@ -758,99 +4121,699 @@ unsigned int mtmCreateNewOrder(Matamazom matamazom){
     return id_of_order;
 }
 
-MatamazomResult mtmChangeProductAmountInOrder(Matamazom matamazom,
-                                                const unsigned int orderId,
-                                                const unsigned int productId,
-                                                const double amount){
+unsigned int mtmCreateNewOrder(Matamazom matamazom){
     if(!matamazom){
-        return MATAMAZOM_NULL_ARGUMENT;
+        return 0;
     }
-    //get the wanted order
-    Order wanted_order = getOrderFromId(matamazom->set_of_orders, orderId);
-    if(wanted_order == NULL){
-        return MATAMAZOM_ORDER_NOT_EXIST;
+    return createNewOrder(matamazom);
+}
+
+/**
+ * OrderLine
+ *
+ * This is an internal struct implemented to be used by the Matamazom warehouse.
+ * It holds the state of a product in an order while changes to its amount are
+ * checked, so they can be written to the order once.
+ *
+ * @param in_order - true if the product is in the order.
+ * @param amount - The amount of the product in the order, in millionths.
+ * @param reserved - The amount of the product reserved by all the open orders,
+ * in millionths.
+ */
+typedef struct order_line{
+    bool in_order;
+    Quantity amount;
+    Quantity reserved;
+}OrderLine;
+
+/**
+ * getPriceOfOrderLine: returns the price of a line of an order, as it is
+ *                      added to the total of the order.
+ *
+ * @param product - The product of the line.
+ * @param line - The line.
+ *
+ * @return:
+ *      The price of the line in millionths, or 0 if the product is not in the
+ *      order.
+ */
+static Quantity getPriceOfOrderLine(Product product, const OrderLine* line){
+    if(!line->in_order){
+        return 0;
+    }
+    return priceToQuantity(getPriceOfProduct(product,line->amount));
+}
+
+/**
+ * changeOrderLine: applies a change to the amount of a product in an order,
+ *                  as described in mtmChangeProductAmountInOrder, to the state
+ *                  of the product in the order.
+ *
+ * @param matamazom - The warehouse of the product.
+ * @param amount_in_warehouse - The amount of the product in the warehouse, in
+ *     millionths.
+ * @param line - The state of the product in the order, that is changed.
+ * @param amount - The amount to add to the product in the order.
+ * @param amount_is_valid - Whether the amount is valid for the amount type of
+ *     the product.
+ *
+ * @return:
+ *      The result of the change, as described in mtmChangeProductAmountInOrder.
+ */
+static MatamazomResult changeOrderLine(Matamazom matamazom,
+                                       const Quantity amount_in_warehouse,
+                                       OrderLine* line, const double amount,
+                                       const bool amount_is_valid){
+    Quantity change;
+    if(!amount_is_valid || !toQuantity(amount, &change)){
+        return MATAMAZOM_INVALID_AMOUNT;
+    }
+    if(!line->in_order && change <= 0){
+        return MATAMAZOM_SUCCESS;
+    }
+    Quantity new_amount_in_order = line->amount + change;
+    if(new_amount_in_order > QUANTITY_LIMIT){
+        return MATAMAZOM_INVALID_AMOUNT;
+    }
+    if(new_amount_in_order < 0){
+        new_amount_in_order = 0;
+    }
+    if(matamazom->reserve_stock){
+        Quantity reserved_change = new_amount_in_order - line->amount;
+        if(line->reserved + reserved_change > amount_in_warehouse){
+            return MATAMAZOM_INSUFFICIENT_AMOUNT;
+        }
+        line->reserved = line->reserved + reserved_change;
+    }
+    line->in_order = new_amount_in_order > 0;
+    line->amount = new_amount_in_order;
+    return MATAMAZOM_SUCCESS;
+}
+
+/**
+ * addLineToOrder: adds a product that is not in an order to the order, and
+ *                 the order to the order index of the product. The order must
+ *                 be locked, and the shard of the product locked at least for
+ *                 reading.
+ *
+ * @param matamazom - The warehouse of the order.
+ * @param order - The order.
+ * @param product_in_warehouse - The product in the warehouse.
+ * @param amount - The amount of the product in the order, in millionths.
+ *
+ * @return:
+ *      false - if an allocation failed. Nothing is changed then.
+ *      true - otherwise.
+ */
+static bool addLineToOrder(Matamazom matamazom, Order order,
+                           Product product_in_warehouse, const Quantity amount){
+    int shard_index = getShardIndex(matamazom, product_in_warehouse->id);
+    lockOrdersOfShard(matamazom, shard_index);
+    bool indexed = addToOrderIndex(&product_in_warehouse->orders, order);
+    unlockOrdersOfShard(matamazom, shard_index);
+    if(!indexed){
+        return false;
+    }
+    if(asRegister(order->list_of_order_products,
+            (ASElement)product_in_warehouse) != AS_SUCCESS){
+        lockOrdersOfShard(matamazom, shard_index);
+        removeFromOrderIndex(&product_in_warehouse->orders, order->id);
+        unlockOrdersOfShard(matamazom, shard_index);
+        return false;
+    }
+    asChangeAmount(order->list_of_order_products,
+            (ASElement)product_in_warehouse, (double)amount);
+    return true;
+}
+
+static MatamazomResult changeProductAmountInOrderBatch(Matamazom matamazom,
+                                                       Order wanted_order,
+                                                       const unsigned int productId,
+                                                       const double *amounts,
+                                                       const int n,
+                                                       MatamazomResult *results){
+    if(!matamazom || (n>0 && (!amounts || !results))){
+        return MATAMAZOM_NULL_ARGUMENT;
     }
     //check if product in warehouse
-    Product product_in_warehouse = getProductFromId(matamazom->list_of_products,
-            productId);
+    AmountSet shard_products=getProductsOfShard(matamazom,productId);
+    Product product_in_warehouse = getProductFromId(shard_products,productId);
     if(product_in_warehouse == NULL){
-        return MATAMAZOM_PRODUCT_NOT_EXIST;
+        for(int i=0;i<n;i++){
+            results[i]=MATAMAZOM_PRODUCT_NOT_EXIST;
+        }
+        return MATAMAZOM_SUCCESS;
     }
-    if(!checkIfAmountIsValid(product_in_warehouse->amount_type, amount)){
-        return MATAMAZOM_INVALID_AMOUNT;
+    double amount_in_warehouse;
+    asGetAmount(shard_products,
+            (ASElement)product_in_warehouse, &amount_in_warehouse);
+    Quantity quantity_in_warehouse = (Quantity)amount_in_warehouse;
+    // the line may be changed through its cursor, so it must not be shared
+    // with a version of the warehouse
+    if(asDetach(wanted_order->list_of_order_products) != AS_SUCCESS){
+        for(int i=0;i<n;i++){
+            results[i]=MATAMAZOM_OUT_OF_MEMORY;
+        }
+        return MATAMAZOM_OUT_OF_MEMORY;
     }
     //check if product is in order
-    Product product_in_order = getProductFromId(wanted_order->
-            list_of_order_products, productId);
-    if(product_in_order == NULL){
-        if(amount > 0){
-            asRegister(wanted_order->list_of_order_products,
-                    (ASElement)product_in_warehouse);
-            asChangeAmount(wanted_order->list_of_order_products,
-                    (ASElement)product_in_warehouse, amount);
+    ASCursor line_cursor = advanceToProduct(
+            asCursorFirst(wanted_order->list_of_order_products), productId);
+    if(line_cursor &&
+            ((Product)asCursorGetElement(line_cursor))->id != productId){
+        line_cursor = NULL;
+    }
+    OrderLine original_line = {line_cursor != NULL, 0,
+                               product_in_warehouse->reserved};
+    if(line_cursor){
+        original_line.amount = getQuantityOfCursor(line_cursor);
+    }
+    // the changes are applied to a copy of the line, which is written once.
+    // the amounts are validated a chunk at a time, before it is applied
+    OrderLine line = original_line;
+    for(int first=0;first<n;first=first+VALIDATION_CHUNK_SIZE){
+        int chunk_size = n-first < VALIDATION_CHUNK_SIZE ? n-first :
+                VALIDATION_CHUNK_SIZE;
+        bool valid[VALIDATION_CHUNK_SIZE];
+        mtmValidateAmounts(product_in_warehouse->amount_type, amounts+first,
+                chunk_size, valid);
+        for(int i=first;i<first+chunk_size;i++){
+            results[i]=changeOrderLine(matamazom, quantity_in_warehouse,
+                    &line, amounts[i], valid[i-first]);
         }
-    } else{
-        AmountSetResult change_result = asChangeAmount(wanted_order->
-                list_of_order_products, (ASElement)product_in_order, amount);
-        if(change_result == AS_INSUFFICIENT_AMOUNT){
-            asDelete(wanted_order->list_of_order_products,
-                    (ASElement)product_in_order);
+    }
+    bool line_added = line.in_order && !original_line.in_order;
+    if(line_added && !addLineToOrder(matamazom, wanted_order,
+                                     product_in_warehouse, line.amount)){
+        for(int i=0;i<n;i++){
+            results[i]=MATAMAZOM_OUT_OF_MEMORY;
         }
-        double amount_of_product_in_order;
-        asGetAmount(wanted_order->list_of_order_products,
-                (ASElement)product_in_order, &amount_of_product_in_order);
-        if(amount_of_product_in_order == 0){
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    if(matamazom->reserve_stock){
+        product_in_warehouse->reserved = line.reserved;
+    }
+    bool line_changed = line.in_order != original_line.in_order ||
+                        line.amount != original_line.amount;
+    if(line_changed && !wanted_order->total_dirty){
+        wanted_order->total = wanted_order->total
+                + getPriceOfOrderLine(product_in_warehouse, &line)
+                - getPriceOfOrderLine(product_in_warehouse, &original_line);
+    }
+    if(line_changed){
+        publishEvent(matamazom, MTM_EVENT_LINE_CHANGED, productId,
+                wanted_order->id, line.amount);
+    }
+    if(!line.in_order){
+        if(original_line.in_order){
             asDelete(wanted_order->list_of_order_products,
-                    (ASElement)product_in_order);
+                    (ASElement)product_in_warehouse);
+            int shard_index = getShardIndex(matamazom, productId);
+            lockOrdersOfShard(matamazom, shard_index);
+            removeFromOrderIndex(&product_in_warehouse->orders,
+                    wanted_order->id);
+            unlockOrdersOfShard(matamazom, shard_index);
         }
+    } else if(original_line.in_order && line.amount != original_line.amount){
+        double original_amount = (double)original_line.amount;
+        asCursorCompareAndSwapAmount(line_cursor, &original_amount,
+                (double)line.amount);
     }
     return MATAMAZOM_SUCCESS;
 }
 
-MatamazomResult mtmShipOrder(Matamazom matamazom, const unsigned int orderId){
+MatamazomResult mtmChangeProductAmountInOrder(Matamazom matamazom,
+                                                const unsigned int orderId,
+                                                const unsigned int productId,
+                                                const double amount){
+    MatamazomResult result;
+    MatamazomResult batch_result=mtmChangeProductAmountInOrderBatch(matamazom,
+            orderId, productId, &amount, 1, &result);
+    return batch_result == MATAMAZOM_SUCCESS ? result : batch_result;
+}
+
+MatamazomResult mtmChangeProductAmountInOrderBatch(Matamazom matamazom,
+                                                   const unsigned int orderId,
+                                                   const unsigned int productId,
+                                                   const double *amounts,
+                                                   const int n,
+                                                   MatamazomResult *results){
+    if(!matamazom || (n>0 && (!amounts || !results))){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    Order wanted_order = findAndLockOrder(matamazom, orderId);
+    if(wanted_order == NULL){
+        for(int i=0;i<n;i++){
+            results[i]=MATAMAZOM_ORDER_NOT_EXIST;
+        }
+        return MATAMAZOM_SUCCESS;
+    }
+    // reservations change the warehouse product, otherwise it is only read
+    int shard_index=getShardIndex(matamazom,productId);
+    lockShard(matamazom,shard_index,matamazom->reserve_stock);
+    MatamazomResult result=changeProductAmountInOrderBatch(matamazom,
+            wanted_order, productId, amounts, n, results);
+    unlockShard(matamazom,shard_index);
+    unlockOrder(matamazom,wanted_order);
+    return result;
+}
+
+/**
+ * addIncomes: adds the prices of shipped amounts of products to the incomes of
+ *             the products. The amounts are priced together.
+ *
+ * @param products - The shipped products, as kept in the warehouse.
+ * @param amounts - The shipped amount of every product, in millionths.
+ * @param n - The number of products, at most PARALLEL_CHUNK_SIZE.
+ * @param incomes - The incomes to add the prices to, one for every product, or
+ *     NULL to add them to the incomes of the products themselves.
+ */
+static void addIncomes(const Product* products, const Quantity* amounts, int n,
+                       Quantity** incomes){
+    double prices[PARALLEL_CHUNK_SIZE];
+    priceProducts(products,amounts,n,prices);
+    for(int i=0;i<n;i++){
+        Quantity* income=incomes ? incomes[i] : &products[i]->income;
+        *income=*income+priceToQuantity(prices[i]);
+    }
+}
+
+static MatamazomResult shipOrder(Matamazom matamazom, const unsigned int orderId){
     if(!matamazom){
         return MATAMAZOM_NULL_ARGUMENT;
     }
-    //get the order
-    Order wanted_order =getOrderFromId(matamazom->set_of_orders,orderId);
+    //get the order, its stripe stays locked until it is removed
+    OrderStripe stripe=getOrderStripe(matamazom,orderId);
+    Order wanted_order =getOrderFromId(stripe->set_of_orders,orderId);
     if(wanted_order == NULL){
         return MATAMAZOM_ORDER_NOT_EXIST;
     }
-    // check if the amounts are ok and if not - return insufficient
-    if(!checkIfOrderIsValid(matamazom,wanted_order)){
+    lockOrder(matamazom,wanted_order);
+    bool locked_shards[MATAMAZOM_SHARDS_NUMBER];
+    lockShardsOfOrder(matamazom,wanted_order,locked_shards);
+    // check if the amounts are ok and if not - return insufficient.
+    // reserved orders were already checked when their amounts were changed
+    if(!matamazom->reserve_stock &&
+                            !checkIfOrderIsValid(matamazom,wanted_order)){
+        unlockShardsOfOrder(matamazom,locked_shards);
+        unlockOrder(matamazom,wanted_order);
         return MATAMAZOM_INSUFFICIENT_AMOUNT;
     }
     // now the order is ok - substract all amounts from the warehouse
-    double amount_of_product_in_order;
+    Quantity amount_of_product_in_order;
     Product warehouse_product;
+    ShardCursors warehouse_cursors;
+    startShardCursors(matamazom,&warehouse_cursors);
+    // the incomes are added by chunks, so the lines are priced together
+    Product shipped_products[PARALLEL_CHUNK_SIZE];
+    Quantity shipped_amounts[PARALLEL_CHUNK_SIZE];
+    int shipped_number=0;
 
-    AS_FOREACH(Product,orderProduct,wanted_order->list_of_order_products){
-        asGetAmount(wanted_order->list_of_order_products,orderProduct,
-                &amount_of_product_in_order);
-        asChangeAmount(matamazom->list_of_products,orderProduct,
+    AS_CURSOR_FOREACH(order_cursor,wanted_order->list_of_order_products){
+        Product orderProduct=asCursorGetElement(order_cursor);
+        amount_of_product_in_order=getQuantityOfCursor(order_cursor);
+        ASCursor warehouse_cursor=seekProduct(matamazom,&warehouse_cursors,
+                orderProduct->id);
+        asCursorChangeAmount(warehouse_cursor,
+                -(double)amount_of_product_in_order);
+        markProductChanged(matamazom,warehouse_cursor);
+        publishEvent(matamazom,MTM_EVENT_STOCK_CHANGED,orderProduct->id,0,
                 -amount_of_product_in_order);
 
-        warehouse_product=getProductFromId(matamazom->list_of_products,
-                orderProduct->id);
-        warehouse_product->income=(warehouse_product->income)
-                +warehouse_product->get_price_function(warehouse_product->
-                additional_info,amount_of_product_in_order);
+        warehouse_product=asCursorGetElement(warehouse_cursor);
+        removeFromOrderIndex(&warehouse_product->orders,orderId);
+        if(matamazom->reserve_stock){
+            warehouse_product->reserved=warehouse_product->reserved
+                    -amount_of_product_in_order;
+        }
+        shipped_products[shipped_number]=warehouse_product;
+        shipped_amounts[shipped_number]=amount_of_product_in_order;
+        shipped_number++;
+        if(shipped_number==PARALLEL_CHUNK_SIZE){
+            addIncomes(shipped_products,shipped_amounts,shipped_number,NULL);
+            shipped_number=0;
+        }
     }
+    if(shipped_number>0){
+        addIncomes(shipped_products,shipped_amounts,shipped_number,NULL);
+    }
+    publishEvent(matamazom,MTM_EVENT_ORDER_SHIPPED,0,orderId,0);
+    unlockShardsOfOrder(matamazom,locked_shards);
+    unlockOrder(matamazom,wanted_order);
     // delete order after changing amounts
-    mtmCancelOrder(matamazom, orderId);
+    setRemove(stripe->set_of_orders, (SetElement)wanted_order);
     return MATAMAZOM_SUCCESS;
 }
 
-MatamazomResult mtmCancelOrder(Matamazom matamazom, const unsigned int orderId){
+MatamazomResult mtmShipOrder(Matamazom matamazom, const unsigned int orderId){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    OrderStripe stripe=getOrderStripe(matamazom,orderId);
+    lockOrderStripe(matamazom,stripe);
+    MatamazomResult result=shipOrder(matamazom, orderId);
+    unlockOrderStripe(matamazom,stripe);
+    return result;
+}
+
+/**
+ * findRequestedOrders: finds and locks the orders of sorted ship requests.
+ *                      The orders of every stripe are kept sorted by id, so
+ *                      they are matched to the requests in a single walk over
+ *                      every stripe. All the order stripes must be locked.
+ *
+ * @param matamazom - The warehouse of the orders.
+ * @param requests - The requests, sorted by order id.
+ * @param n - The number of requests.
+ * @param orders - An array of n orders, that is set to the order of every
+ *     request, or to NULL if there is no such order or it was already
+ *     requested.
+ */
+static void findRequestedOrders(Matamazom matamazom,
+                                const ShipRequest* requests, const int n,
+                                Order* orders){
+    Order stripe_orders[ORDER_STRIPES_NUMBER];
+    for(int i=0;i<matamazom->order_stripes_number;i++){
+        stripe_orders[i]=setGetFirst(matamazom->order_stripes[i].set_of_orders);
+    }
+    for(int i=0;i<n;i++){
+        orders[i]=NULL;
+        unsigned int order_id=requests[i].order_id;
+        if(i>0 && requests[i-1].order_id==order_id){
+            continue;
+        }
+        OrderStripe stripe=getOrderStripe(matamazom,order_id);
+        int index=(int)(stripe-matamazom->order_stripes);
+        while(stripe_orders[index] && stripe_orders[index]->id<order_id){
+            stripe_orders[index]=setGetNext(stripe->set_of_orders);
+        }
+        if(stripe_orders[index] && stripe_orders[index]->id==order_id){
+            orders[i]=stripe_orders[index];
+            lockOrder(matamazom,orders[i]);
+        }
+    }
+}
+
+static MatamazomResult shipOrders(Matamazom matamazom,
+                                  const unsigned int *orderIds, const int n,
+                                  MatamazomResult *results){
+    if(!matamazom || (n>0 && (!orderIds || !results))){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    if(n<=0){
+        return MATAMAZOM_SUCCESS;
+    }
+    ShipRequest* requests=malloc(sizeof(*requests)*n);
+    Order* requested_orders=malloc(sizeof(*requested_orders)*n);
+    if(!requests || !requested_orders){
+        free(requests);
+        free(requested_orders);
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    for(int i=0;i<n;i++){
+        requests[i].order_id=orderIds[i];
+        requests[i].position=i;
+    }
+    qsort(requests,n,sizeof(*requests),compareShipRequests);
+    // orders are locked before shards
+    findRequestedOrders(matamazom,requests,n,requested_orders);
+    lockAllShards(matamazom,true);
+    int catalog_size=0;
+    for(int i=0;i<matamazom->shards_number;i++){
+        catalog_size=catalog_size+
+                asGetSize(matamazom->shards[i].list_of_products);
+    }
+    ASCursor* catalog=malloc(sizeof(*catalog)*(catalog_size+1));
+    Quantity* incomes=malloc(sizeof(*incomes)*(catalog_size+1));
+    if(!catalog || !incomes){
+        catalog_size=0;
+    }
+    // a single walk over the catalog, incomes are written back once at the end
+    int index=0;
+    ShardCursors walk;
+    PRODUCTS_FOREACH(warehouse_cursor,&walk,matamazom){
+        if(index==catalog_size){
+            break;
+        }
+        catalog[index]=warehouse_cursor;
+        incomes[index]=((Product)asCursorGetElement(warehouse_cursor))->income;
+        index++;
+    }
+
+    // orders are shipped in the order of their ids, and the incomes of their
+    // lines are added by chunks that may span several orders
+    Product shipped_products[PARALLEL_CHUNK_SIZE];
+    Quantity shipped_amounts[PARALLEL_CHUNK_SIZE];
+    Quantity* shipped_incomes[PARALLEL_CHUNK_SIZE];
+    int shipped_number=0;
+    for(int request_index=0;catalog && incomes && request_index<n;
+                                                            request_index++){
+        Order current_order=requested_orders[request_index];
+        MatamazomResult result=MATAMAZOM_ORDER_NOT_EXIST;
+        if(current_order){
+            result=MATAMAZOM_SUCCESS;
+            Quantity amount_in_order;
+            if(!matamazom->reserve_stock){
+                AS_CURSOR_FOREACH(order_cursor,
+                                  current_order->list_of_order_products){
+                    Product orderProduct=asCursorGetElement(order_cursor);
+                    int product_index=findCatalogIndex(catalog,catalog_size,
+                            orderProduct->id);
+                    amount_in_order=getQuantityOfCursor(order_cursor);
+                    if(product_index<0){
+                        result=MATAMAZOM_INSUFFICIENT_AMOUNT;
+                        break;
+                    }
+                    if(amount_in_order>
+                            getQuantityOfCursor(catalog[product_index])){
+                        result=MATAMAZOM_INSUFFICIENT_AMOUNT;
+                        break;
+                    }
+                }
+            }
+            if(result==MATAMAZOM_SUCCESS){
+                AS_CURSOR_FOREACH(order_cursor,
+                                  current_order->list_of_order_products){
+                    Product orderProduct=asCursorGetElement(order_cursor);
+                    int product_index=findCatalogIndex(catalog,catalog_size,
+                            orderProduct->id);
+                    Product warehouse_product=
+                            asCursorGetElement(catalog[product_index]);
+                    removeFromOrderIndex(&warehouse_product->orders,
+                            current_order->id);
+                    amount_in_order=getQuantityOfCursor(order_cursor);
+                    asCursorChangeAmount(catalog[product_index],
+                            -(double)amount_in_order);
+                    markProductChanged(matamazom,catalog[product_index]);
+                    publishEvent(matamazom,MTM_EVENT_STOCK_CHANGED,
+                            orderProduct->id,0,-amount_in_order);
+                    if(matamazom->reserve_stock){
+                        warehouse_product->reserved=
+                                warehouse_product->reserved-amount_in_order;
+                    }
+                    shipped_products[shipped_number]=warehouse_product;
+                    shipped_amounts[shipped_number]=amount_in_order;
+                    shipped_incomes[shipped_number]=&incomes[product_index];
+                    shipped_number++;
+                    if(shipped_number==PARALLEL_CHUNK_SIZE){
+                        addIncomes(shipped_products,shipped_amounts,
+                                shipped_number,shipped_incomes);
+                        shipped_number=0;
+                    }
+                }
+                publishEvent(matamazom,MTM_EVENT_ORDER_SHIPPED,0,
+                        current_order->id,0);
+            } else{
+                requested_orders[request_index]=NULL;
+                unlockOrder(matamazom,current_order);
+            }
+        } else if(request_index>0 && requests[request_index-1].order_id==
+                                        requests[request_index].order_id){
+            // repeated requests for the same order get the answer shipping it
+            // again would give
+            MatamazomResult first_result=
+                    results[requests[request_index-1].position];
+            result=first_result==MATAMAZOM_SUCCESS ?
+                    MATAMAZOM_ORDER_NOT_EXIST : first_result;
+        }
+        results[requests[request_index].position]=result;
+    }
+    if(shipped_number>0){
+        addIncomes(shipped_products,shipped_amounts,shipped_number,
+                shipped_incomes);
+    }
+
+    for(int i=0;i<catalog_size;i++){
+        ((Product)asCursorGetElement(catalog[i]))->income=incomes[i];
+    }
+    unlockAllShards(matamazom);
+    bool out_of_memory=!catalog || !incomes;
+    for(int i=0;i<n;i++){
+        Order shipped_order=requested_orders[i];
+        if(shipped_order){
+            unlockOrder(matamazom,shipped_order);
+            if(!out_of_memory){
+                setRemove(getOrderStripe(matamazom,shipped_order->id)->
+                        set_of_orders,(SetElement)shipped_order);
+            }
+        }
+    }
+    free(requests);
+    free(requested_orders);
+    free(catalog);
+    free(incomes);
+    return out_of_memory ? MATAMAZOM_OUT_OF_MEMORY : MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmShipOrders(Matamazom matamazom,
+                              const unsigned int *orderIds, const int n,
+                              MatamazomResult *results){
     if(!matamazom){
         return MATAMAZOM_NULL_ARGUMENT;
     }
-    //get the order
-    Order wanted_order=getOrderFromId(matamazom->set_of_orders,orderId);
+    lockAllOrderStripes(matamazom);
+    MatamazomResult result=shipOrders(matamazom, orderIds, n, results);
+    unlockAllOrderStripes(matamazom);
+    return result;
+}
+
+static MatamazomResult cancelOrder(Matamazom matamazom, const unsigned int orderId){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    //get the order, its stripe stays locked until it is removed
+    OrderStripe stripe=getOrderStripe(matamazom,orderId);
+    Order wanted_order=getOrderFromId(stripe->set_of_orders,orderId);
 
     if(wanted_order == NULL){
         return MATAMAZOM_ORDER_NOT_EXIST;
     }
-    setRemove(matamazom->set_of_orders, (SetElement)wanted_order);
+    lockOrder(matamazom,wanted_order);
+    bool locked_shards[MATAMAZOM_SHARDS_NUMBER];
+    lockShardsOfOrder(matamazom,wanted_order,locked_shards);
+    releaseOrderProducts(matamazom, wanted_order);
+    unlockShardsOfOrder(matamazom,locked_shards);
+    publishEvent(matamazom,MTM_EVENT_ORDER_CANCELED,0,orderId,0);
+    unlockOrder(matamazom,wanted_order);
+    setRemove(stripe->set_of_orders, (SetElement)wanted_order);
+    return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmCancelOrder(Matamazom matamazom, const unsigned int orderId){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    OrderStripe stripe=getOrderStripe(matamazom,orderId);
+    lockOrderStripe(matamazom,stripe);
+    MatamazomResult result=cancelOrder(matamazom, orderId);
+    unlockOrderStripe(matamazom,stripe);
+    return result;
+}
+
+/**
+ * MatamazomSubscriber_t
+ *
+ * A reader of the change feed of a warehouse.
+ *
+ * @param matamazom - The warehouse whose feed is read.
+ * @param next_sequence - The sequence of the next event to read.
+ */
+struct MatamazomSubscriber_t {
+    Matamazom matamazom;
+    unsigned long long next_sequence;
+};
+
+MatamazomResult mtmEnableChangeFeed(Matamazom matamazom,
+                                    const unsigned int capacity){
+    if(!matamazom){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    if(capacity==0){
+        return MATAMAZOM_INVALID_AMOUNT;
+    }
+    if(__atomic_load_n(&matamazom->change_feed,__ATOMIC_ACQUIRE)){
+        return MATAMAZOM_SUCCESS;
+    }
+    ChangeFeed feed=malloc(sizeof(*feed));
+    if(!feed){
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    feed->events=malloc(sizeof(*feed->events)*capacity);
+    if(!feed->events){
+        free(feed);
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    if(pthread_mutex_init(&feed->lock,NULL) != 0){
+        free(feed->events);
+        free(feed);
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    feed->capacity=capacity;
+    feed->next_sequence=0;
+    // the feed may be enabled by several threads together, only one is kept
+    ChangeFeed no_feed=NULL;
+    if(!__atomic_compare_exchange_n(&matamazom->change_feed,&no_feed,feed,
+            false,__ATOMIC_RELEASE,__ATOMIC_ACQUIRE)){
+        destroyChangeFeed(feed);
+    }
     return MATAMAZOM_SUCCESS;
 }
+
+MatamazomSubscriber mtmSubscribe(Matamazom matamazom){
+    if(!matamazom){
+        return NULL;
+    }
+    ChangeFeed feed=__atomic_load_n(&matamazom->change_feed,__ATOMIC_ACQUIRE);
+    if(!feed){
+        return NULL;
+    }
+    MatamazomSubscriber subscriber=malloc(sizeof(*subscriber));
+    if(!subscriber){
+        return NULL;
+    }
+    subscriber->matamazom=matamazom;
+    if(matamazom->concurrent){
+        pthread_mutex_lock(&feed->lock);
+    }
+    subscriber->next_sequence=feed->next_sequence;
+    if(matamazom->concurrent){
+        pthread_mutex_unlock(&feed->lock);
+    }
+    return subscriber;
+}
+
+void mtmUnsubscribe(MatamazomSubscriber subscriber){
+    free(subscriber);
+}
+
+MatamazomResult mtmPollEvents(MatamazomSubscriber subscriber, MtmEvent *events,
+                              const int maxEvents, int *outNumber){
+    if(!subscriber || !events || !outNumber){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    Matamazom matamazom=subscriber->matamazom;
+    ChangeFeed feed=__atomic_load_n(&matamazom->change_feed,__ATOMIC_ACQUIRE);
+    *outNumber=0;
+    if(matamazom->concurrent){
+        pthread_mutex_lock(&feed->lock);
+    }
+    unsigned long long oldest_sequence=feed->next_sequence>feed->capacity ?
+            feed->next_sequence-feed->capacity : 0;
+    MatamazomResult result=MATAMAZOM_SUCCESS;
+    if(subscriber->next_sequence<oldest_sequence){
+        subscriber->next_sequence=oldest_sequence;
+        result=MATAMAZOM_EVENTS_LOST;
+    } else{
+        while(*outNumber<maxEvents &&
+                subscriber->next_sequence<feed->next_sequence){
+            events[*outNumber]=feed->events[subscriber->next_sequence %
+                    feed->capacity];
+            (*outNumber)++;
+            subscriber->next_sequence++;
+        }
+    }
+    if(matamazom->concurrent){
+        pthread_mutex_unlock(&feed->lock);
+    }
+    return result;
+}
@@ -14,6 +14,8 @@ typedef enum MatamazomResult_t {
     MATAMAZOM_PRODUCT_NOT_EXIST,
     MATAMAZOM_ORDER_NOT_EXIST,
     MATAMAZOM_INSUFFICIENT_AMOUNT,
+    MATAMAZOM_INVALID_DATA_SIZE,
+    MATAMAZOM_EVENTS_LOST,
 } MatamazomResult;
 
 /** Type for specifying what is a valid amount for a product.
@@ -27,6 +29,11 @@ typedef enum MatamazomResult_t {
  * 
  * For MATAMAZOM_ANY_AMOUNT, any amount is valid. For example, this is suitable for
  * products which are measured by weight.
+ *
+ * The warehouse keeps amounts and incomes as whole numbers of millionths, so
+ * amounts are rounded to the nearest 0.000001 once they are validated, and are
+ * then added and compared exactly. Amounts larger than 9,007,199,254 (in
+ * absolute value) are not valid for any amount type.
  */
 typedef enum MatamazomAmountType_t {
     MATAMAZOM_INTEGER_AMOUNT,
@@ -34,12 +41,56 @@ typedef enum MatamazomAmountType_t {
     MATAMAZOM_ANY_AMOUNT,
 } MatamazomAmountType;
 
+/** Flags for selecting optional behaviours of a Matamazom warehouse.
+ * The flags can be combined with a bitwise or.
+ *
+ * MATAMAZOM_DEFAULT_MODE - the behaviour described in the *.pdf.
+ *
+ * MATAMAZOM_RESERVE_STOCK - products are reserved in the warehouse as soon as
+ * they are added to an order. The amount available for orders is the amount in
+ * the warehouse minus the amount already reserved by open orders. Reserved
+ * amounts are released when the order is canceled or decreased, and consumed
+ * when the order is shipped, so shipping never fails for lack of stock.
+ *
+ * MATAMAZOM_CONCURRENT - the warehouse may be used by several threads at the
+ * same time. mtmPrintInventory, mtmPrintBestSelling and mtmPrintFiltered print
+ * a snapshot of the products as they were when the report started, so they do
+ * not wait for, or hold back, the functions that change the warehouse while
+ * they print. A snapshot only takes the products that changed since the last
+ * one, and shares the rest with it.
+ * mtmChangeProductAmount changes the amount atomically, so it may run together
+ * with itself. Every order has its own lock, so functions that use different
+ * orders (e.g. mtmChangeProductAmountInOrder, mtmPrintOrder) run together, and
+ * only wait for the products they use. mtmClearProduct and mtmShipOrders wait
+ * for all the functions that use orders.
+ * Functions received from the user (e.g. MtmGetProductPrice, MtmFilterProduct)
+ * may be called from several threads at the same time.
+ * matamazomDestroy must not be called while the warehouse is still in use.
+ *
+ * MATAMAZOM_SHARDED - implies MATAMAZOM_CONCURRENT. The products are split
+ * between several shards by their id, each with its own lock, so functions
+ * that change different products (mtmNewProduct, mtmChangeProductAmount,
+ * mtmClearProduct) usually run together. Shipping an order only locks the
+ * shards of its products. The printed reports are the same as in the other
+ * modes.
+ */
+typedef enum MatamazomMode_t {
+    MATAMAZOM_DEFAULT_MODE = 0,
+    MATAMAZOM_RESERVE_STOCK = 1 << 0,
+    MATAMAZOM_CONCURRENT = 1 << 1,
+    MATAMAZOM_SHARDED = 1 << 2,
+} MatamazomMode;
+
 /** Type for representing a Matamazom warehouse */
 typedef struct Matamazom_t *Matamazom;
 
 /** Type for additional custom data of a product */
 typedef void *MtmProductData;
 
+/** The largest custom data, in bytes, that a product may keep inline
+ * (@see mtmNewProductWithInlineData) */
+#define MTM_INLINE_DATA_SIZE 16
+
 /**
  * Type of function for copying a product's custom data.
  *
@@ -74,6 +125,87 @@ typedef void (*MtmFreeData)(MtmProductData);
  */
 typedef double (*MtmGetProductPrice)(MtmProductData, const double amount);
 
+/**
+ * Type of function for calculating the prices of many amounts of products at
+ * once.
+ *
+ * Such a function receives n custom data of products and n amounts, and writes
+ * the price of purchasing every amount of its product to the matching entry of
+ * prices. The products may be different, but all of them were added with the
+ * same function. The warehouse passes it all the lines it prices together
+ * (e.g. up to 64 lines of an order, or of the orders shipped by
+ * mtmShipOrders), so simple prices can be computed with SIMD instructions.
+ *
+ * For example, the batch version of basicGetPrice:
+ * @code
+ * void basicGetPrices(const MtmProductData *basePrices, const double *amounts,
+ *                     int n, double *prices) {
+ *     for (int i = 0; i < n; ++i) {
+ *         prices[i] = (*(double*)basePrices[i]) * amounts[i];
+ *     }
+ * }
+ * @endcode
+ */
+typedef void (*MtmGetProductPriceBatch)(const MtmProductData *customData,
+                                        const double *amounts, int n,
+                                        double *prices);
+
+/** Flags for declaring how the price function of a product may be used.
+ * The flags can be combined with a bitwise or.
+ *
+ * MTM_PRICE_DEFAULT - the price function is called every time a price is
+ * needed.
+ *
+ * MTM_PRICE_CACHEABLE - the price function always returns the same price for
+ * the same amount, so the warehouse remembers the prices of recently priced
+ * amounts of the product, and does not call the function for them again until
+ * mtmInvalidatePrices is called for the product.
+ */
+typedef enum MtmPriceFlags_t {
+    MTM_PRICE_DEFAULT = 0,
+    MTM_PRICE_CACHEABLE = 1 << 0,
+} MtmPriceFlags;
+
+/** The largest number of tiers a MTM_PRICE_RULE_TIERED rule may have */
+#define MTM_PRICE_RULE_MAX_TIERS 4
+
+/** Types of the built-in pricing rules, which price a product without a price
+ * function.
+ *
+ * MTM_PRICE_RULE_LINEAR - every unit costs unitPrice.
+ *
+ * MTM_PRICE_RULE_BUY_GET_FREE - the first paidAmount units cost unitPrice each,
+ * the next freeAmount units are free, and every unit after them costs
+ * unitPrice again. For example, paidAmount 10 and freeAmount 10 mean "buy 10,
+ * get the next 10 for free".
+ *
+ * MTM_PRICE_RULE_TIERED - every unit costs the price of the tier it falls in:
+ * tier i holds the units from tierStarts[i] up to tierStarts[i+1], and each of
+ * them costs tierUnitPrices[i]. The last tier holds all the units above its
+ * start.
+ */
+typedef enum MtmPriceRuleType_t {
+    MTM_PRICE_RULE_LINEAR,
+    MTM_PRICE_RULE_BUY_GET_FREE,
+    MTM_PRICE_RULE_TIERED,
+} MtmPriceRuleType;
+
+/** A built-in pricing rule of a product (@see MtmPriceRuleType).
+ * Only the fields of the rule's type are used. A MTM_PRICE_RULE_BUY_GET_FREE
+ * rule must have non-negative paidAmount and freeAmount. A MTM_PRICE_RULE_TIERED
+ * rule must have between 1 and MTM_PRICE_RULE_MAX_TIERS tiers, whose starts are
+ * ascending and begin with 0.
+ */
+typedef struct MtmPriceRule_t {
+    MtmPriceRuleType type;
+    double unitPrice;
+    double paidAmount;
+    double freeAmount;
+    int tiersNumber;
+    double tierStarts[MTM_PRICE_RULE_MAX_TIERS];
+    double tierUnitPrices[MTM_PRICE_RULE_MAX_TIERS];
+} MtmPriceRule;
+
 /**
  * Type of function for filtering a product.
  *
@@ -107,6 +239,18 @@ typedef bool (*MtmFilterProduct)(const unsigned int id, const char *name, const
  */
 Matamazom matamazomCreate();
 
+/**
+ * matamazomCreateWithMode: create an empty Matamazom warehouse with optional
+ * behaviours enabled.
+ *
+ * @param modeFlags - a bitwise or of MatamazomMode flags.
+ *     matamazomCreateWithMode(MATAMAZOM_DEFAULT_MODE) is the same as
+ *     matamazomCreate().
+ * @return A new Matamazom warehouse in case of success, and NULL otherwise (e.g.
+ *     in case of an allocation error)
+ */
+Matamazom matamazomCreateWithMode(const unsigned int modeFlags);
+
 /**
  * matamazomDestroy: free a Matamazom warehouse, and all its contents, from
  * memory.
@@ -144,6 +288,122 @@ MatamazomResult mtmNewProduct(Matamazom matamazom, const unsigned int id, const
                               const double amount, const MatamazomAmountType amountType,
                               const MtmProductData customData, MtmCopyData copyData,
                               MtmFreeData freeData, MtmGetProductPrice prodPrice);
+
+/**
+ * mtmNewProductWithFlags: add a new product to a Matamazom warehouse, and
+ * declare how its price function may be used.
+ *
+ * @param matamazom, id, name, amount, amountType, customData, copyData,
+ *     freeData, prodPrice - the same as in mtmNewProduct.
+ * @param priceFlags - a bitwise or of MtmPriceFlags. MTM_PRICE_DEFAULT adds
+ *     the product exactly as mtmNewProduct does.
+ * @return
+ *     The same results as mtmNewProduct.
+ */
+MatamazomResult mtmNewProductWithFlags(Matamazom matamazom, const unsigned int id,
+                                       const char *name, const double amount,
+                                       const MatamazomAmountType amountType,
+                                       const MtmProductData customData,
+                                       MtmCopyData copyData, MtmFreeData freeData,
+                                       MtmGetProductPrice prodPrice,
+                                       const MtmPriceFlags priceFlags);
+
+/**
+ * mtmInvalidatePrices: forget the prices remembered for a product, so they are
+ * computed again by its price function. It should be called whenever the data
+ * its price function depends on changes.
+ *
+ * The price of a single unit, printed by mtmPrintInventory and
+ * mtmPrintFiltered, is computed once when a product is added, and is computed
+ * again here. For a product added with MTM_PRICE_CACHEABLE, all the prices it
+ * remembers are forgotten as well.
+ *
+ * @param matamazom - warehouse of the product. Must be non-NULL.
+ * @param id - existing product id.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_PRODUCT_NOT_EXIST - if matamazom does not contain a product with
+ *         the given id.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmInvalidatePrices(Matamazom matamazom, const unsigned int id);
+
+/**
+ * mtmNewProductWithRule: add a new product to a Matamazom warehouse, which is
+ * priced by a built-in pricing rule instead of a price function.
+ *
+ * The warehouse prices such products without calling back to the user, so
+ * orders of many of them are priced faster. The rule is copied, and
+ * mtmInvalidatePrices has no effect on the product.
+ *
+ * @param matamazom, id, name, amount, amountType, customData, copyData,
+ *     freeData - the same as in mtmNewProduct.
+ * @param priceRule - the rule that prices the product. Must be non-NULL.
+ * @return
+ *     The same results as mtmNewProduct, and
+ *     MATAMAZOM_INVALID_AMOUNT - also if the rule is not valid (@see
+ *         MtmPriceRule).
+ */
+MatamazomResult mtmNewProductWithRule(Matamazom matamazom, const unsigned int id,
+                                      const char *name, const double amount,
+                                      const MatamazomAmountType amountType,
+                                      const MtmProductData customData,
+                                      MtmCopyData copyData, MtmFreeData freeData,
+                                      const MtmPriceRule *priceRule);
+
+/**
+ * mtmNewProductWithBatchPrice: add a new product to a Matamazom warehouse,
+ * which is priced by a batch price function instead of a price function.
+ *
+ * Order totals and shipments price the lines of such products together, with a
+ * single call for every batch function. A single amount is priced by calling
+ * the function with n = 1.
+ *
+ * @param matamazom, id, name, amount, amountType, customData, copyData,
+ *     freeData - the same as in mtmNewProduct.
+ * @param prodPriceBatch - the function that prices the product. Must be
+ *     non-NULL.
+ * @return
+ *     The same results as mtmNewProduct.
+ */
+MatamazomResult mtmNewProductWithBatchPrice(Matamazom matamazom,
+                                            const unsigned int id,
+                                            const char *name,
+                                            const double amount,
+                                            const MatamazomAmountType amountType,
+                                            const MtmProductData customData,
+                                            MtmCopyData copyData,
+                                            MtmFreeData freeData,
+                                            MtmGetProductPriceBatch prodPriceBatch);
+
+/**
+ * mtmNewProductWithInlineData: add a new product to a Matamazom warehouse,
+ * whose custom data is small and is kept inside the product.
+ *
+ * The custom data is a plain block of up to MTM_INLINE_DATA_SIZE bytes (e.g. a
+ * base price), which is copied byte by byte, so no copy or free function is
+ * needed, and copying the product allocates nothing for it. The MtmProductData
+ * that the price function (and a filter function) receives points to the copy
+ * kept in the product, aligned for any basic type, and is valid while the
+ * product exists.
+ *
+ * @param matamazom, id, name, amount, amountType, prodPrice - the same as in
+ *     mtmNewProduct.
+ * @param customData - a pointer to the custom data to copy. Must be non-NULL.
+ * @param dataSize - the size of the custom data, in bytes.
+ * @return
+ *     The same results as mtmNewProduct, and
+ *     MATAMAZOM_INVALID_DATA_SIZE - if dataSize is 0 or larger than
+ *         MTM_INLINE_DATA_SIZE.
+ */
+MatamazomResult mtmNewProductWithInlineData(Matamazom matamazom,
+                                            const unsigned int id,
+                                            const char *name,
+                                            const double amount,
+                                            const MatamazomAmountType amountType,
+                                            const void *customData,
+                                            const size_t dataSize,
+                                            MtmGetProductPrice prodPrice);
 /**
  * mtmChangeProductAmount: increase or decrease the amount of an *existing* product in a Matamazom warehouse.
  * if 'amount' < 0 then this amount should be decreased from the matamazom warehouse.
@@ -167,7 +427,9 @@ MatamazomResult mtmNewProduct(Matamazom matamazom, const unsigned int id, const
  *     MATAMAZOM_INVALID_AMOUNT - if amount is not consistent with product's amount type
  *         (@see parameter amountType in mtmNewProduct).
  *     MATAMAZOM_INSUFFICIENT_AMOUNT - if 'amount' < 0 and the amount to be decreased
- *         is bigger than product's amount in the warehouse.
+ *         is bigger than product's amount in the warehouse. In
+ *         MATAMAZOM_RESERVE_STOCK mode, also if the amount left in the warehouse
+ *         would be smaller than the amount reserved by open orders.
  *     MATAMAZOM_SUCCESS - if product amount was increased/decreased successfully.
  * @note Even if amount is 0 (thus the function will change nothing), still a proper
  *    error code is returned if one of the parameters is invalid, and MATAMAZOM_SUCCESS
@@ -175,6 +437,30 @@ MatamazomResult mtmNewProduct(Matamazom matamazom, const unsigned int id, const
  */
 MatamazomResult mtmChangeProductAmount(Matamazom matamazom, const unsigned int id, const double amount);
 
+/**
+ * mtmChangeProductAmountBatch: apply several changes to the amount of the same
+ * product in a Matamazom warehouse.
+ *
+ * The changes are applied one after the other, exactly as if
+ * mtmChangeProductAmount was called for each of them, but the product is only
+ * looked up once, and its amount is only written once.
+ *
+ * @param matamazom - warehouse of the product. Must be non-NULL.
+ * @param id - existing product id.
+ * @param amounts - the n amounts to increase/decrease, in the order they are
+ *     applied.
+ * @param n - the number of changes.
+ * @param results - an array of n results, that is set to the result
+ *     mtmChangeProductAmount returns for every change.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - if the changes were applied, whether each of them
+ *         succeeded or not.
+ */
+MatamazomResult mtmChangeProductAmountBatch(Matamazom matamazom, const unsigned int id,
+                                            const double *amounts, const int n,
+                                            MatamazomResult *results);
+
 /**
  * mtmClearProduct: clear a product from a Matamazom warehouse.
  *
@@ -183,6 +469,8 @@ MatamazomResult mtmChangeProductAmount(Matamazom matamazom, const unsigned int i
  * 'income' mechanism(holding the profits for each existing product).
  * For example, after clearing a product with
  * mtmClearProduct, calling mtmChangeProductAmount on that product will fail.
+ * The warehouse keeps the open orders of every product, so only the orders
+ * that have the product are changed.
  *
  * @param matamazom - warehouse to remove the product from.
  * @param id - id of product to be removed.
@@ -229,6 +517,11 @@ unsigned int mtmCreateNewOrder(Matamazom matamazom);
  *         the given productId.
  *     MATAMAZOM_INVALID_AMOUNT - if amount is not consistent with product's amount type
  *         (@see parameter amountType in mtmNewProduct).
+ *     MATAMAZOM_INSUFFICIENT_AMOUNT - only in MATAMAZOM_RESERVE_STOCK mode, if the
+ *         increase is larger than the product's amount available for reservation.
+ *         In that case the order is not changed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure. In that
+ *         case the order is not changed.
  *     MATAMAZOM_SUCCESS - if product was added/removed/increased/decreased to the order successfully.
  * @note Even if amount is 0 (thus the function will change nothing), still a proper
  *    error code is returned if one of the parameters is invalid, and MATAMAZOM_SUCCESS
@@ -237,6 +530,37 @@ unsigned int mtmCreateNewOrder(Matamazom matamazom);
 MatamazomResult mtmChangeProductAmountInOrder(Matamazom, const unsigned int orderId,
                                      const unsigned int productId, const double amount);
 
+/**
+ * mtmChangeProductAmountInOrderBatch: apply several changes to the amount of
+ * the same product in an existing order.
+ *
+ * The changes are applied one after the other, exactly as if
+ * mtmChangeProductAmountInOrder was called for each of them, but the order and
+ * the product are only looked up once, and the order is only written once.
+ *
+ * @param matamazom - warehouse containing the order and the product. Must be
+ *     non-NULL.
+ * @param orderId - id of the order being modified.
+ * @param productId - id of the product to change in the order.
+ * @param amounts - the n amounts to add to the product in the order, in the
+ *     order they are applied.
+ * @param n - the number of changes.
+ * @param results - an array of n results, that is set to the result
+ *     mtmChangeProductAmountInOrder returns for every change.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure. In that
+ *         case the order is not changed, and every result is set to it.
+ *     MATAMAZOM_SUCCESS - if the changes were applied, whether each of them
+ *         succeeded or not.
+ */
+MatamazomResult mtmChangeProductAmountInOrderBatch(Matamazom matamazom,
+                                                   const unsigned int orderId,
+                                                   const unsigned int productId,
+                                                   const double *amounts,
+                                                   const int n,
+                                                   MatamazomResult *results);
+
 /**
  * mtmShipOrder: ship an order and remove it from a Matamazom warehouse.
  *
@@ -249,6 +573,8 @@ MatamazomResult mtmChangeProductAmountInOrder(Matamazom, const unsigned int orde
  * the order is larger than its amount in the warehouse, then the entire
  * operation is canceled - the order remains in the warehouse, and the
  * warehouse contents are not modified.
+ * In MATAMAZOM_RESERVE_STOCK mode the order's amounts are already reserved, so
+ * the order is shipped without checking the warehouse again.
  *
  * @param matamazom - warehouse containing the order and all the products.
  * @param orderId - id of the order being shipped.
@@ -262,11 +588,36 @@ MatamazomResult mtmChangeProductAmountInOrder(Matamazom, const unsigned int orde
  */
 MatamazomResult mtmShipOrder(Matamazom matamazom, const unsigned int orderId);
 
+/**
+ * mtmShipOrders: ship several orders of a Matamazom warehouse at once.
+ *
+ * The orders are shipped in ascending order of their ids, and the result of
+ * each order is exactly the result mtmShipOrder would return if the orders
+ * were shipped one by one in that order. The products of the warehouse are
+ * walked only once for the entire batch.
+ *
+ * @param matamazom - warehouse containing the orders and all the products.
+ * @param orderIds - an array of the ids of the orders to ship.
+ * @param n - the number of ids in orderIds.
+ * @param results - an array of n results. results[i] is set to the result of
+ *     shipping orderIds[i] (@see mtmShipOrder). If the same id is requested
+ *     more than once, only its first request may ship it.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - if an allocation failed. In that case no order
+ *         is shipped and results is not changed.
+ *     MATAMAZOM_SUCCESS - if every order was handled, whether it was shipped or
+ *         not.
+ */
+MatamazomResult mtmShipOrders(Matamazom matamazom, const unsigned int *orderIds,
+                              const int n, MatamazomResult *results);
+
 /**
  * mtmCancelOrder: cancel an order and remove it from a Matamazom warehouse.
  *
  * The order is deleted from the warehouse. The products and their amounts in
- * the warehouse is not changed.
+ * the warehouse is not changed. In MATAMAZOM_RESERVE_STOCK mode the amounts
+ * reserved by the order are released.
  *
  * @param matamazom - warehouse containing the order.
  * @param orderId - id of the order being canceled.
@@ -290,6 +641,31 @@ MatamazomResult mtmCancelOrder(Matamazom matamazom, const unsigned int orderId);
  */
 MatamazomResult mtmPrintInventory(Matamazom matamazom, FILE *output);
 
+/**
+ * mtmPrintInventoryRange: print the products of a Matamazom warehouse whose ids
+ * are between lowId and highId (inclusive), in the format of
+ * mtmPrintInventory.
+ *
+ * The range is read from a snapshot of the products sorted by id, so the first
+ * product of the range is found in logarithmic time, and only the products in
+ * the range are visited. The first range that is read from a warehouse takes a
+ * snapshot of all its products, and the next ones only take the products that
+ * changed since.
+ *
+ * @param matamazom - a Matamazom warehouse to print.
+ * @param lowId - the smallest id to print.
+ * @param highId - the largest id to print. If it is smaller than lowId, no
+ *     product is printed.
+ * @param output - an open, writable output stream, to which the contents are printed.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmPrintInventoryRange(Matamazom matamazom,
+                                       const unsigned int lowId,
+                                       const unsigned int highId,
+                                       FILE *output);
+
 /**
  * matamazomPrintOrder: print a summary of an order from a Matamazom warehouse,
  * as explained in the *.pdf
@@ -307,6 +683,48 @@ MatamazomResult mtmPrintInventory(Matamazom matamazom, FILE *output);
  */
 MatamazomResult mtmPrintOrder(Matamazom matamazom, const unsigned int orderId, FILE *output);
 
+/**
+ * mtmGetOrderTotal: get the total price of an order, as printed by
+ * mtmPrintOrder.
+ *
+ * Every order keeps its total, in millionths: a change to the amount of a
+ * product in the order adds the difference between the new and the old price
+ * of the line, so the total is returned without pricing the order again.
+ * Prices are assumed not to change until mtmInvalidatePrices is called, which
+ * makes the totals of all the orders be computed again from their lines the
+ * next time they are needed. Such a total does not depend on the order the
+ * lines are summed in. In MATAMAZOM_CONCURRENT mode, the lines of large orders
+ * are priced by several threads.
+ *
+ * @param matamazom - the Matamazom warehouse containing the order.
+ * @param orderId - id of the order in matamazom.
+ * @param outTotal - pointer to the location where the total is returned.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_ORDER_NOT_EXIST - if matamazom does not contain an order with
+ *         the given orderId.
+ *     MATAMAZOM_SUCCESS - if the total was returned successfully.
+ */
+MatamazomResult mtmGetOrderTotal(Matamazom matamazom, const unsigned int orderId,
+                                 double *outTotal);
+
+/**
+ * mtmGetOpenOrdersTotal: get the sum of the total prices of all the open orders
+ * of a Matamazom warehouse.
+ *
+ * The totals kept by the orders are summed (@see mtmGetOrderTotal). In
+ * MATAMAZOM_CONCURRENT mode, the orders whose totals must be computed again
+ * are priced by several threads.
+ *
+ * @param matamazom - a Matamazom warehouse.
+ * @param outTotal - pointer to the location where the total is returned.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if the total was returned successfully.
+ */
+MatamazomResult mtmGetOpenOrdersTotal(Matamazom matamazom, double *outTotal);
+
 /**
  * mtmPrintBestSelling: print the best selling products of a Matamazom
  * warehouse, as explained in the *.pdf.
@@ -337,4 +755,293 @@ MatamazomResult mtmPrintBestSelling(Matamazom matamazom, FILE *output);
  */
 MatamazomResult mtmPrintFiltered(Matamazom matamazom, MtmFilterProduct customFilter, FILE *output);
 
+/**
+ * mtmPrintFilteredParallel: print some products of a Matamazom warehouse,
+ * according to a custom filter, exactly like mtmPrintFiltered does, while
+ * calling the filter from several threads at the same time.
+ *
+ * The products are split into ranges, that are filtered by a few threads which
+ * take work from each other once they finish their own ranges. The products
+ * that passed the filter are then printed in ascending id order by the calling
+ * thread, so the output is the same as the output of mtmPrintFiltered.
+ *
+ * @param matamazom - a Matamazom warehouse.
+ * @param customFilter - a boolean function that receives a product's information and
+ *     returns true if it should be printed.
+ * @param filterIsThreadSafe - true if customFilter may be called from several
+ *     threads at the same time. If false, the products are filtered by the
+ *     calling thread alone.
+ * @param output - an open, writable output stream, to which the order is printed.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmPrintFilteredParallel(Matamazom matamazom,
+                                         MtmFilterProduct customFilter,
+                                         const bool filterIsThreadSafe,
+                                         FILE *output);
+
+/** Type for representing an unchanging version of a Matamazom warehouse */
+typedef struct MatamazomVersion_t *MatamazomVersion;
+
+/**
+ * mtmCaptureVersion: capture a version of a Matamazom warehouse, that keeps
+ * its products (with their amounts and incomes) and its open orders as they
+ * are now, for reports that are printed later "as of" this moment.
+ *
+ * Capturing a version does not copy the warehouse: the version shares the
+ * products with the warehouse and with the other versions, and only keeps
+ * apart what changes after it is captured (the amounts and incomes of changed
+ * products, or the lines of a changed order). The custom data of the products
+ * is never copied for a version. The warehouse keeps working while versions
+ * exist, and a version never changes. A version may be printed by several
+ * threads at the same time.
+ *
+ * @param matamazom - the warehouse to capture.
+ * @return
+ *     NULL - if matamazom is NULL or allocations failed.
+ *     A new version in case of success. It must be destroyed with
+ *     mtmVersionDestroy.
+ */
+MatamazomVersion mtmCaptureVersion(Matamazom matamazom);
+
+/**
+ * mtmVersionDestroy: free all the resources of a version. The warehouse it was
+ * captured from is not changed.
+ *
+ * @param version - the version to destroy. If version is NULL nothing is done.
+ */
+void mtmVersionDestroy(MatamazomVersion version);
+
+/**
+ * mtmVersionPrintInventory: print the inventory of a warehouse as it was when
+ * a version was captured, in the format of mtmPrintInventory.
+ *
+ * @param version - the captured version.
+ * @param output - an open, writable output stream.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmVersionPrintInventory(MatamazomVersion version, FILE *output);
+
+/**
+ * mtmVersionPrintOrder: print an order of a warehouse as it was when a version
+ * was captured, in the format of mtmPrintOrder.
+ *
+ * @param version - the captured version.
+ * @param orderId - id of an order that was open when the version was captured.
+ * @param output - an open, writable output stream.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_ORDER_NOT_EXIST - if the order was not open when the version was
+ *         captured.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmVersionPrintOrder(MatamazomVersion version,
+                                     const unsigned int orderId, FILE *output);
+
+/**
+ * mtmVersionPrintBestSelling: print the best selling product of a warehouse as
+ * it was when a version was captured, in the format of mtmPrintBestSelling.
+ *
+ * @param version - the captured version.
+ * @param output - an open, writable output stream.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmVersionPrintBestSelling(MatamazomVersion version, FILE *output);
+
+/**
+ * mtmVersionPrintFiltered: print the products of a warehouse that pass a
+ * filter, as they were when a version was captured, in the format of
+ * mtmPrintFiltered.
+ *
+ * @param version - the captured version.
+ * @param customFilter - a function that determines which products to print.
+ * @param output - an open, writable output stream.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmVersionPrintFiltered(MatamazomVersion version,
+                                        MtmFilterProduct customFilter,
+                                        FILE *output);
+
+/** Type for walking over the products of a warehouse in a range of ids */
+typedef struct MatamazomProductCursor_t *MatamazomProductCursor;
+
+/** A product of a warehouse, as returned by mtmProductCursorNext.
+ *
+ * id, name, amount, customData - as given to MtmFilterProduct. name and
+ *     customData belong to the cursor, and stay valid until it is destroyed.
+ */
+typedef struct MtmProductInfo_t {
+    unsigned int id;
+    const char *name;
+    double amount;
+    MtmProductData customData;
+} MtmProductInfo;
+
+/**
+ * mtmProductCursorCreate: start a walk over the products of a warehouse whose
+ * ids are between lowId and highId (inclusive), in ascending id order.
+ *
+ * The cursor sees the products as they are now, like a version (@see
+ * mtmCaptureVersion), so the warehouse may change while it is walked. The
+ * first product of the range is found in logarithmic time, and only the
+ * products in the range are visited (@see mtmPrintInventoryRange).
+ *
+ * @param matamazom - the warehouse to walk.
+ * @param lowId - the smallest id to walk.
+ * @param highId - the largest id to walk.
+ * @return
+ *     NULL - if matamazom is NULL or allocations failed.
+ *     A new cursor in case of success. It must be destroyed with
+ *     mtmProductCursorDestroy.
+ */
+MatamazomProductCursor mtmProductCursorCreate(Matamazom matamazom,
+                                              const unsigned int lowId,
+                                              const unsigned int highId);
+
+/**
+ * mtmProductCursorDestroy: free all the resources of a cursor.
+ *
+ * @param cursor - the cursor to destroy. If cursor is NULL nothing is done.
+ */
+void mtmProductCursorDestroy(MatamazomProductCursor cursor);
+
+/**
+ * mtmProductCursorNext: move a cursor to the next product of its range.
+ *
+ * @param cursor - the cursor to move.
+ * @param outInfo - set to the next product, if there is one.
+ * @return
+ *     false - if a NULL argument is passed, or all the products of the range
+ *         were already returned.
+ *     true - if outInfo was set to the next product.
+ */
+bool mtmProductCursorNext(MatamazomProductCursor cursor,
+                          MtmProductInfo *outInfo);
+
+/** Type for representing a subscriber of the change feed of a warehouse */
+typedef struct MatamazomSubscriber_t *MatamazomSubscriber;
+
+/** The kinds of changes that are published in the change feed of a warehouse.
+ *
+ * MTM_EVENT_PRODUCT_CREATED - a product was added to the warehouse. amount is
+ * its amount in the warehouse.
+ *
+ * MTM_EVENT_STOCK_CHANGED - the amount of a product in the warehouse changed,
+ * by mtmChangeProductAmount or by shipping an order. amount is the change.
+ * Changes that were applied together (e.g. by mtmChangeProductAmountBatch) are
+ * published as a single event.
+ *
+ * MTM_EVENT_PRODUCT_CLEARED - a product was removed from the warehouse, and
+ * from all the open orders.
+ *
+ * MTM_EVENT_ORDER_CREATED - a new order was created.
+ *
+ * MTM_EVENT_LINE_CHANGED - the amount of a product in an order changed. amount
+ * is the new amount of the product in the order, 0 if it was removed.
+ *
+ * MTM_EVENT_ORDER_SHIPPED - an order was shipped. It comes after the
+ * MTM_EVENT_STOCK_CHANGED events of its products.
+ *
+ * MTM_EVENT_ORDER_CANCELED - an order was canceled.
+ */
+typedef enum MtmEventType_t {
+    MTM_EVENT_PRODUCT_CREATED,
+    MTM_EVENT_STOCK_CHANGED,
+    MTM_EVENT_PRODUCT_CLEARED,
+    MTM_EVENT_ORDER_CREATED,
+    MTM_EVENT_LINE_CHANGED,
+    MTM_EVENT_ORDER_SHIPPED,
+    MTM_EVENT_ORDER_CANCELED,
+} MtmEventType;
+
+/** A change to a warehouse, as published in its change feed.
+ *
+ * sequence - the number of events that were published before this one.
+ * type - the kind of change.
+ * productId - the id of the changed product. Not used by the events of orders
+ *     other than MTM_EVENT_LINE_CHANGED.
+ * orderId - the id of the changed order. Not used by the events of products.
+ * amount - as described in MtmEventType, 0 if not used.
+ */
+typedef struct MtmEvent_t {
+    unsigned long long sequence;
+    MtmEventType type;
+    unsigned int productId;
+    unsigned int orderId;
+    double amount;
+} MtmEvent;
+
+/**
+ * mtmEnableChangeFeed: start publishing the changes of a warehouse in its
+ * change feed, so subscribers can follow them.
+ *
+ * The feed keeps the last capacity events in a ring, that is shared by all the
+ * subscribers, so its memory does not grow however slowly they read it. A
+ * subscriber that falls behind by more than capacity events loses the events
+ * it did not read, and is told so by mtmPollEvents.
+ *
+ * @param matamazom - the warehouse to publish the changes of.
+ * @param capacity - the number of events the feed keeps.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if matamazom is NULL.
+ *     MATAMAZOM_INVALID_AMOUNT - if capacity is 0.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if the feed is enabled. If it was already enabled,
+ *         its capacity is not changed.
+ */
+MatamazomResult mtmEnableChangeFeed(Matamazom matamazom,
+                                    const unsigned int capacity);
+
+/**
+ * mtmSubscribe: subscribe to the change feed of a warehouse. The subscriber
+ * receives the events that are published from now on.
+ *
+ * @param matamazom - the warehouse to follow. It must not be destroyed before
+ *     the subscriber.
+ * @return
+ *     NULL - if matamazom is NULL, its change feed is not enabled, or
+ *         allocations failed.
+ *     A new subscriber in case of success. It must be destroyed with
+ *     mtmUnsubscribe.
+ */
+MatamazomSubscriber mtmSubscribe(Matamazom matamazom);
+
+/**
+ * mtmUnsubscribe: free all the resources of a subscriber.
+ *
+ * @param subscriber - the subscriber to destroy. If subscriber is NULL nothing
+ *     is done.
+ */
+void mtmUnsubscribe(MatamazomSubscriber subscriber);
+
+/**
+ * mtmPollEvents: read the next events of a change feed, in the order they were
+ * published, without waiting for new ones.
+ *
+ * A subscriber is only used by one thread at a time, but several subscribers
+ * may poll while the warehouse changes.
+ *
+ * @param subscriber - the subscriber that reads the events.
+ * @param events - an array of at least maxEvents events, that is filled with
+ *     the events that were read.
+ * @param maxEvents - the largest number of events to read.
+ * @param outNumber - set to the number of events that were read.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_EVENTS_LOST - if events the subscriber did not read yet were
+ *         already overwritten. No events are read, and the subscriber goes on
+ *         from the oldest event that is still kept, so it should rebuild
+ *         whatever it keeps of the warehouse (e.g. from mtmCaptureVersion).
+ *     MATAMAZOM_SUCCESS - if the events were read, even if there were none.
+ */
+MatamazomResult mtmPollEvents(MatamazomSubscriber subscriber, MtmEvent *events,
+                              const int maxEvents, int *outNumber);
+
 #endif /* MATAMAZOM_H_ */
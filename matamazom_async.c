@@ -0,0 +1,720 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "matamazom_async.h"
+#include "amount_validation.h"
+
+/**
+ * OperationType
+ *
+ * The kinds of operations that can be submitted to a queue.
+ */
+typedef enum operation_type{
+    OPERATION_NEW_PRODUCT,
+    OPERATION_CHANGE_AMOUNT,
+    OPERATION_CHANGE_AMOUNT_IN_ORDER,
+    OPERATION_SHIP_ORDER,
+    OPERATION_CANCEL_ORDER,
+}OperationType;
+
+/**
+ * Operation
+ *
+ * This is an internal struct implemented to be used by the MatamazomQueue.
+ * It holds a submitted operation and its arguments, until it is done.
+ *
+ * @param type - The kind of the operation.
+ * @param id - The id of the product, or of the order for order operations.
+ * @param product_id - The id of the product, for
+ * OPERATION_CHANGE_AMOUNT_IN_ORDER.
+ * @param amount - The amount argument of the operation.
+ * @param name, amount_type, custom_data, copy_data, free_data, product_price -
+ * The arguments of OPERATION_NEW_PRODUCT. name and custom_data are owned by
+ * the operation.
+ * @param completion - The function that receives the result, or NULL.
+ * @param user_data - Passed to the completion function.
+ * @param result - The result of the operation, once it is done.
+ * @param next - The operation that was submitted after this one.
+ */
+typedef struct operation{
+    OperationType type;
+    unsigned int id;
+    unsigned int product_id;
+    double amount;
+    char* name;
+    MatamazomAmountType amount_type;
+    MtmProductData custom_data;
+    MtmCopyData copy_data;
+    MtmFreeData free_data;
+    MtmGetProductPrice product_price;
+    MtmCompletion completion;
+    void* user_data;
+    MatamazomResult result;
+    struct operation* next;
+}*Operation;
+
+/**
+ * MatamazomQueue_t
+ *
+ * @param matamazom - The warehouse the operations are executed on.
+ * @param window - The time in microseconds the warehouse thread waits for more
+ * operations after one is submitted, so they are executed in the same batch.
+ * @param first_operation - The first operation that waits in the queue.
+ * @param last_operation - The last operation that waits in the queue.
+ * @param pending - The number of operations that were submitted and are not
+ * done yet.
+ * @param stopping - true once the queue is being destroyed.
+ * @param lock - Held while any of the fields above is used.
+ * @param submitted - Signaled when an operation is submitted, or the queue is
+ * being destroyed.
+ * @param completed - Signaled when operations are done.
+ * @param warehouse_thread - The thread that executes the operations.
+ */
+struct MatamazomQueue_t{
+    Matamazom matamazom;
+    unsigned int window;
+    Operation first_operation;
+    Operation last_operation;
+    int pending;
+    bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted;
+    pthread_cond_t completed;
+    pthread_t warehouse_thread;
+};
+
+/**
+ * AmountChange
+ *
+ * This is an internal struct implemented to be used by executeAmountChanges.
+ * It keeps the product of a change together with its place in the batch, so
+ * the changes can be grouped by product and still be applied in order.
+ *
+ * @param product_id - The id of the changed product.
+ * @param position - The index of the change in the batch.
+ */
+typedef struct amount_change{
+    unsigned int product_id;
+    int position;
+}AmountChange;
+
+/**
+ * freeOperation: frees an operation and the arguments it owns.
+ *
+ * @param operation - The operation to free.
+ */
+static void freeOperation(Operation operation){
+    if(!operation){
+        return;
+    }
+    if(operation->custom_data){
+        operation->free_data(operation->custom_data);
+    }
+    free(operation->name);
+    free(operation);
+}
+
+/**
+ * createOperation: creates an operation with no arguments.
+ *
+ * @param type - The kind of the operation.
+ * @param completion - The function that receives the result, or NULL.
+ * @param userData - Passed to the completion function.
+ *
+ * @return
+ *     NULL - if a memory allocation failed.
+ *     A new operation otherwise.
+ */
+static Operation createOperation(OperationType type, MtmCompletion completion,
+                                 void* userData){
+    Operation operation=malloc(sizeof(*operation));
+    if(!operation){
+        return NULL;
+    }
+    operation->type=type;
+    operation->id=0;
+    operation->product_id=0;
+    operation->amount=0;
+    operation->name=NULL;
+    operation->amount_type=MATAMAZOM_ANY_AMOUNT;
+    operation->custom_data=NULL;
+    operation->copy_data=NULL;
+    operation->free_data=NULL;
+    operation->product_price=NULL;
+    operation->completion=completion;
+    operation->user_data=userData;
+    operation->result=MATAMAZOM_SUCCESS;
+    operation->next=NULL;
+    return operation;
+}
+
+/**
+ * submitOperation: adds an operation to the end of a queue, and wakes the
+ *                  warehouse thread up.
+ *
+ * @param queue - The queue to submit to.
+ * @param operation - The operation to submit. It is owned by the queue from
+ *     now on.
+ *
+ * @return
+ *     MATAMAZOM_SUCCESS.
+ */
+static MatamazomResult submitOperation(MatamazomQueue queue,
+                                       Operation operation){
+    pthread_mutex_lock(&queue->lock);
+    if(queue->last_operation){
+        queue->last_operation->next=operation;
+    } else{
+        queue->first_operation=operation;
+    }
+    queue->last_operation=operation;
+    queue->pending++;
+    pthread_cond_signal(&queue->submitted);
+    pthread_mutex_unlock(&queue->lock);
+    return MATAMAZOM_SUCCESS;
+}
+
+/**
+ * compareAmountChanges: a compare function for qsort, that sorts changes by
+ *                       product id, and changes of the same product by their
+ *                       position.
+ *
+ * @param element1 - a pointer to the first change to be compared.
+ * @param element2 - a pointer to the second change to be compared.
+ *
+ * @return:
+ *      A negative number, zero or a positive number if the first change
+ *      should come before, is equal to or should come after the second one.
+ */
+static int compareAmountChanges(const void* element1, const void* element2){
+    const AmountChange* change1=element1;
+    const AmountChange* change2=element2;
+    if(change1->product_id != change2->product_id){
+        return change1->product_id < change2->product_id ? -1 : 1;
+    }
+    return change1->position - change2->position;
+}
+
+/**
+ * executeOperation: executes a single operation, and keeps its result.
+ *
+ * @param matamazom - The warehouse to execute the operation on.
+ * @param operation - The operation to execute.
+ */
+static void executeOperation(Matamazom matamazom, Operation operation){
+    switch(operation->type){
+        case OPERATION_NEW_PRODUCT:
+            operation->result=mtmNewProduct(matamazom,operation->id,
+                    operation->name,operation->amount,operation->amount_type,
+                    operation->custom_data,operation->copy_data,
+                    operation->free_data,operation->product_price);
+            break;
+        case OPERATION_CHANGE_AMOUNT:
+            operation->result=mtmChangeProductAmount(matamazom,operation->id,
+                    operation->amount);
+            break;
+        case OPERATION_CHANGE_AMOUNT_IN_ORDER:
+            operation->result=mtmChangeProductAmountInOrder(matamazom,
+                    operation->id,operation->product_id,operation->amount);
+            break;
+        case OPERATION_SHIP_ORDER:
+            operation->result=mtmShipOrder(matamazom,operation->id);
+            break;
+        case OPERATION_CANCEL_ORDER:
+            operation->result=mtmCancelOrder(matamazom,operation->id);
+            break;
+    }
+}
+
+/**
+ * endOfSummableRun: finds the run of changes that starts at a change, and can
+ *                   be applied as their sum. Such changes are whole, so they
+ *                   are valid for every amount type, and none of them goes the
+ *                   other way from the others. Every change of the run then
+ *                   passes through amounts between the amount before the run
+ *                   and the amount after it, so if their sum succeeds, every
+ *                   one of them succeeds on its own too.
+ *
+ * @param amounts - The amounts of the changes.
+ * @param first - The index of the first change of the run.
+ * @param n - The number of changes.
+ * @param sum - Set to the sum of the changes of the run.
+ *
+ * @return
+ *     The index after the last change of the run, which is first if the first
+ *     change is not whole.
+ */
+static int endOfSummableRun(const double* amounts, int first, int n,
+                            double* sum){
+    int direction=0;
+    int end=first;
+    *sum=0;
+    while(end<n && mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT,amounts[end])){
+        int change_direction=(amounts[end]>0)-(amounts[end]<0);
+        if(direction!=0 && change_direction==-direction){
+            break;
+        }
+        if(change_direction!=0){
+            direction=change_direction;
+        }
+        *sum=*sum+amounts[end];
+        end++;
+    }
+    return end;
+}
+
+/**
+ * applyChanges: applies changes one after the other, to the amount of a
+ *               product or of a product in an order.
+ *
+ * @param matamazom - The warehouse to apply the changes to.
+ * @param key - One of the operations of the changes, which tells what they
+ *     change.
+ * @param amounts - The amounts of the changes.
+ * @param n - The number of changes.
+ * @param results - Set to the result of every change.
+ */
+static void applyChanges(Matamazom matamazom, Operation key,
+                         const double* amounts, int n,
+                         MatamazomResult* results){
+    if(n==0){
+        return;
+    }
+    if(key->type == OPERATION_CHANGE_AMOUNT_IN_ORDER){
+        mtmChangeProductAmountInOrderBatch(matamazom,key->id,key->product_id,
+                amounts,n,results);
+    } else{
+        mtmChangeProductAmountBatch(matamazom,key->id,amounts,n,results);
+    }
+}
+
+/**
+ * coalesceChanges: applies changes one after the other, to the amount of a
+ *                  product or of a product in an order. Runs of changes that
+ *                  can be summed are applied as their sum when it succeeds,
+ *                  and the other changes are applied together in order.
+ *
+ * @param matamazom - The warehouse to apply the changes to.
+ * @param key - One of the operations of the changes, which tells what they
+ *     change.
+ * @param amounts - The amounts of the changes.
+ * @param n - The number of changes.
+ * @param results - Set to the result of every change.
+ */
+static void coalesceChanges(Matamazom matamazom, Operation key,
+                            const double* amounts, int n,
+                            MatamazomResult* results){
+    int first=0;
+    int run=0;
+    while(run<n){
+        double sum;
+        int end=endOfSummableRun(amounts,run,n,&sum);
+        if(end-run<2){
+            run=end>run ? end : run+1;
+            continue;
+        }
+        applyChanges(matamazom,key,amounts+first,run-first,results+first);
+        MatamazomResult result=key->type == OPERATION_CHANGE_AMOUNT_IN_ORDER ?
+                mtmChangeProductAmountInOrder(matamazom,key->id,
+                        key->product_id,sum) :
+                mtmChangeProductAmount(matamazom,key->id,sum);
+        if(result==MATAMAZOM_SUCCESS || result==MATAMAZOM_PRODUCT_NOT_EXIST ||
+                                        result==MATAMAZOM_ORDER_NOT_EXIST){
+            for(int i=run;i<end;i++){
+                results[i]=result;
+            }
+        } else{
+            // some of the changes fail, so each of them gets its own result
+            applyChanges(matamazom,key,amounts+run,end-run,results+run);
+        }
+        first=end;
+        run=end;
+    }
+    applyChanges(matamazom,key,amounts+first,n-first,results+first);
+}
+
+/**
+ * executeAmountChanges: executes a run of OPERATION_CHANGE_AMOUNT operations.
+ *                       Changes to different products do not affect each
+ *                       other, so the changes are grouped by product, and
+ *                       every group is coalesced and applied in order with a
+ *                       single lookup.
+ *
+ * @param matamazom - The warehouse to execute the operations on.
+ * @param operations - The operations of the run.
+ * @param n - The number of operations.
+ */
+static void executeAmountChanges(Matamazom matamazom, Operation* operations,
+                                 int n){
+    AmountChange* changes=malloc(sizeof(*changes)*n);
+    double* amounts=malloc(sizeof(*amounts)*n);
+    MatamazomResult* results=malloc(sizeof(*results)*n);
+    if(!changes || !amounts || !results){
+        for(int i=0;i<n;i++){
+            executeOperation(matamazom,operations[i]);
+        }
+        free(changes);
+        free(amounts);
+        free(results);
+        return;
+    }
+    for(int i=0;i<n;i++){
+        changes[i].product_id=operations[i]->id;
+        changes[i].position=i;
+    }
+    qsort(changes,n,sizeof(*changes),compareAmountChanges);
+    int first=0;
+    while(first<n){
+        int end=first;
+        while(end<n && changes[end].product_id==changes[first].product_id){
+            amounts[end-first]=operations[changes[end].position]->amount;
+            end++;
+        }
+        coalesceChanges(matamazom,operations[changes[first].position],amounts,
+                end-first,results);
+        for(int i=first;i<end;i++){
+            operations[changes[i].position]->result=results[i-first];
+        }
+        first=end;
+    }
+    free(changes);
+    free(amounts);
+    free(results);
+}
+
+/**
+ * isSameOrderLine: checks whether two operations change the same product in
+ *                  the same order.
+ *
+ * @param operation1 - The first operation.
+ * @param operation2 - The second operation.
+ *
+ * @return
+ *     true if both are OPERATION_CHANGE_AMOUNT_IN_ORDER operations of the same
+ *     order and product, false otherwise.
+ */
+static bool isSameOrderLine(Operation operation1, Operation operation2){
+    return operation1->type == OPERATION_CHANGE_AMOUNT_IN_ORDER &&
+           operation2->type == OPERATION_CHANGE_AMOUNT_IN_ORDER &&
+           operation1->id == operation2->id &&
+           operation1->product_id == operation2->product_id;
+}
+
+/**
+ * executeOrderLineChanges: executes a run of OPERATION_CHANGE_AMOUNT_IN_ORDER
+ *                          operations of the same product in the same order,
+ *                          coalesced, with a single lookup of the order and
+ *                          the product.
+ *                          Changes to different lines are not merged, since
+ *                          reservations of different orders affect each other.
+ *
+ * @param matamazom - The warehouse to execute the operations on.
+ * @param operations - The operations of the run.
+ * @param n - The number of operations.
+ */
+static void executeOrderLineChanges(Matamazom matamazom, Operation* operations,
+                                    int n){
+    double* amounts=malloc(sizeof(*amounts)*n);
+    MatamazomResult* results=malloc(sizeof(*results)*n);
+    if(!amounts || !results){
+        for(int i=0;i<n;i++){
+            executeOperation(matamazom,operations[i]);
+        }
+        free(amounts);
+        free(results);
+        return;
+    }
+    for(int i=0;i<n;i++){
+        amounts[i]=operations[i]->amount;
+    }
+    coalesceChanges(matamazom,operations[0],amounts,n,results);
+    for(int i=0;i<n;i++){
+        operations[i]->result=results[i];
+    }
+    free(amounts);
+    free(results);
+}
+
+/**
+ * executeBatch: executes all the operations of a batch, in order.
+ *
+ * @param matamazom - The warehouse to execute the operations on.
+ * @param operations - The operations of the batch, in submission order.
+ * @param n - The number of operations.
+ */
+static void executeBatch(Matamazom matamazom, Operation* operations, int n){
+    int first=0;
+    while(first<n){
+        int end=first+1;
+        if(operations[first]->type == OPERATION_CHANGE_AMOUNT){
+            while(end<n && operations[end]->type == OPERATION_CHANGE_AMOUNT){
+                end++;
+            }
+            executeAmountChanges(matamazom,operations+first,end-first);
+        } else if(operations[first]->type == OPERATION_CHANGE_AMOUNT_IN_ORDER){
+            while(end<n && isSameOrderLine(operations[first],operations[end])){
+                end++;
+            }
+            executeOrderLineChanges(matamazom,operations+first,end-first);
+        } else{
+            executeOperation(matamazom,operations[first]);
+        }
+        first=end;
+    }
+}
+
+/**
+ * executeOperations: executes a list of operations, passes their results to
+ *                    their completion functions and frees them.
+ *
+ * @param matamazom - The warehouse to execute the operations on.
+ * @param first_operation - The first operation of the list.
+ *
+ * @return
+ *     The number of operations that were executed.
+ */
+static int executeOperations(Matamazom matamazom, Operation first_operation){
+    int n=0;
+    for(Operation operation=first_operation;operation;
+                                            operation=operation->next){
+        n++;
+    }
+    Operation* operations=malloc(sizeof(*operations)*n);
+    if(operations){
+        int index=0;
+        for(Operation operation=first_operation;operation;
+                                                operation=operation->next){
+            operations[index++]=operation;
+        }
+        executeBatch(matamazom,operations,n);
+        free(operations);
+    } else{
+        for(Operation operation=first_operation;operation;
+                                                operation=operation->next){
+            executeOperation(matamazom,operation);
+        }
+    }
+    Operation operation=first_operation;
+    while(operation){
+        Operation next=operation->next;
+        if(operation->completion){
+            operation->completion(operation->result,operation->user_data);
+        }
+        freeOperation(operation);
+        operation=next;
+    }
+    return n;
+}
+
+/**
+ * runWarehouseThread: executes the operations of a queue in batches, until the
+ *                     queue is destroyed. A thread routine for pthread_create.
+ *
+ * @param argument - The queue.
+ *
+ * @return
+ *     NULL.
+ */
+static void* runWarehouseThread(void* argument){
+    MatamazomQueue queue=argument;
+    pthread_mutex_lock(&queue->lock);
+    while(true){
+        while(!queue->first_operation && !queue->stopping){
+            pthread_cond_wait(&queue->submitted,&queue->lock);
+        }
+        if(!queue->first_operation){
+            break;
+        }
+        if(queue->window>0 && !queue->stopping){
+            // let more operations gather, so they are coalesced together
+            struct timespec window={queue->window/1000000,
+                                    (queue->window%1000000)*1000};
+            pthread_mutex_unlock(&queue->lock);
+            nanosleep(&window,NULL);
+            pthread_mutex_lock(&queue->lock);
+        }
+        // everything that waits is taken as one batch, and new operations
+        // wait for the next one
+        Operation batch=queue->first_operation;
+        queue->first_operation=NULL;
+        queue->last_operation=NULL;
+        pthread_mutex_unlock(&queue->lock);
+        int executed=executeOperations(queue->matamazom,batch);
+        pthread_mutex_lock(&queue->lock);
+        queue->pending=queue->pending-executed;
+        pthread_cond_broadcast(&queue->completed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+MatamazomQueue mtmQueueCreate(Matamazom matamazom){
+    return mtmQueueCreateWithWindow(matamazom,0);
+}
+
+MatamazomQueue mtmQueueCreateWithWindow(Matamazom matamazom,
+                                        const unsigned int windowMicroseconds){
+    if(!matamazom){
+        return NULL;
+    }
+    MatamazomQueue queue=malloc(sizeof(*queue));
+    if(!queue){
+        return NULL;
+    }
+    queue->matamazom=matamazom;
+    queue->window=windowMicroseconds;
+    queue->first_operation=NULL;
+    queue->last_operation=NULL;
+    queue->pending=0;
+    queue->stopping=false;
+    if(pthread_mutex_init(&queue->lock,NULL) != 0){
+        free(queue);
+        return NULL;
+    }
+    if(pthread_cond_init(&queue->submitted,NULL) != 0){
+        pthread_mutex_destroy(&queue->lock);
+        free(queue);
+        return NULL;
+    }
+    if(pthread_cond_init(&queue->completed,NULL) != 0){
+        pthread_cond_destroy(&queue->submitted);
+        pthread_mutex_destroy(&queue->lock);
+        free(queue);
+        return NULL;
+    }
+    if(pthread_create(&queue->warehouse_thread,NULL,runWarehouseThread,
+                                                                queue) != 0){
+        pthread_cond_destroy(&queue->completed);
+        pthread_cond_destroy(&queue->submitted);
+        pthread_mutex_destroy(&queue->lock);
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+void mtmQueueDestroy(MatamazomQueue queue){
+    if(!queue){
+        return;
+    }
+    pthread_mutex_lock(&queue->lock);
+    queue->stopping=true;
+    pthread_cond_signal(&queue->submitted);
+    pthread_mutex_unlock(&queue->lock);
+    pthread_join(queue->warehouse_thread,NULL);
+    pthread_cond_destroy(&queue->completed);
+    pthread_cond_destroy(&queue->submitted);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+}
+
+void mtmQueueWait(MatamazomQueue queue){
+    if(!queue){
+        return;
+    }
+    pthread_mutex_lock(&queue->lock);
+    while(queue->pending>0){
+        pthread_cond_wait(&queue->completed,&queue->lock);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+MatamazomResult mtmSubmitNewProduct(MatamazomQueue queue, const unsigned int id,
+                                    const char *name, const double amount,
+                                    const MatamazomAmountType amountType,
+                                    const MtmProductData customData,
+                                    MtmCopyData copyData, MtmFreeData freeData,
+                                    MtmGetProductPrice prodPrice,
+                                    MtmCompletion completion, void *userData){
+    if(!queue || !name || !customData || !copyData || !freeData || !prodPrice){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    Operation operation=createOperation(OPERATION_NEW_PRODUCT,completion,
+            userData);
+    if(!operation){
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    operation->id=id;
+    operation->amount=amount;
+    operation->amount_type=amountType;
+    operation->copy_data=copyData;
+    operation->free_data=freeData;
+    operation->product_price=prodPrice;
+    operation->name=malloc(strlen(name)+1);
+    operation->custom_data=copyData(customData);
+    if(!operation->name || !operation->custom_data){
+        freeOperation(operation);
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    strcpy(operation->name,name);
+    return submitOperation(queue,operation);
+}
+
+MatamazomResult mtmSubmitChangeProductAmount(MatamazomQueue queue,
+                                             const unsigned int id,
+                                             const double amount,
+                                             MtmCompletion completion,
+                                             void *userData){
+    if(!queue){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    Operation operation=createOperation(OPERATION_CHANGE_AMOUNT,completion,
+            userData);
+    if(!operation){
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    operation->id=id;
+    operation->amount=amount;
+    return submitOperation(queue,operation);
+}
+
+MatamazomResult mtmSubmitChangeProductAmountInOrder(MatamazomQueue queue,
+                                                    const unsigned int orderId,
+                                                    const unsigned int productId,
+                                                    const double amount,
+                                                    MtmCompletion completion,
+                                                    void *userData){
+    if(!queue){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    Operation operation=createOperation(OPERATION_CHANGE_AMOUNT_IN_ORDER,
+            completion,userData);
+    if(!operation){
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    operation->id=orderId;
+    operation->product_id=productId;
+    operation->amount=amount;
+    return submitOperation(queue,operation);
+}
+
+MatamazomResult mtmSubmitShipOrder(MatamazomQueue queue, const unsigned int orderId,
+                                   MtmCompletion completion, void *userData){
+    if(!queue){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    Operation operation=createOperation(OPERATION_SHIP_ORDER,completion,
+            userData);
+    if(!operation){
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    operation->id=orderId;
+    return submitOperation(queue,operation);
+}
+
+MatamazomResult mtmSubmitCancelOrder(MatamazomQueue queue, const unsigned int orderId,
+                                     MtmCompletion completion, void *userData){
+    if(!queue){
+        return MATAMAZOM_NULL_ARGUMENT;
+    }
+    Operation operation=createOperation(OPERATION_CANCEL_ORDER,completion,
+            userData);
+    if(!operation){
+        return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    operation->id=orderId;
+    return submitOperation(queue,operation);
+}
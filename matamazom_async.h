@@ -0,0 +1,213 @@
+#ifndef MATAMAZOM_ASYNC_H_
+#define MATAMAZOM_ASYNC_H_
+
+#include <stdbool.h>
+#include "matamazom.h"
+
+/**
+ * Matamazom Queue
+ *
+ * Implements a submission queue in front of a Matamazom warehouse.
+ *
+ * Operations are submitted to the queue without waiting for them, and are
+ * executed in the order they were submitted by a warehouse thread that the
+ * queue owns. When an operation is done, its result is passed to a completion
+ * function given on submission, which is called from the warehouse thread.
+ *
+ * The warehouse thread is the only writer the queue uses, and it executes all
+ * the operations that wait in the queue together: changes to the amount of the
+ * same product that were submitted one after the other (possibly mixed with
+ * changes to other products) are applied with a single lookup of the product,
+ * and consecutive changes to the same product in the same order are applied
+ * with a single lookup of the order and the product. Such changes are
+ * coalesced, and written to the warehouse once, but every one of them still
+ * gets the result it would have gotten on its own. Runs of whole changes that
+ * all add or all remove are applied as a single change of their sum, since
+ * when the sum succeeds, so does every one of them; otherwise each change of
+ * the run is applied on its own. A queue may be given a
+ * window, for which the warehouse thread waits after an operation is submitted
+ * so more operations are coalesced with it.
+ *
+ * The queue calls the functions of the warehouse from its own thread, so if
+ * the warehouse is used by other threads too, it must be created in
+ * MATAMAZOM_CONCURRENT mode.
+ *
+ * The following functions are available:
+ *   mtmQueueCreate                  - Creates a queue for a warehouse.
+ *   mtmQueueCreateWithWindow        - Creates a queue for a warehouse, that
+ *                                     waits for operations to gather.
+ *   mtmQueueDestroy                 - Executes the waiting operations and
+ *                                     deletes the queue.
+ *   mtmQueueWait                    - Waits until all the submitted operations
+ *                                     are done.
+ *   mtmSubmitNewProduct             - Submits a mtmNewProduct operation.
+ *   mtmSubmitChangeProductAmount    - Submits a mtmChangeProductAmount
+ *                                     operation.
+ *   mtmSubmitChangeProductAmountInOrder - Submits a
+ *                                     mtmChangeProductAmountInOrder operation.
+ *   mtmSubmitShipOrder              - Submits a mtmShipOrder operation.
+ *   mtmSubmitCancelOrder            - Submits a mtmCancelOrder operation.
+ */
+
+/** Type for representing a submission queue of a Matamazom warehouse */
+typedef struct MatamazomQueue_t *MatamazomQueue;
+
+/**
+ * Type of function for receiving the result of a submitted operation.
+ *
+ * Such a function is called from the warehouse thread once the operation is
+ * done. It receives the result the matching mtm* function returned, and the
+ * user data given on submission. It may submit more operations, but must not
+ * call mtmQueueWait or mtmQueueDestroy.
+ */
+typedef void (*MtmCompletion)(MatamazomResult result, void *userData);
+
+/**
+ * mtmQueueCreate: create a submission queue for a Matamazom warehouse, and
+ * start its warehouse thread.
+ *
+ * @param matamazom - the warehouse the operations are executed on. It must
+ *     not be destroyed before the queue.
+ * @return
+ *     NULL - if matamazom is NULL, or allocations failed.
+ *     A new queue in case of success.
+ */
+MatamazomQueue mtmQueueCreate(Matamazom matamazom);
+
+/**
+ * mtmQueueCreateWithWindow: create a submission queue for a Matamazom
+ * warehouse, whose warehouse thread waits for a window of time after an
+ * operation is submitted, and then executes all the operations that were
+ * submitted meanwhile together.
+ *
+ * A longer window lets more changes be coalesced, and delays their results.
+ *
+ * @param matamazom - the warehouse the operations are executed on. It must
+ *     not be destroyed before the queue.
+ * @param windowMicroseconds - the time to wait for more operations, in
+ *     microseconds. If it is 0, the queue is the same as one created by
+ *     mtmQueueCreate.
+ * @return
+ *     NULL - if matamazom is NULL, or allocations failed.
+ *     A new queue in case of success.
+ */
+MatamazomQueue mtmQueueCreateWithWindow(Matamazom matamazom,
+                                        const unsigned int windowMicroseconds);
+
+/**
+ * mtmQueueDestroy: execute all the operations that wait in the queue, stop its
+ * warehouse thread and free all the resources of the queue. The warehouse
+ * itself is not destroyed.
+ *
+ * @param queue - the queue to destroy. If queue is NULL nothing is done.
+ */
+void mtmQueueDestroy(MatamazomQueue queue);
+
+/**
+ * mtmQueueWait: wait until all the operations that were submitted to the queue
+ * are done, and their completion functions returned.
+ *
+ * @param queue - the queue to wait for. If queue is NULL nothing is done.
+ */
+void mtmQueueWait(MatamazomQueue queue);
+
+/**
+ * mtmSubmitNewProduct: submit a mtmNewProduct operation.
+ *
+ * The name and custom data are copied on submission, so they may be freed as
+ * soon as this function returns.
+ *
+ * @param queue - the queue to submit to.
+ * @param id, name, amount, amountType, customData, copyData, freeData,
+ *     prodPrice - the arguments of mtmNewProduct.
+ * @param completion - a function that receives the result of the operation,
+ *     or NULL if it is not needed.
+ * @param userData - passed to the completion function.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed, other than
+ *         completion or userData.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if the operation was submitted.
+ */
+MatamazomResult mtmSubmitNewProduct(MatamazomQueue queue, const unsigned int id,
+                                    const char *name, const double amount,
+                                    const MatamazomAmountType amountType,
+                                    const MtmProductData customData,
+                                    MtmCopyData copyData, MtmFreeData freeData,
+                                    MtmGetProductPrice prodPrice,
+                                    MtmCompletion completion, void *userData);
+
+/**
+ * mtmSubmitChangeProductAmount: submit a mtmChangeProductAmount operation.
+ *
+ * @param queue - the queue to submit to.
+ * @param id, amount - the arguments of mtmChangeProductAmount.
+ * @param completion - a function that receives the result of the operation,
+ *     or NULL if it is not needed.
+ * @param userData - passed to the completion function.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if queue is NULL.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if the operation was submitted.
+ */
+MatamazomResult mtmSubmitChangeProductAmount(MatamazomQueue queue,
+                                             const unsigned int id,
+                                             const double amount,
+                                             MtmCompletion completion,
+                                             void *userData);
+
+/**
+ * mtmSubmitChangeProductAmountInOrder: submit a mtmChangeProductAmountInOrder
+ * operation.
+ *
+ * @param queue - the queue to submit to.
+ * @param orderId, productId, amount - the arguments of
+ *     mtmChangeProductAmountInOrder.
+ * @param completion - a function that receives the result of the operation,
+ *     or NULL if it is not needed.
+ * @param userData - passed to the completion function.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if queue is NULL.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if the operation was submitted.
+ */
+MatamazomResult mtmSubmitChangeProductAmountInOrder(MatamazomQueue queue,
+                                                    const unsigned int orderId,
+                                                    const unsigned int productId,
+                                                    const double amount,
+                                                    MtmCompletion completion,
+                                                    void *userData);
+
+/**
+ * mtmSubmitShipOrder: submit a mtmShipOrder operation.
+ *
+ * @param queue - the queue to submit to.
+ * @param orderId - the argument of mtmShipOrder.
+ * @param completion - a function that receives the result of the operation,
+ *     or NULL if it is not needed.
+ * @param userData - passed to the completion function.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if queue is NULL.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if the operation was submitted.
+ */
+MatamazomResult mtmSubmitShipOrder(MatamazomQueue queue, const unsigned int orderId,
+                                   MtmCompletion completion, void *userData);
+
+/**
+ * mtmSubmitCancelOrder: submit a mtmCancelOrder operation.
+ *
+ * @param queue - the queue to submit to.
+ * @param orderId - the argument of mtmCancelOrder.
+ * @param completion - a function that receives the result of the operation,
+ *     or NULL if it is not needed.
+ * @param userData - passed to the completion function.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if queue is NULL.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if the operation was submitted.
+ */
+MatamazomResult mtmSubmitCancelOrder(MatamazomQueue queue, const unsigned int orderId,
+                                     MtmCompletion completion, void *userData);
+
+#endif /* MATAMAZOM_ASYNC_H_ */
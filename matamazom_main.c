@@ -11,5 +11,29 @@ int main()
     RUN_TEST(testPrintOrder);
     RUN_TEST(testPrintBestSelling);
     RUN_TEST(testPrintFiltered);
+    RUN_TEST(testReserveStock);
+    RUN_TEST(testShipOrders);
+    RUN_TEST(testConcurrentAmountChanges);
+    RUN_TEST(testConcurrentStress);
+    RUN_TEST(testShardedStress);
+    RUN_TEST(testShardedReports);
+    RUN_TEST(testConcurrentCarts);
+    RUN_TEST(testReportSnapshots);
+    RUN_TEST(testPrintFilteredParallel);
+    RUN_TEST(testOrderTotals);
+    RUN_TEST(testAsyncQueue);
+    RUN_TEST(testCoalescingQueue);
+    RUN_TEST(testExactAmounts);
+    RUN_TEST(testAmountValidation);
+    RUN_TEST(testPriceCache);
+    RUN_TEST(testUnitPrices);
+    RUN_TEST(testPriceRules);
+    RUN_TEST(testBatchPrices);
+    RUN_TEST(testMaintainedOrderTotals);
+    RUN_TEST(testInlineData);
+    RUN_TEST(testVersions);
+    RUN_TEST(testChangeFeed);
+    RUN_TEST(testClearProductOrders);
+    RUN_TEST(testInventoryRange);
     return 0;
 }
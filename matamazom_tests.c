@@ -1,10 +1,15 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include "matamazom_tests.h"
 #include "matamazom.h"
+#include "matamazom_async.h"
+#include "amount_validation.h"
 #include "test_utilities.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 // remove the ../
 #define INVENTORY_OUT_FILE "../tests/printed_inventory.txt"
@@ -18,6 +23,11 @@
 #define FILTERED_OUT_FILE "../tests/printed_filtered.txt"
 #define FILTERED_TEST_FILE "../tests/expected_filtered.txt"
 
+#define STRESS_PRODUCTS 4
+#define STRESS_WRITERS 8
+#define STRESS_READERS 8
+#define STRESS_ITERATIONS 500
+
 #define ASSERT_OR_DESTROY(expr) ASSERT_TEST_WITH_FREE((expr), matamazomDestroy(mtm))
 
 bool testCreate() {
@@ -271,3 +281,1477 @@ bool testPrintFiltered() {
     matamazomDestroy(mtm);
     return true;
 }
+
+bool testReserveStock() {
+    Matamazom mtm = matamazomCreateWithMode(MATAMAZOM_RESERVE_STOCK);
+    ASSERT_TEST(mtm != NULL);
+    makeInventory(mtm);
+
+    unsigned int order1 = mtmCreateNewOrder(mtm);
+    unsigned int order2 = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmChangeProductAmountInOrder(mtm, order1, 11, 3.0));
+    ASSERT_OR_DESTROY(MATAMAZOM_INSUFFICIENT_AMOUNT ==
+                      mtmChangeProductAmountInOrder(mtm, order2, 11, 2.0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmChangeProductAmountInOrder(mtm, order2, 11, 1.0));
+    /* reserved stock cannot be taken out of the warehouse */
+    ASSERT_OR_DESTROY(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmChangeProductAmount(mtm, 11, -1.0));
+
+    /* decreasing an order releases its reservation */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmChangeProductAmountInOrder(mtm, order1, 11, -1.0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 11, -1.0));
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, order2));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order1));
+    ASSERT_OR_DESTROY(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmChangeProductAmount(mtm, 11, -2.0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 11, -1.0));
+
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static void makeOrdersToShip(Matamazom mtm, unsigned int *ids) {
+    makeInventory(mtm);
+    for (int i = 0; i < 4; ++i) {
+        ids[i] = mtmCreateNewOrder(mtm);
+    }
+    mtmChangeProductAmountInOrder(mtm, ids[0], 11, 3.0);
+    mtmChangeProductAmountInOrder(mtm, ids[0], 6, 10.25);
+    mtmChangeProductAmountInOrder(mtm, ids[1], 11, 2.0);
+    mtmChangeProductAmountInOrder(mtm, ids[1], 7, 1.5);
+    mtmChangeProductAmountInOrder(mtm, ids[2], 11, 1.0);
+    mtmChangeProductAmountInOrder(mtm, ids[2], 4, 19.11);
+    mtmChangeProductAmountInOrder(mtm, ids[3], 10, 2.0);
+}
+
+static bool streamsEqual(FILE *file1, FILE *file2) {
+    rewind(file1);
+    rewind(file2);
+    return fileEqual(file1, file2);
+}
+
+bool testShipOrders() {
+    Matamazom mtm = matamazomCreate();
+    Matamazom sequential = matamazomCreate();
+    unsigned int ids[4];
+    unsigned int sequentialIds[4];
+    makeOrdersToShip(mtm, ids);
+    makeOrdersToShip(sequential, sequentialIds);
+
+    unsigned int toShip[5] = {ids[3], ids[1], ids[0], ids[1], ids[0] + 100};
+    MatamazomResult results[5];
+    ASSERT_TEST_WITH_FREE(mtmShipOrders(mtm, toShip, 5, results) == MATAMAZOM_SUCCESS,
+                          (matamazomDestroy(mtm), matamazomDestroy(sequential)));
+    ASSERT_TEST_WITH_FREE(mtmShipOrders(NULL, toShip, 5, results) == MATAMAZOM_NULL_ARGUMENT,
+                          (matamazomDestroy(mtm), matamazomDestroy(sequential)));
+
+    MatamazomResult expected[5];
+    expected[2] = mtmShipOrder(sequential, sequentialIds[0]);
+    expected[1] = mtmShipOrder(sequential, sequentialIds[1]);
+    expected[3] = mtmShipOrder(sequential, sequentialIds[1]);
+    expected[0] = mtmShipOrder(sequential, sequentialIds[3]);
+    expected[4] = mtmShipOrder(sequential, sequentialIds[0] + 100);
+    ASSERT_TEST_WITH_FREE(expected[1] == MATAMAZOM_INSUFFICIENT_AMOUNT,
+                          (matamazomDestroy(mtm), matamazomDestroy(sequential)));
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_TEST_WITH_FREE(results[i] == expected[i],
+                              (matamazomDestroy(mtm), matamazomDestroy(sequential)));
+    }
+
+    FILE *batchOutput = tmpfile();
+    FILE *sequentialOutput = tmpfile();
+    assert(batchOutput);
+    assert(sequentialOutput);
+    mtmPrintInventory(mtm, batchOutput);
+    mtmPrintBestSelling(mtm, batchOutput);
+    mtmPrintOrder(mtm, ids[1], batchOutput);
+    mtmPrintInventory(sequential, sequentialOutput);
+    mtmPrintBestSelling(sequential, sequentialOutput);
+    mtmPrintOrder(sequential, sequentialIds[1], sequentialOutput);
+    bool equal = streamsEqual(batchOutput, sequentialOutput);
+    fclose(batchOutput);
+    fclose(sequentialOutput);
+    matamazomDestroy(sequential);
+    ASSERT_OR_DESTROY(equal);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+typedef struct stressArgs {
+    Matamazom mtm;
+    unsigned int productId;
+    bool ok;
+} StressArgs;
+
+static void *stressWriter(void *arg) {
+    StressArgs *args = arg;
+    for (int i = 0; i < STRESS_ITERATIONS; ++i) {
+        /* every iteration restocks one item and ships it again */
+        args->ok &= mtmChangeProductAmount(args->mtm, args->productId, 1.0) ==
+                    MATAMAZOM_SUCCESS;
+        unsigned int order = mtmCreateNewOrder(args->mtm);
+        args->ok &= order > 0;
+        args->ok &= mtmChangeProductAmountInOrder(args->mtm, order, args->productId,
+                                                  1.0) == MATAMAZOM_SUCCESS;
+        args->ok &= mtmShipOrder(args->mtm, order) == MATAMAZOM_SUCCESS;
+    }
+    return NULL;
+}
+
+static void *stressReader(void *arg) {
+    StressArgs *args = arg;
+    FILE *output = tmpfile();
+    if (!output) {
+        args->ok = false;
+        return NULL;
+    }
+    for (int i = 0; i < STRESS_ITERATIONS; ++i) {
+        rewind(output);
+        args->ok &= mtmPrintInventory(args->mtm, output) == MATAMAZOM_SUCCESS;
+        args->ok &= mtmPrintBestSelling(args->mtm, output) == MATAMAZOM_SUCCESS;
+        args->ok &= mtmPrintFiltered(args->mtm, isAmountLessThan10, output) ==
+                    MATAMAZOM_SUCCESS;
+    }
+    fclose(output);
+    return NULL;
+}
+
+static void *stressAmountChanger(void *arg) {
+    StressArgs *args = arg;
+    for (int i = 0; i < STRESS_ITERATIONS; ++i) {
+        /* the unit added is still there when it is taken back */
+        args->ok &= mtmChangeProductAmount(args->mtm, args->productId, 1.0) ==
+                    MATAMAZOM_SUCCESS;
+        args->ok &= mtmChangeProductAmount(args->mtm, args->productId, 0.5) ==
+                    MATAMAZOM_INVALID_AMOUNT;
+        args->ok &= mtmChangeProductAmount(args->mtm, args->productId, -1.0) ==
+                    MATAMAZOM_SUCCESS;
+    }
+    return NULL;
+}
+
+static void *stressCartEditor(void *arg) {
+    StressArgs *args = arg;
+    FILE *output = tmpfile();
+    if (!output) {
+        args->ok = false;
+        return NULL;
+    }
+    for (int i = 0; i < STRESS_ITERATIONS; ++i) {
+        /* every other cart ships a single item, the others are canceled */
+        unsigned int order = mtmCreateNewOrder(args->mtm);
+        args->ok &= order > 0;
+        args->ok &= mtmChangeProductAmountInOrder(args->mtm, order, args->productId,
+                                                  2.0) == MATAMAZOM_SUCCESS;
+        args->ok &= mtmChangeProductAmountInOrder(args->mtm, order, args->productId,
+                                                  -1.0) == MATAMAZOM_SUCCESS;
+        rewind(output);
+        args->ok &= mtmPrintOrder(args->mtm, order, output) == MATAMAZOM_SUCCESS;
+        if (i % 2 == 0) {
+            args->ok &= mtmShipOrder(args->mtm, order) == MATAMAZOM_SUCCESS;
+        } else {
+            args->ok &= mtmCancelOrder(args->mtm, order) == MATAMAZOM_SUCCESS;
+        }
+    }
+    fclose(output);
+    return NULL;
+}
+
+static void makeStressInventory(Matamazom mtm) {
+    double basePrice = 1.0;
+    for (unsigned int id = 1; id <= STRESS_PRODUCTS; ++id) {
+        mtmNewProduct(mtm, id, "Stress", 10, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                      copyDouble, freeDouble, simplePrice);
+    }
+}
+
+static bool runStress(const unsigned int mode) {
+    Matamazom mtm = matamazomCreateWithMode(mode);
+    ASSERT_TEST(mtm != NULL);
+    makeStressInventory(mtm);
+
+    pthread_t threads[STRESS_WRITERS + STRESS_READERS];
+    StressArgs args[STRESS_WRITERS + STRESS_READERS];
+    int started = 0;
+    for (int i = 0; i < STRESS_WRITERS + STRESS_READERS; ++i) {
+        args[i].mtm = mtm;
+        args[i].productId = i % STRESS_PRODUCTS + 1;
+        args[i].ok = true;
+        void *(*routine)(void *) = i < STRESS_WRITERS ? stressWriter : stressReader;
+        if (pthread_create(threads + i, NULL, routine, args + i) != 0) {
+            break;
+        }
+        started++;
+    }
+    /* every thread is joined before asserting, since they all use mtm */
+    bool ok = started == STRESS_WRITERS + STRESS_READERS;
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+        ok &= args[i].ok;
+    }
+    ASSERT_OR_DESTROY(ok);
+
+    /* all the restocked items were shipped, so the stock is back where it was */
+    Matamazom expected = matamazomCreate();
+    makeStressInventory(expected);
+    FILE *printed = tmpfile();
+    FILE *expectedOutput = tmpfile();
+    assert(printed);
+    assert(expectedOutput);
+    mtmPrintInventory(mtm, printed);
+    mtmPrintInventory(expected, expectedOutput);
+    bool equal = streamsEqual(printed, expectedOutput);
+    fclose(printed);
+    fclose(expectedOutput);
+    matamazomDestroy(expected);
+    ASSERT_OR_DESTROY(equal);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testConcurrentAmountChanges() {
+    Matamazom mtm = matamazomCreateWithMode(MATAMAZOM_CONCURRENT);
+    ASSERT_TEST(mtm != NULL);
+    makeStressInventory(mtm);
+    ASSERT_OR_DESTROY(mtmChangeProductAmount(mtm, 1, -10) == MATAMAZOM_SUCCESS);
+
+    pthread_t threads[STRESS_WRITERS];
+    StressArgs args[STRESS_WRITERS];
+    int started = 0;
+    for (int i = 0; i < STRESS_WRITERS; ++i) {
+        args[i].mtm = mtm;
+        args[i].productId = 1;
+        args[i].ok = true;
+        if (pthread_create(threads + i, NULL, stressAmountChanger, args + i) != 0) {
+            break;
+        }
+        started++;
+    }
+    bool ok = started == STRESS_WRITERS;
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+        ok &= args[i].ok;
+    }
+    ASSERT_OR_DESTROY(ok);
+    /* every change was applied exactly once, so the product is empty again */
+    ASSERT_OR_DESTROY(mtmChangeProductAmount(mtm, 1, -1) == MATAMAZOM_INSUFFICIENT_AMOUNT);
+    ASSERT_OR_DESTROY(mtmChangeProductAmount(mtm, 1, 0) == MATAMAZOM_SUCCESS);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testConcurrentStress() {
+    return runStress(MATAMAZOM_CONCURRENT);
+}
+
+bool testShardedStress() {
+    return runStress(MATAMAZOM_SHARDED);
+}
+
+bool testShardedReports() {
+    Matamazom mtm = matamazomCreateWithMode(MATAMAZOM_SHARDED);
+    ASSERT_TEST(mtm != NULL);
+    Matamazom expected = matamazomCreate();
+    double basePrice = 2.0;
+    /* enough products to have several in every shard, added out of order */
+    for (unsigned int i = 0; i < 64; ++i) {
+        unsigned int id = (i * 37) % 64 + 1;
+        ASSERT_OR_DESTROY(mtmNewProduct(mtm, id, "Sharded", id % 13, MATAMAZOM_ANY_AMOUNT,
+                                        &basePrice, copyDouble, freeDouble, simplePrice) ==
+                          MATAMAZOM_SUCCESS);
+        mtmNewProduct(expected, id, "Sharded", id % 13, MATAMAZOM_ANY_AMOUNT, &basePrice,
+                      copyDouble, freeDouble, simplePrice);
+    }
+    Matamazom both[] = {mtm, expected};
+    for (int i = 0; i < 2; ++i) {
+        unsigned int order = mtmCreateNewOrder(both[i]);
+        mtmChangeProductAmountInOrder(both[i], order, 12, 5);
+        mtmChangeProductAmountInOrder(both[i], order, 25, 1);
+        mtmChangeProductAmountInOrder(both[i], order, 51, 2);
+        ASSERT_OR_DESTROY(mtmShipOrder(both[i], order) == MATAMAZOM_SUCCESS);
+        ASSERT_OR_DESTROY(mtmClearProduct(both[i], 40) == MATAMAZOM_SUCCESS);
+    }
+
+    FILE *printed = tmpfile();
+    FILE *expectedOutput = tmpfile();
+    assert(printed);
+    assert(expectedOutput);
+    mtmPrintInventory(mtm, printed);
+    mtmPrintBestSelling(mtm, printed);
+    mtmPrintFiltered(mtm, isAmountLessThan10, printed);
+    mtmPrintInventory(expected, expectedOutput);
+    mtmPrintBestSelling(expected, expectedOutput);
+    mtmPrintFiltered(expected, isAmountLessThan10, expectedOutput);
+    bool equal = streamsEqual(printed, expectedOutput);
+    fclose(printed);
+    fclose(expectedOutput);
+    matamazomDestroy(expected);
+    ASSERT_OR_DESTROY(equal);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool runCartStress(const unsigned int mode) {
+    Matamazom mtm = matamazomCreateWithMode(mode);
+    ASSERT_TEST(mtm != NULL);
+    makeStressInventory(mtm);
+    const double restock = STRESS_WRITERS * STRESS_ITERATIONS;
+    for (unsigned int id = 1; id <= STRESS_PRODUCTS; ++id) {
+        mtmChangeProductAmount(mtm, id, restock);
+    }
+
+    pthread_t threads[STRESS_WRITERS];
+    StressArgs args[STRESS_WRITERS];
+    int started = 0;
+    for (int i = 0; i < STRESS_WRITERS; ++i) {
+        args[i].mtm = mtm;
+        args[i].productId = i % STRESS_PRODUCTS + 1;
+        args[i].ok = true;
+        if (pthread_create(threads + i, NULL, stressCartEditor, args + i) != 0) {
+            break;
+        }
+        started++;
+    }
+    bool ok = started == STRESS_WRITERS;
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+        ok &= args[i].ok;
+    }
+    ASSERT_OR_DESTROY(ok);
+
+    /* half of the carts of every thread shipped a single item */
+    Matamazom expected = matamazomCreate();
+    makeStressInventory(expected);
+    const double shipped = (STRESS_WRITERS / STRESS_PRODUCTS) * (STRESS_ITERATIONS / 2);
+    for (unsigned int id = 1; id <= STRESS_PRODUCTS; ++id) {
+        mtmChangeProductAmount(expected, id, restock - shipped);
+    }
+    FILE *printed = tmpfile();
+    FILE *expectedOutput = tmpfile();
+    assert(printed);
+    assert(expectedOutput);
+    mtmPrintInventory(mtm, printed);
+    mtmPrintInventory(expected, expectedOutput);
+    bool equal = streamsEqual(printed, expectedOutput);
+    fclose(printed);
+    fclose(expectedOutput);
+    matamazomDestroy(expected);
+    ASSERT_OR_DESTROY(equal);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testConcurrentCarts() {
+    return runCartStress(MATAMAZOM_CONCURRENT) &&
+           runCartStress(MATAMAZOM_SHARDED | MATAMAZOM_RESERVE_STOCK);
+}
+
+static Matamazom writtenDuringReport = NULL;
+
+static bool acceptAll(const unsigned int id, const char *name,
+                      const double amount, MtmProductData customData) {
+    return true;
+}
+
+static bool writeDuringReport(const unsigned int id, const char *name,
+                              const double amount, MtmProductData customData) {
+    /* the report reads a snapshot, so writers are not blocked by it */
+    if (id == 1) {
+        double basePrice = 1.0;
+        mtmNewProduct(writtenDuringReport, 100, "Late", 1, MATAMAZOM_INTEGER_AMOUNT,
+                      &basePrice, copyDouble, freeDouble, simplePrice);
+        mtmChangeProductAmount(writtenDuringReport, 2, 5);
+        mtmClearProduct(writtenDuringReport, 3);
+    }
+    return true;
+}
+
+bool testReportSnapshots() {
+    Matamazom mtm = matamazomCreateWithMode(MATAMAZOM_SHARDED);
+    ASSERT_TEST(mtm != NULL);
+    Matamazom expected = matamazomCreate();
+    makeStressInventory(mtm);
+    makeStressInventory(expected);
+    FILE *printed = tmpfile();
+    FILE *expectedOutput = tmpfile();
+    assert(printed);
+    assert(expectedOutput);
+
+    writtenDuringReport = mtm;
+    ASSERT_OR_DESTROY(mtmPrintFiltered(mtm, writeDuringReport, printed) == MATAMAZOM_SUCCESS);
+    mtmPrintFiltered(expected, acceptAll, expectedOutput);
+    bool unchanged = streamsEqual(printed, expectedOutput);
+
+    /* the next report sees everything that was written meanwhile */
+    double basePrice = 1.0;
+    mtmNewProduct(expected, 100, "Late", 1, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    mtmChangeProductAmount(expected, 2, 5);
+    mtmClearProduct(expected, 3);
+    rewind(printed);
+    rewind(expectedOutput);
+    mtmPrintInventory(mtm, printed);
+    mtmPrintInventory(expected, expectedOutput);
+    bool updated = streamsEqual(printed, expectedOutput);
+    fclose(printed);
+    fclose(expectedOutput);
+    matamazomDestroy(expected);
+    ASSERT_OR_DESTROY(unchanged);
+    ASSERT_OR_DESTROY(updated);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool filterSameAsSerial(const unsigned int mode, const bool threadSafe) {
+    Matamazom mtm = matamazomCreateWithMode(mode);
+    ASSERT_TEST(mtm != NULL);
+    double basePrice = 3.0;
+    /* enough products for every filter thread to have several chunks */
+    for (unsigned int id = 1000; id > 0; --id) {
+        mtmNewProduct(mtm, id * 7, "Filtered", id % 20, MATAMAZOM_INTEGER_AMOUNT,
+                      &basePrice, copyDouble, freeDouble, simplePrice);
+    }
+    FILE *parallel = tmpfile();
+    FILE *serial = tmpfile();
+    assert(parallel);
+    assert(serial);
+    ASSERT_OR_DESTROY(mtmPrintFilteredParallel(mtm, isAmountLessThan10, threadSafe,
+                                               parallel) == MATAMAZOM_SUCCESS);
+    mtmPrintFiltered(mtm, isAmountLessThan10, serial);
+    bool equal = streamsEqual(parallel, serial);
+    fclose(parallel);
+    fclose(serial);
+    ASSERT_OR_DESTROY(equal);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testPrintFilteredParallel() {
+    ASSERT_TEST(mtmPrintFilteredParallel(NULL, isAmountLessThan10, true, stdout) ==
+                MATAMAZOM_NULL_ARGUMENT);
+    return filterSameAsSerial(MATAMAZOM_DEFAULT_MODE, true) &&
+           filterSameAsSerial(MATAMAZOM_SHARDED, true) &&
+           filterSameAsSerial(MATAMAZOM_DEFAULT_MODE, false);
+}
+
+static void makeLargeOrders(Matamazom mtm, unsigned int *orders, int ordersNumber) {
+    double basePrice = 0.1;
+    for (unsigned int id = 1; id <= 1000; ++id) {
+        mtmNewProduct(mtm, id, "Line", 1000, MATAMAZOM_ANY_AMOUNT, &basePrice,
+                      copyDouble, freeDouble, simplePrice);
+    }
+    for (int i = 0; i < ordersNumber; ++i) {
+        orders[i] = mtmCreateNewOrder(mtm);
+        for (unsigned int id = i + 1; id <= 1000; id += i + 1) {
+            mtmChangeProductAmountInOrder(mtm, orders[i], id, 0.3 * id / (i + 1));
+        }
+    }
+}
+
+bool testOrderTotals() {
+    Matamazom mtm = matamazomCreateWithMode(MATAMAZOM_CONCURRENT);
+    ASSERT_TEST(mtm != NULL);
+    Matamazom serial = matamazomCreate();
+    unsigned int orders[3];
+    unsigned int serialOrders[3];
+    makeLargeOrders(mtm, orders, 3);
+    makeLargeOrders(serial, serialOrders, 3);
+
+    double total = 0;
+    double serialTotal = 0;
+    double linesSum = 0;
+    ASSERT_OR_DESTROY(mtmGetOrderTotal(NULL, orders[0], &total) == MATAMAZOM_NULL_ARGUMENT);
+    ASSERT_OR_DESTROY(mtmGetOrderTotal(mtm, orders[0], NULL) == MATAMAZOM_NULL_ARGUMENT);
+    ASSERT_OR_DESTROY(mtmGetOrderTotal(mtm, orders[2] + 1, &total) ==
+                      MATAMAZOM_ORDER_NOT_EXIST);
+    /* the same lines always add up to exactly the same total */
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_OR_DESTROY(mtmGetOrderTotal(mtm, orders[i], &total) == MATAMAZOM_SUCCESS);
+        mtmGetOrderTotal(serial, serialOrders[i], &serialTotal);
+        ASSERT_OR_DESTROY(total == serialTotal);
+        linesSum += total;
+    }
+    ASSERT_OR_DESTROY(mtmGetOpenOrdersTotal(mtm, &total) == MATAMAZOM_SUCCESS);
+    mtmGetOpenOrdersTotal(serial, &serialTotal);
+    ASSERT_OR_DESTROY(total == serialTotal);
+    ASSERT_OR_DESTROY(-0.001 < total - linesSum && total - linesSum < 0.001);
+    ASSERT_OR_DESTROY(mtmGetOpenOrdersTotal(mtm, NULL) == MATAMAZOM_NULL_ARGUMENT);
+    matamazomDestroy(serial);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static void keepResult(MatamazomResult result, void *userData) {
+    *(MatamazomResult *)userData = result;
+}
+
+bool testAsyncQueue() {
+    Matamazom mtm = matamazomCreateWithMode(MATAMAZOM_CONCURRENT);
+    ASSERT_TEST(mtm != NULL);
+    ASSERT_OR_DESTROY(mtmQueueCreate(NULL) == NULL);
+    MatamazomQueue queue = mtmQueueCreate(mtm);
+    ASSERT_OR_DESTROY(queue != NULL);
+    Matamazom sequential = matamazomCreate();
+    unsigned int order = mtmCreateNewOrder(mtm);
+    unsigned int sequentialOrder = mtmCreateNewOrder(sequential);
+
+    double basePrice = 2.0;
+    MatamazomResult results[10];
+    MatamazomResult expected[10];
+    mtmSubmitNewProduct(queue, 1, "Milk", 3, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                        copyDouble, freeDouble, simplePrice, keepResult, results + 0);
+    mtmSubmitNewProduct(queue, 2, "Flour", 1.5, MATAMAZOM_HALF_INTEGER_AMOUNT,
+                        &basePrice, copyDouble, freeDouble, simplePrice, keepResult,
+                        results + 1);
+    /* a run of changes to two products, in which some of the changes fail */
+    mtmSubmitChangeProductAmount(queue, 1, -2, keepResult, results + 2);
+    mtmSubmitChangeProductAmount(queue, 2, 0.5, keepResult, results + 3);
+    mtmSubmitChangeProductAmount(queue, 1, -2, keepResult, results + 4);
+    mtmSubmitChangeProductAmount(queue, 1, 0.5, keepResult, results + 5);
+    mtmSubmitChangeProductAmount(queue, 3, 1, keepResult, results + 6);
+    mtmSubmitChangeProductAmountInOrder(queue, order, 2, 2, keepResult, results + 7);
+    mtmSubmitShipOrder(queue, order, keepResult, results + 8);
+    mtmSubmitCancelOrder(queue, order, keepResult, results + 9);
+    ASSERT_OR_DESTROY(mtmSubmitShipOrder(NULL, order, NULL, NULL) ==
+                      MATAMAZOM_NULL_ARGUMENT);
+    mtmQueueWait(queue);
+
+    expected[0] = mtmNewProduct(sequential, 1, "Milk", 3, MATAMAZOM_INTEGER_AMOUNT,
+                                &basePrice, copyDouble, freeDouble, simplePrice);
+    expected[1] = mtmNewProduct(sequential, 2, "Flour", 1.5, MATAMAZOM_HALF_INTEGER_AMOUNT,
+                                &basePrice, copyDouble, freeDouble, simplePrice);
+    expected[2] = mtmChangeProductAmount(sequential, 1, -2);
+    expected[3] = mtmChangeProductAmount(sequential, 2, 0.5);
+    expected[4] = mtmChangeProductAmount(sequential, 1, -2);
+    expected[5] = mtmChangeProductAmount(sequential, 1, 0.5);
+    expected[6] = mtmChangeProductAmount(sequential, 3, 1);
+    expected[7] = mtmChangeProductAmountInOrder(sequential, sequentialOrder, 2, 2);
+    expected[8] = mtmShipOrder(sequential, sequentialOrder);
+    expected[9] = mtmCancelOrder(sequential, sequentialOrder);
+    bool sameResults = true;
+    for (int i = 0; i < 10; ++i) {
+        sameResults &= results[i] == expected[i];
+    }
+
+    FILE *printed = tmpfile();
+    FILE *expectedOutput = tmpfile();
+    assert(printed);
+    assert(expectedOutput);
+    mtmPrintInventory(mtm, printed);
+    mtmPrintBestSelling(mtm, printed);
+    mtmPrintInventory(sequential, expectedOutput);
+    mtmPrintBestSelling(sequential, expectedOutput);
+    bool equal = streamsEqual(printed, expectedOutput);
+    fclose(printed);
+    fclose(expectedOutput);
+    matamazomDestroy(sequential);
+    mtmQueueDestroy(queue);
+    ASSERT_OR_DESTROY(sameResults);
+    ASSERT_OR_DESTROY(equal);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+/* runs the same changes through a coalescing queue and directly */
+static void submitCartChanges(MatamazomQueue queue, Matamazom sequential,
+                              unsigned int order, MatamazomResult *results,
+                              int *n) {
+    const struct {
+        bool inOrder;
+        unsigned int id;
+        unsigned int productId;
+        double amount;
+    } changes[] = {
+        {true, 0, 1, 1}, {true, 0, 1, 1}, {true, 0, 1, 1}, {true, 0, 1, 1},
+        {true, 0, 1, 1}, {true, 0, 1, 1}, {true, 0, 1, 1}, {true, 0, 1, 1},
+        {true, 0, 1, 1}, {true, 0, 1, 1}, {true, 0, 1, 1}, {true, 0, 1, 1},
+        {true, 0, 1, 1}, {true, 0, 1, 1}, {true, 0, 1, 0.5}, {true, 0, 1, -20},
+        {true, 0, 1, 4}, {true, 0, 9, 1}, {true, 100, 1, 1},
+        {false, 2, 0, 0.5}, {false, 2, 0, 0.5}, {false, 2, 0, -10},
+        {false, 2, 0, -2}, {false, 1, 0, 2}, {false, 1, 0, 3},
+        {false, 1, 0, -10}, {false, 1, 0, -8}, {true, 0, 2, 1}, {true, 0, 2, 2},
+        {true, 0, 2, -1}, {true, 0, 2, -10},
+    };
+    *n = sizeof(changes) / sizeof(*changes);
+    for (int i = 0; i < *n; ++i) {
+        if (changes[i].inOrder) {
+            unsigned int orderId = order + changes[i].id;
+            if (queue) {
+                mtmSubmitChangeProductAmountInOrder(queue, orderId,
+                        changes[i].productId, changes[i].amount, keepResult,
+                        results + i);
+            } else {
+                results[i] = mtmChangeProductAmountInOrder(sequential, orderId,
+                        changes[i].productId, changes[i].amount);
+            }
+        } else if (queue) {
+            mtmSubmitChangeProductAmount(queue, changes[i].id, changes[i].amount,
+                                         keepResult, results + i);
+        } else {
+            results[i] = mtmChangeProductAmount(sequential, changes[i].id,
+                                                changes[i].amount);
+        }
+    }
+}
+
+bool testCoalescingQueue() {
+    Matamazom mtm = matamazomCreateWithMode(MATAMAZOM_CONCURRENT |
+                                            MATAMAZOM_RESERVE_STOCK);
+    ASSERT_TEST(mtm != NULL);
+    Matamazom sequential = matamazomCreateWithMode(MATAMAZOM_RESERVE_STOCK);
+    double basePrice = 2.0;
+    mtmNewProduct(mtm, 1, "Milk", 12, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    mtmNewProduct(mtm, 2, "Flour", 5, MATAMAZOM_HALF_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    mtmNewProduct(sequential, 1, "Milk", 12, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    mtmNewProduct(sequential, 2, "Flour", 5, MATAMAZOM_HALF_INTEGER_AMOUNT,
+                  &basePrice, copyDouble, freeDouble, simplePrice);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    unsigned int sequentialOrder = mtmCreateNewOrder(sequential);
+
+    /* the window lets all the changes gather into one coalesced batch */
+    MatamazomQueue queue = mtmQueueCreateWithWindow(mtm, 2000);
+    ASSERT_OR_DESTROY(queue != NULL);
+    MatamazomResult results[32];
+    MatamazomResult expected[32];
+    int n;
+    submitCartChanges(queue, NULL, order, results, &n);
+    mtmQueueWait(queue);
+    submitCartChanges(NULL, sequential, sequentialOrder, expected, &n);
+    bool sameResults = true;
+    for (int i = 0; i < n; ++i) {
+        sameResults &= results[i] == expected[i];
+    }
+
+    MatamazomResult batchResults[3];
+    double amounts[] = {1, -5, 1};
+    ASSERT_OR_DESTROY(mtmChangeProductAmountInOrderBatch(NULL, order, 1, amounts,
+                      3, batchResults) == MATAMAZOM_NULL_ARGUMENT);
+    ASSERT_OR_DESTROY(mtmChangeProductAmountInOrderBatch(mtm, order, 1, NULL,
+                      3, batchResults) == MATAMAZOM_NULL_ARGUMENT);
+
+    FILE *printed = tmpfile();
+    FILE *expectedOutput = tmpfile();
+    assert(printed);
+    assert(expectedOutput);
+    mtmPrintInventory(mtm, printed);
+    mtmPrintOrder(mtm, order, printed);
+    mtmPrintInventory(sequential, expectedOutput);
+    mtmPrintOrder(sequential, sequentialOrder, expectedOutput);
+    bool equal = streamsEqual(printed, expectedOutput);
+    fclose(printed);
+    fclose(expectedOutput);
+    matamazomDestroy(sequential);
+    mtmQueueDestroy(queue);
+    ASSERT_OR_DESTROY(sameResults);
+    ASSERT_OR_DESTROY(equal);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testExactAmounts() {
+    Matamazom mtm = matamazomCreate();
+    ASSERT_TEST(mtm != NULL);
+    double basePrice = 0.1;
+    ASSERT_OR_DESTROY(mtmNewProduct(mtm, 1, "Salt", 0, MATAMAZOM_ANY_AMOUNT,
+                                    &basePrice, copyDouble, freeDouble,
+                                    simplePrice) == MATAMAZOM_SUCCESS);
+    ASSERT_OR_DESTROY(mtmNewProduct(mtm, 2, "Huge", 1e13, MATAMAZOM_ANY_AMOUNT,
+                                    &basePrice, copyDouble, freeDouble,
+                                    simplePrice) == MATAMAZOM_INVALID_AMOUNT);
+    /* ten tenths are exactly one unit, which a double sum is not */
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_OR_DESTROY(mtmChangeProductAmount(mtm, 1, 0.1) == MATAMAZOM_SUCCESS);
+    }
+    ASSERT_OR_DESTROY(mtmChangeProductAmount(mtm, 1, 1e13) ==
+                      MATAMAZOM_INVALID_AMOUNT);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(mtmChangeProductAmountInOrder(mtm, order, 1, 1) ==
+                      MATAMAZOM_SUCCESS);
+    ASSERT_OR_DESTROY(mtmShipOrder(mtm, order) == MATAMAZOM_SUCCESS);
+    ASSERT_OR_DESTROY(mtmChangeProductAmount(mtm, 1, -0.1) ==
+                      MATAMAZOM_INSUFFICIENT_AMOUNT);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+/* the validation mtmIsAmountValid replaced, for comparing the two within the
+ * range of int the old one supported */
+static bool legacyIsAmountValid(MatamazomAmountType amountType, double amount) {
+    if (amountType == MATAMAZOM_ANY_AMOUNT) {
+        return true;
+    }
+    int completeValue = amount >= 0 ? (int)amount : (int)amount - 1;
+    double below = amount - completeValue;
+    double above = (completeValue + 1) - amount;
+    if ((below < 0 ? -below : below) <= 0.001 ||
+        (above < 0 ? -above : above) <= 0.001) {
+        return true;
+    }
+    double half = ((double)completeValue + 0.5) - amount;
+    return amountType == MATAMAZOM_HALF_INTEGER_AMOUNT &&
+           (half < 0 ? -half : half) <= 0.001;
+}
+
+static bool sameValidation(double amount) {
+    for (MatamazomAmountType type = MATAMAZOM_INTEGER_AMOUNT;
+         type <= MATAMAZOM_ANY_AMOUNT; ++type) {
+        if (mtmIsAmountValid(type, amount) != legacyIsAmountValid(type, amount)) {
+            printf("\nvalidation of %.17g differs for type %d ", amount, type);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool testAmountValidation() {
+    /* around every step of small amounts, and exactly on the tolerance */
+    const double offsets[] = {0, 0.0001, 0.000999999999, 0.001, 0.0010000000001,
+                              0.0011, 0.25, 0.4989999999999999, 0.499, 0.5};
+    for (int whole = -1000; whole <= 1000; ++whole) {
+        for (int i = 0; i < (int)(sizeof(offsets) / sizeof(*offsets)); ++i) {
+            ASSERT_TEST(sameValidation(whole + offsets[i]));
+            ASSERT_TEST(sameValidation(whole - offsets[i]));
+            ASSERT_TEST(sameValidation(whole + 0.5 + offsets[i]));
+        }
+    }
+    for (int i = -100000; i <= 100000; ++i) {
+        ASSERT_TEST(sameValidation(i / 10000.0));
+    }
+    srand(39);
+    for (int i = 0; i < 100000; ++i) {
+        double amount = ((double)rand() / RAND_MAX - 0.5) * 4e9;
+        ASSERT_TEST(sameValidation(amount));
+        ASSERT_TEST(sameValidation((double)(long long)amount + 0.5));
+    }
+
+    /* odd whole numbers and halves from 2^50 to 2^53, where doubles are
+     * 1/4 to 2 apart */
+    for (int power = 50; power < 53; ++power) {
+        long long first = 1LL << power;
+        long long stride = (first / 20000) * 2;
+        for (long long whole = first + 1; whole < 2 * first; whole += stride) {
+            for (int sign = -1; sign <= 1; sign += 2) {
+                double amount = (double)(sign * whole);
+                ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, amount));
+                ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_HALF_INTEGER_AMOUNT, amount));
+                ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_ANY_AMOUNT, amount));
+                if (power < 52) {
+                    double half = amount + sign * 0.5;
+                    ASSERT_TEST(!mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, half));
+                    ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_HALF_INTEGER_AMOUNT, half));
+                    ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_ANY_AMOUNT, half));
+                }
+            }
+        }
+    }
+    ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, 2251799813685249.0));
+    ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, 3000000000000001.0));
+    ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_HALF_INTEGER_AMOUNT, 1125899906842624.5));
+    ASSERT_TEST(!mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, 1125899906842624.5));
+
+    /* beyond the range of int */
+    double zero = 0;
+    ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, 1e10 + 0.0005));
+    ASSERT_TEST(!mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, 1e10 + 0.5));
+    ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_HALF_INTEGER_AMOUNT, 1e10 + 0.5));
+    ASSERT_TEST(!mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, 3e15 + 0.5));
+    ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, -1e300));
+    ASSERT_TEST(!mtmIsAmountValid(MATAMAZOM_INTEGER_AMOUNT, zero / zero));
+    ASSERT_TEST(mtmIsAmountValid(MATAMAZOM_ANY_AMOUNT, zero / zero));
+
+    double amounts[] = {1, 1.5, 2.0009, -2.4, 1e10 + 0.5, -0.001, 7.25};
+    int n = sizeof(amounts) / sizeof(*amounts);
+    bool valid[sizeof(amounts) / sizeof(*amounts)];
+    for (MatamazomAmountType type = MATAMAZOM_INTEGER_AMOUNT;
+         type <= MATAMAZOM_ANY_AMOUNT; ++type) {
+        mtmValidateAmounts(type, amounts, n, valid);
+        for (int i = 0; i < n; ++i) {
+            ASSERT_TEST(valid[i] == mtmIsAmountValid(type, amounts[i]));
+        }
+    }
+    return true;
+}
+
+static int pricesComputed = 0;
+
+/* a simple price that counts its calls */
+static double countedPrice(MtmProductData basePrice, const double amount) {
+    __atomic_add_fetch(&pricesComputed, 1, __ATOMIC_RELAXED);
+    return simplePrice(basePrice, amount);
+}
+
+static Matamazom invalidatedDuringReport = NULL;
+static double reportPriceFactor = 1;
+
+/* a price that invalidates the prices of its product once, after it read the
+ * old factor, as if mtmInvalidatePrices ran while a report priced it */
+static double invalidatingPrice(MtmProductData basePrice, const double amount) {
+    double price = simplePrice(basePrice, amount) * reportPriceFactor;
+    if (invalidatedDuringReport) {
+        Matamazom mtm = invalidatedDuringReport;
+        invalidatedDuringReport = NULL;
+        reportPriceFactor = 2;
+        mtmInvalidatePrices(mtm, 1);
+    }
+    return price;
+}
+
+static bool invalidateDuringReport(const unsigned int mode) {
+    Matamazom mtm = matamazomCreateWithMode(mode);
+    double basePrice = 2.5;
+    reportPriceFactor = 1;
+    mtmNewProductWithFlags(mtm, 1, "Cached", 10, MATAMAZOM_INTEGER_AMOUNT,
+                           &basePrice, copyDouble, freeDouble,
+                           invalidatingPrice, MTM_PRICE_CACHEABLE);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order, 1, 3);
+    /* the price of the line is forgotten, so the report computes it again */
+    mtmInvalidatePrices(mtm, 1);
+    FILE *output = tmpfile();
+    assert(output);
+    invalidatedDuringReport = mtm;
+    bool printed = mtmPrintOrder(mtm, order, output) == MATAMAZOM_SUCCESS;
+    fclose(output);
+    /* the price computed before the invalidation is not kept in the cache */
+    double total = 0;
+    mtmGetOrderTotal(mtm, order, &total);
+    matamazomDestroy(mtm);
+    return printed && total == 15;
+}
+
+bool testPriceCache() {
+    Matamazom mtm = matamazomCreateWithMode(MATAMAZOM_CONCURRENT);
+    ASSERT_TEST(mtm != NULL);
+    double basePrice = 2.5;
+    ASSERT_OR_DESTROY(mtmNewProductWithFlags(NULL, 1, "Cached", 10,
+                      MATAMAZOM_INTEGER_AMOUNT, &basePrice, copyDouble, freeDouble,
+                      countedPrice, MTM_PRICE_CACHEABLE) == MATAMAZOM_NULL_ARGUMENT);
+    ASSERT_OR_DESTROY(mtmNewProductWithFlags(mtm, 1, "Cached", 10,
+                      MATAMAZOM_INTEGER_AMOUNT, &basePrice, copyDouble, freeDouble,
+                      countedPrice, MTM_PRICE_CACHEABLE) == MATAMAZOM_SUCCESS);
+    ASSERT_OR_DESTROY(mtmNewProductWithFlags(mtm, 2, "Plain", 10,
+                      MATAMAZOM_INTEGER_AMOUNT, &basePrice, copyDouble, freeDouble,
+                      countedPrice, MTM_PRICE_DEFAULT) == MATAMAZOM_SUCCESS);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order, 1, 3);
+    mtmChangeProductAmountInOrder(mtm, order, 2, 3);
+
+    FILE *first = tmpfile();
+    FILE *second = tmpfile();
+    assert(first);
+    assert(second);
+    pricesComputed = 0;
+    mtmPrintInventory(mtm, first);
+    mtmPrintOrder(mtm, order, first);
+    int firstComputed = pricesComputed;
+    mtmPrintInventory(mtm, second);
+    mtmPrintOrder(mtm, order, second);
+    /* the total is kept in the order, and only the line of the product that
+     * is not cacheable is priced again */
+    int secondComputed = pricesComputed - firstComputed;
+    bool equal = streamsEqual(first, second);
+    fclose(first);
+    fclose(second);
+    ASSERT_OR_DESTROY(firstComputed == 1);
+    ASSERT_OR_DESTROY(secondComputed == 1);
+    ASSERT_OR_DESTROY(equal);
+
+    /* the order shares the cache of the warehouse product, the unit price is
+     * computed again, and so is the total of the order */
+    ASSERT_OR_DESTROY(mtmInvalidatePrices(mtm, 1) == MATAMAZOM_SUCCESS);
+    double total;
+    mtmGetOrderTotal(mtm, order, &total);
+    ASSERT_OR_DESTROY(pricesComputed - firstComputed - secondComputed == 3);
+    ASSERT_OR_DESTROY(total == 15);
+    ASSERT_OR_DESTROY(mtmInvalidatePrices(mtm, 3) == MATAMAZOM_PRODUCT_NOT_EXIST);
+    ASSERT_OR_DESTROY(mtmInvalidatePrices(NULL, 1) == MATAMAZOM_NULL_ARGUMENT);
+    ASSERT_OR_DESTROY(mtmShipOrder(mtm, order) == MATAMAZOM_SUCCESS);
+    matamazomDestroy(mtm);
+    ASSERT_TEST(invalidateDuringReport(MATAMAZOM_DEFAULT_MODE));
+    ASSERT_TEST(invalidateDuringReport(MATAMAZOM_CONCURRENT));
+    return true;
+}
+
+static double priceFactor = 1;
+
+/* a price that depends on data outside the product */
+static double factoredPrice(MtmProductData basePrice, const double amount) {
+    return simplePrice(basePrice, amount) * priceFactor;
+}
+
+bool testUnitPrices() {
+    Matamazom mtm = matamazomCreate();
+    ASSERT_TEST(mtm != NULL);
+    double basePrice = 4;
+    priceFactor = 1;
+    mtmNewProduct(mtm, 1, "Bread", 5, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, factoredPrice);
+    FILE *after = tmpfile();
+    FILE *refreshed = tmpfile();
+    assert(after && refreshed);
+    /* the unit price is kept until the prices are invalidated */
+    priceFactor = 2;
+    mtmPrintInventory(mtm, after);
+    mtmPrintFiltered(mtm, acceptAll, after);
+    ASSERT_OR_DESTROY(mtmInvalidatePrices(mtm, 1) == MATAMAZOM_SUCCESS);
+    mtmPrintInventory(mtm, refreshed);
+    mtmPrintFiltered(mtm, acceptAll, refreshed);
+    priceFactor = 1;
+    char line[128];
+    rewind(after);
+    bool keptPrice = fgets(line, sizeof(line), after) &&
+                     fgets(line, sizeof(line), after) &&
+                     strstr(line, "price: 4.000") != NULL;
+    rewind(refreshed);
+    bool newPrice = fgets(line, sizeof(line), refreshed) &&
+                    fgets(line, sizeof(line), refreshed) &&
+                    strstr(line, "price: 8.000") != NULL;
+    fclose(after);
+    fclose(refreshed);
+    ASSERT_OR_DESTROY(keptPrice);
+    ASSERT_OR_DESTROY(newPrice);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static double tieredPrice(MtmProductData basePrice, const double amount) {
+    (void)basePrice;
+    return amount < 10 ? 3 * amount : 30 + 2 * (amount - 10);
+}
+
+bool testPriceRules() {
+    Matamazom byRule = matamazomCreate();
+    Matamazom byFunction = matamazomCreate();
+    ASSERT_TEST(byRule != NULL && byFunction != NULL);
+    double basePrice = 8.9;
+    MtmPriceRule linear = {.type = MTM_PRICE_RULE_LINEAR, .unitPrice = 8.9};
+    MtmPriceRule buyGetFree = {.type = MTM_PRICE_RULE_BUY_GET_FREE,
+                               .unitPrice = 8.9, .paidAmount = 10,
+                               .freeAmount = 10};
+    MtmPriceRule tiered = {.type = MTM_PRICE_RULE_TIERED, .tiersNumber = 2,
+                           .tierStarts = {0, 10}, .tierUnitPrices = {3, 2}};
+    MtmPriceRule invalid = tiered;
+    invalid.tierStarts[1] = 0;
+    bool added =
+        mtmNewProductWithRule(byRule, 1, "Tomato", 100, MATAMAZOM_ANY_AMOUNT,
+                              &basePrice, copyDouble, freeDouble,
+                              &linear) == MATAMAZOM_SUCCESS &&
+        mtmNewProductWithRule(byRule, 2, "Onion", 100, MATAMAZOM_ANY_AMOUNT,
+                              &basePrice, copyDouble, freeDouble,
+                              &buyGetFree) == MATAMAZOM_SUCCESS &&
+        mtmNewProductWithRule(byRule, 3, "Rice", 100, MATAMAZOM_ANY_AMOUNT,
+                              &basePrice, copyDouble, freeDouble,
+                              &tiered) == MATAMAZOM_SUCCESS &&
+        mtmNewProductWithRule(byRule, 4, "Flour", 100, MATAMAZOM_ANY_AMOUNT,
+                              &basePrice, copyDouble, freeDouble,
+                              &invalid) == MATAMAZOM_INVALID_AMOUNT &&
+        mtmNewProductWithRule(byRule, 4, "Flour", 100, MATAMAZOM_ANY_AMOUNT,
+                              &basePrice, copyDouble, freeDouble,
+                              NULL) == MATAMAZOM_NULL_ARGUMENT &&
+        mtmNewProduct(byFunction, 1, "Tomato", 100, MATAMAZOM_ANY_AMOUNT,
+                      &basePrice, copyDouble, freeDouble,
+                      simplePrice) == MATAMAZOM_SUCCESS &&
+        mtmNewProduct(byFunction, 2, "Onion", 100, MATAMAZOM_ANY_AMOUNT,
+                      &basePrice, copyDouble, freeDouble,
+                      buy10Get10ForFree) == MATAMAZOM_SUCCESS &&
+        mtmNewProduct(byFunction, 3, "Rice", 100, MATAMAZOM_ANY_AMOUNT,
+                      &basePrice, copyDouble, freeDouble,
+                      tieredPrice) == MATAMAZOM_SUCCESS;
+    FILE *ruleOutput = tmpfile();
+    FILE *functionOutput = tmpfile();
+    assert(ruleOutput && functionOutput);
+    /* every rule prices the same as the function it replaces */
+    const double amounts[] = {0.5, 9.75, 10, 15, 20, 25.5};
+    for (int i = 0; added && i < (int)(sizeof(amounts) / sizeof(*amounts)); ++i) {
+        unsigned int ruleOrder = mtmCreateNewOrder(byRule);
+        unsigned int functionOrder = mtmCreateNewOrder(byFunction);
+        for (unsigned int id = 1; id <= 3; ++id) {
+            mtmChangeProductAmountInOrder(byRule, ruleOrder, id, amounts[i]);
+            mtmChangeProductAmountInOrder(byFunction, functionOrder, id,
+                                          amounts[i]);
+        }
+        mtmPrintOrder(byRule, ruleOrder, ruleOutput);
+        mtmPrintOrder(byFunction, functionOrder, functionOutput);
+        mtmShipOrder(byRule, ruleOrder);
+        mtmShipOrder(byFunction, functionOrder);
+    }
+    mtmPrintInventory(byRule, ruleOutput);
+    mtmPrintInventory(byFunction, functionOutput);
+    mtmPrintBestSelling(byRule, ruleOutput);
+    mtmPrintBestSelling(byFunction, functionOutput);
+    bool samePrices = streamsEqual(ruleOutput, functionOutput);
+    fclose(ruleOutput);
+    fclose(functionOutput);
+    matamazomDestroy(byFunction);
+    matamazomDestroy(byRule);
+    ASSERT_TEST(added);
+    ASSERT_TEST(samePrices);
+    return true;
+}
+
+static int largestPriceBatch = 0;
+
+static void batchPrices(const MtmProductData *basePrices, const double *amounts,
+                        int n, double *prices) {
+    if (n > largestPriceBatch) {
+        largestPriceBatch = n;
+    }
+    for (int i = 0; i < n; ++i) {
+        prices[i] = simplePrice(basePrices[i], amounts[i]);
+    }
+}
+
+bool testBatchPrices() {
+    Matamazom byBatch = matamazomCreate();
+    Matamazom byFunction = matamazomCreate();
+    ASSERT_TEST(byBatch != NULL && byFunction != NULL);
+    largestPriceBatch = 0;
+    double basePrice = 0.1;
+    bool added = mtmNewProductWithBatchPrice(byBatch, 1, "Line", 10,
+                                             MATAMAZOM_ANY_AMOUNT, &basePrice,
+                                             copyDouble, freeDouble,
+                                             NULL) == MATAMAZOM_NULL_ARGUMENT;
+    for (unsigned int id = 1; id <= 100; ++id) {
+        basePrice = 0.1 * id;
+        added = added &&
+                mtmNewProductWithBatchPrice(byBatch, id, "Line", 1000,
+                                            MATAMAZOM_ANY_AMOUNT, &basePrice,
+                                            copyDouble, freeDouble,
+                                            batchPrices) == MATAMAZOM_SUCCESS &&
+                mtmNewProduct(byFunction, id, "Line", 1000, MATAMAZOM_ANY_AMOUNT,
+                              &basePrice, copyDouble, freeDouble,
+                              simplePrice) == MATAMAZOM_SUCCESS;
+    }
+    /* the lines of an order, and of orders shipped together, are priced
+     * together */
+    unsigned int batchOrders[2];
+    unsigned int functionOrders[2];
+    for (int i = 0; i < 2; ++i) {
+        batchOrders[i] = mtmCreateNewOrder(byBatch);
+        functionOrders[i] = mtmCreateNewOrder(byFunction);
+        for (unsigned int id = i + 1; id <= 100; ++id) {
+            mtmChangeProductAmountInOrder(byBatch, batchOrders[i], id, 0.5 * id);
+            mtmChangeProductAmountInOrder(byFunction, functionOrders[i], id,
+                                          0.5 * id);
+        }
+    }
+    FILE *batchOutput = tmpfile();
+    FILE *functionOutput = tmpfile();
+    assert(batchOutput && functionOutput);
+    largestPriceBatch = 0;
+    mtmInvalidatePrices(byBatch, 1);
+    mtmPrintOrder(byBatch, batchOrders[0], batchOutput);
+    mtmPrintOrder(byFunction, functionOrders[0], functionOutput);
+    bool batchedTotal = largestPriceBatch == 64;
+    largestPriceBatch = 0;
+    MatamazomResult results[2];
+    mtmShipOrders(byBatch, batchOrders, 2, results);
+    mtmShipOrders(byFunction, functionOrders, 2, results);
+    bool batchedIncomes = largestPriceBatch == 64;
+    mtmPrintBestSelling(byBatch, batchOutput);
+    mtmPrintBestSelling(byFunction, functionOutput);
+    bool samePrices = streamsEqual(batchOutput, functionOutput);
+    fclose(batchOutput);
+    fclose(functionOutput);
+    matamazomDestroy(byFunction);
+    matamazomDestroy(byBatch);
+    ASSERT_TEST(added);
+    ASSERT_TEST(batchedTotal);
+    ASSERT_TEST(batchedIncomes);
+    ASSERT_TEST(samePrices);
+    return true;
+}
+
+bool testMaintainedOrderTotals() {
+    Matamazom mtm = matamazomCreate();
+    ASSERT_TEST(mtm != NULL);
+    double basePrice = 2;
+    priceFactor = 1;
+    mtmNewProduct(mtm, 1, "Milk", 100, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, factoredPrice);
+    mtmNewProduct(mtm, 2, "Onion", 100, MATAMAZOM_ANY_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, buy10Get10ForFree);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    double total;
+    /* every change adds the difference of the prices of the line */
+    mtmChangeProductAmountInOrder(mtm, order, 1, 3);
+    mtmChangeProductAmountInOrder(mtm, order, 2, 12.5);
+    mtmChangeProductAmountInOrder(mtm, order, 1, 2);
+    mtmChangeProductAmountInOrder(mtm, order, 2, 10);
+    ASSERT_OR_DESTROY(mtmGetOrderTotal(mtm, order, &total) == MATAMAZOM_SUCCESS);
+    ASSERT_OR_DESTROY(total == 10 + 2 * 12.5);
+    mtmChangeProductAmountInOrder(mtm, order, 2, -22.5);
+    mtmGetOrderTotal(mtm, order, &total);
+    ASSERT_OR_DESTROY(total == 10);
+    /* the total is kept until the prices are invalidated */
+    priceFactor = 3;
+    mtmGetOrderTotal(mtm, order, &total);
+    ASSERT_OR_DESTROY(total == 10);
+    mtmInvalidatePrices(mtm, 1);
+    mtmGetOrderTotal(mtm, order, &total);
+    ASSERT_OR_DESTROY(total == 30);
+    priceFactor = 1;
+    mtmChangeProductAmountInOrder(mtm, order, 2, 1);
+    mtmClearProduct(mtm, 1);
+    mtmGetOrderTotal(mtm, order, &total);
+    ASSERT_OR_DESTROY(total == 2);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testInlineData() {
+    Matamazom inlined = matamazomCreateWithMode(MATAMAZOM_CONCURRENT);
+    Matamazom allocated = matamazomCreateWithMode(MATAMAZOM_CONCURRENT);
+    ASSERT_TEST(inlined != NULL && allocated != NULL);
+    double basePrice = 2.5;
+    char largeData[MTM_INLINE_DATA_SIZE + 1] = {0};
+    bool added =
+        mtmNewProductWithInlineData(inlined, 1, "Bread", 10,
+                                    MATAMAZOM_INTEGER_AMOUNT, NULL,
+                                    sizeof(basePrice),
+                                    simplePrice) == MATAMAZOM_NULL_ARGUMENT &&
+        mtmNewProductWithInlineData(inlined, 1, "Bread", 10,
+                                    MATAMAZOM_INTEGER_AMOUNT, largeData,
+                                    sizeof(largeData),
+                                    simplePrice) == MATAMAZOM_INVALID_DATA_SIZE &&
+        mtmNewProductWithInlineData(inlined, 1, "Bread", 10,
+                                    MATAMAZOM_INTEGER_AMOUNT, &basePrice, 0,
+                                    simplePrice) == MATAMAZOM_INVALID_DATA_SIZE &&
+        mtmNewProductWithInlineData(inlined, 1, "Bread", 10,
+                                    MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                                    sizeof(basePrice),
+                                    simplePrice) == MATAMAZOM_SUCCESS &&
+        mtmNewProduct(allocated, 1, "Bread", 10, MATAMAZOM_INTEGER_AMOUNT,
+                      &basePrice, copyDouble, freeDouble,
+                      simplePrice) == MATAMAZOM_SUCCESS;
+    /* the data is copied on adding, and with every copy of the product */
+    basePrice = 100;
+    FILE *inlinedOutput = tmpfile();
+    FILE *allocatedOutput = tmpfile();
+    assert(inlinedOutput && allocatedOutput);
+    unsigned int inlinedOrder = mtmCreateNewOrder(inlined);
+    unsigned int allocatedOrder = mtmCreateNewOrder(allocated);
+    mtmChangeProductAmountInOrder(inlined, inlinedOrder, 1, 4);
+    mtmChangeProductAmountInOrder(allocated, allocatedOrder, 1, 4);
+    mtmPrintOrder(inlined, inlinedOrder, inlinedOutput);
+    mtmPrintOrder(allocated, allocatedOrder, allocatedOutput);
+    mtmShipOrder(inlined, inlinedOrder);
+    mtmShipOrder(allocated, allocatedOrder);
+    mtmPrintInventory(inlined, inlinedOutput);
+    mtmPrintInventory(allocated, allocatedOutput);
+    mtmPrintBestSelling(inlined, inlinedOutput);
+    mtmPrintBestSelling(allocated, allocatedOutput);
+    bool sameOutput = streamsEqual(inlinedOutput, allocatedOutput);
+    fclose(inlinedOutput);
+    fclose(allocatedOutput);
+    matamazomDestroy(allocated);
+    matamazomDestroy(inlined);
+    ASSERT_TEST(added);
+    ASSERT_TEST(sameOutput);
+    return true;
+}
+
+static void printAllReports(Matamazom mtm, const unsigned int *orders,
+                            FILE *output) {
+    mtmPrintInventory(mtm, output);
+    mtmPrintOrder(mtm, orders[0], output);
+    mtmPrintOrder(mtm, orders[1], output);
+    mtmPrintBestSelling(mtm, output);
+    mtmPrintFiltered(mtm, acceptAll, output);
+}
+
+static void printAllVersionReports(MatamazomVersion version,
+                                   const unsigned int *orders, FILE *output) {
+    mtmVersionPrintInventory(version, output);
+    mtmVersionPrintOrder(version, orders[0], output);
+    mtmVersionPrintOrder(version, orders[1], output);
+    mtmVersionPrintBestSelling(version, output);
+    mtmVersionPrintFiltered(version, acceptAll, output);
+}
+
+typedef struct {
+    MatamazomVersion version;
+    const unsigned int *orders;
+    FILE *output;
+} VersionReportArgs;
+
+static void *printVersionReports(void *arg) {
+    VersionReportArgs *args = arg;
+    printAllVersionReports(args->version, args->orders, args->output);
+    return NULL;
+}
+
+static bool versionKeepsReports(const unsigned int mode) {
+    Matamazom mtm = matamazomCreateWithMode(mode);
+    double basePrice = 1.5;
+    for (unsigned int id = 1; id <= 40; ++id) {
+        mtmNewProduct(mtm, id, "Item", 100, MATAMAZOM_ANY_AMOUNT, &basePrice,
+                      copyDouble, freeDouble, simplePrice);
+    }
+    unsigned int orders[2];
+    for (int i = 0; i < 2; ++i) {
+        orders[i] = mtmCreateNewOrder(mtm);
+        for (unsigned int id = i + 1; id <= 40; id += 3) {
+            mtmChangeProductAmountInOrder(mtm, orders[i], id, id);
+        }
+    }
+    mtmShipOrder(mtm, mtmCreateNewOrder(mtm));
+    FILE *before = tmpfile();
+    FILE *asOf = tmpfile();
+    assert(before && asOf);
+    printAllReports(mtm, orders, before);
+    MatamazomVersion version = mtmCaptureVersion(mtm);
+    bool captured = version != NULL;
+    /* the warehouse goes on changing after the version is captured, while the
+     * version is printed if the warehouse is concurrent */
+    VersionReportArgs args = {version, orders, asOf};
+    pthread_t reporter;
+    bool concurrent = (mode & MATAMAZOM_CONCURRENT) != 0 &&
+                      pthread_create(&reporter, NULL, printVersionReports,
+                                     &args) == 0;
+    mtmChangeProductAmount(mtm, 5, 20);
+    mtmChangeProductAmountInOrder(mtm, orders[1], 2, 1);
+    mtmShipOrder(mtm, orders[0]);
+    mtmClearProduct(mtm, 7);
+    mtmNewProduct(mtm, 41, "Late", 1, MATAMAZOM_ANY_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    if (concurrent) {
+        pthread_join(reporter, NULL);
+    } else {
+        printAllVersionReports(version, orders, asOf);
+    }
+    bool missingOrder = mtmVersionPrintOrder(version, 100, asOf) ==
+                        MATAMAZOM_ORDER_NOT_EXIST;
+    bool sameReports = streamsEqual(before, asOf);
+    fclose(before);
+    fclose(asOf);
+    mtmVersionDestroy(version);
+    matamazomDestroy(mtm);
+    return captured && missingOrder && sameReports;
+}
+
+static int dataCopied = 0;
+
+static MtmProductData countedCopyDouble(MtmProductData number) {
+    dataCopied++;
+    return copyDouble(number);
+}
+
+static double amountSeen = -1;
+
+static bool seeAmountOfFirst(const unsigned int id, const char *name,
+                             const double amount, MtmProductData customData) {
+    if (id == 1) {
+        amountSeen = amount;
+    }
+    return false;
+}
+
+static double amountInVersion(MatamazomVersion version) {
+    amountSeen = -1;
+    mtmVersionPrintFiltered(version, seeAmountOfFirst, stdout);
+    return amountSeen;
+}
+
+static bool versionSharesProducts(const unsigned int mode) {
+    Matamazom mtm = matamazomCreateWithMode(mode);
+    double basePrice = 1;
+    for (unsigned int id = 1; id <= 2000; ++id) {
+        mtmNewProduct(mtm, id, "Item", 10, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                      countedCopyDouble, freeDouble, simplePrice);
+    }
+    /* versions share the products with the warehouse, and only take what
+     * changed since the last version */
+    dataCopied = 0;
+    MatamazomVersion first = mtmCaptureVersion(mtm);
+    bool noCopies = dataCopied == 0;
+    mtmChangeProductAmount(mtm, 1, 5);
+    MatamazomVersion second = mtmCaptureVersion(mtm);
+    noCopies = noCopies && dataCopied == 0;
+    bool bothKept = first && second && amountInVersion(first) == 10 &&
+                    amountInVersion(second) == 15;
+    mtmVersionDestroy(first);
+    mtmVersionDestroy(second);
+    matamazomDestroy(mtm);
+    return noCopies && bothKept;
+}
+
+bool testVersions() {
+    ASSERT_TEST(mtmCaptureVersion(NULL) == NULL);
+    ASSERT_TEST(mtmVersionPrintInventory(NULL, stdout) == MATAMAZOM_NULL_ARGUMENT);
+    ASSERT_TEST(versionKeepsReports(MATAMAZOM_DEFAULT_MODE));
+    ASSERT_TEST(versionKeepsReports(MATAMAZOM_CONCURRENT));
+    ASSERT_TEST(versionKeepsReports(MATAMAZOM_SHARDED | MATAMAZOM_RESERVE_STOCK));
+    ASSERT_TEST(versionSharesProducts(MATAMAZOM_DEFAULT_MODE));
+    ASSERT_TEST(versionSharesProducts(MATAMAZOM_SHARDED));
+    return true;
+}
+
+bool testChangeFeed() {
+    Matamazom mtm = matamazomCreateWithMode(MATAMAZOM_CONCURRENT);
+    ASSERT_TEST(mtm != NULL);
+    ASSERT_TEST(mtmSubscribe(mtm) == NULL);
+    ASSERT_TEST(mtmEnableChangeFeed(mtm, 0) == MATAMAZOM_INVALID_AMOUNT);
+    ASSERT_TEST(mtmEnableChangeFeed(mtm, 8) == MATAMAZOM_SUCCESS);
+    double basePrice = 2;
+    MtmEvent events[16];
+    int number = 0;
+    /* changes made before subscribing are not received */
+    mtmNewProduct(mtm, 1, "Milk", 10, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    MatamazomSubscriber subscriber = mtmSubscribe(mtm);
+    ASSERT_TEST(subscriber != NULL);
+    ASSERT_TEST(mtmPollEvents(subscriber, NULL, 16, &number) == MATAMAZOM_NULL_ARGUMENT);
+    mtmNewProduct(mtm, 2, "Eggs", 12, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order, 1, 3);
+    mtmChangeProductAmountInOrder(mtm, order, 1, 7.5);
+    mtmChangeProductAmount(mtm, 2, -2);
+    mtmShipOrder(mtm, order);
+    ASSERT_TEST(mtmPollEvents(subscriber, events, 16, &number) == MATAMAZOM_SUCCESS);
+    MtmEventType types[] = {MTM_EVENT_PRODUCT_CREATED, MTM_EVENT_ORDER_CREATED,
+                            MTM_EVENT_LINE_CHANGED, MTM_EVENT_STOCK_CHANGED,
+                            MTM_EVENT_STOCK_CHANGED, MTM_EVENT_ORDER_SHIPPED};
+    double amounts[] = {12, 0, 3, -2, -3, 0};
+    ASSERT_TEST(number == 6);
+    for (int i = 0; i < number; i++) {
+        ASSERT_TEST(events[i].sequence == (unsigned long long)i + 1);
+        ASSERT_TEST(events[i].type == types[i] && events[i].amount == amounts[i]);
+    }
+    ASSERT_TEST(events[2].orderId == order && events[2].productId == 1);
+    ASSERT_TEST(mtmPollEvents(subscriber, events, 16, &number) == MATAMAZOM_SUCCESS &&
+                number == 0);
+    /* a subscriber that falls behind is told, and goes on from the oldest kept
+     * event */
+    for (int i = 0; i < 10; i++) {
+        mtmCancelOrder(mtm, mtmCreateNewOrder(mtm));
+    }
+    mtmClearProduct(mtm, 1);
+    ASSERT_TEST(mtmPollEvents(subscriber, events, 16, &number) == MATAMAZOM_EVENTS_LOST &&
+                number == 0);
+    ASSERT_TEST(mtmPollEvents(subscriber, events, 5, &number) == MATAMAZOM_SUCCESS &&
+                number == 5 && events[0].sequence == 20);
+    ASSERT_TEST(mtmPollEvents(subscriber, events, 16, &number) == MATAMAZOM_SUCCESS &&
+                number == 3 && events[2].type == MTM_EVENT_PRODUCT_CLEARED &&
+                events[2].productId == 1);
+    mtmUnsubscribe(subscriber);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool clearReachesOrders(const unsigned int mode) {
+    Matamazom mtm = matamazomCreateWithMode(mode);
+    ASSERT_TEST(mtm != NULL);
+    double basePrice = 2;
+    mtmNewProduct(mtm, 1, "Old", 100, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    mtmNewProduct(mtm, 2, "New", 100, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    unsigned int orders[20];
+    for (int i = 0; i < 20; i++) {
+        orders[i] = mtmCreateNewOrder(mtm);
+        mtmChangeProductAmountInOrder(mtm, orders[i], 2, 1);
+    }
+    /* the product leaves orders that are emptied, shipped and canceled */
+    int withOld[] = {3, 7, 11, 15, 19};
+    for (int i = 0; i < 5; i++) {
+        mtmChangeProductAmountInOrder(mtm, orders[withOld[i]], 1, 2);
+    }
+    mtmChangeProductAmountInOrder(mtm, orders[3], 1, -2);
+    mtmShipOrder(mtm, orders[7]);
+    mtmCancelOrder(mtm, orders[11]);
+    ASSERT_TEST(mtmClearProduct(mtm, 1) == MATAMAZOM_SUCCESS);
+    ASSERT_TEST(mtmClearProduct(mtm, 1) == MATAMAZOM_PRODUCT_NOT_EXIST);
+    double total = 0;
+    for (int i = 0; i < 20; i++) {
+        if (i != 7 && i != 11) {
+            ASSERT_TEST(mtmGetOrderTotal(mtm, orders[i], &total) == MATAMAZOM_SUCCESS &&
+                        total == 2);
+        }
+    }
+    ASSERT_TEST(mtmChangeProductAmountInOrder(mtm, orders[15], 1, 1) ==
+                MATAMAZOM_PRODUCT_NOT_EXIST);
+    ASSERT_TEST(mtmShipOrder(mtm, orders[19]) == MATAMAZOM_SUCCESS);
+    /* a product added again starts with no orders */
+    mtmNewProduct(mtm, 1, "Old", 100, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    mtmChangeProductAmountInOrder(mtm, orders[15], 1, 3);
+    ASSERT_TEST(mtmClearProduct(mtm, 1) == MATAMAZOM_SUCCESS);
+    ASSERT_TEST(mtmGetOrderTotal(mtm, orders[15], &total) == MATAMAZOM_SUCCESS &&
+                total == 2);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testClearProductOrders() {
+    ASSERT_TEST(clearReachesOrders(MATAMAZOM_DEFAULT_MODE));
+    ASSERT_TEST(clearReachesOrders(MATAMAZOM_CONCURRENT));
+    ASSERT_TEST(clearReachesOrders(MATAMAZOM_SHARDED | MATAMAZOM_RESERVE_STOCK));
+    return true;
+}
+
+static bool isInCategory(const unsigned int id, const char *name, const double amount,
+                         MtmProductData customData) {
+    return id >= 200 && id <= 299;
+}
+
+static bool rangeMatchesFilter(const unsigned int mode) {
+    Matamazom mtm = matamazomCreateWithMode(mode);
+    ASSERT_TEST(mtm != NULL);
+    double basePrice = 1.5;
+    for (unsigned int id = 1; id <= 500; id += 7) {
+        mtmNewProduct(mtm, id, "Item", id % 13, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                      copyDouble, freeDouble, simplePrice);
+    }
+    mtmNewProduct(mtm, 200, "First", 1, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    mtmNewProduct(mtm, 299, "Last", 1, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    FILE *ranged = tmpfile();
+    FILE *filtered = tmpfile();
+    assert(ranged && filtered);
+    ASSERT_TEST(mtmPrintInventoryRange(mtm, 200, 299, NULL) == MATAMAZOM_NULL_ARGUMENT);
+    ASSERT_TEST(mtmPrintInventoryRange(mtm, 200, 299, ranged) == MATAMAZOM_SUCCESS);
+    fprintf(filtered, "Inventory Status:\n");
+    mtmPrintFiltered(mtm, isInCategory, filtered);
+    bool same = streamsEqual(ranged, filtered);
+    /* the cursor keeps the products as they were when it was created */
+    MatamazomProductCursor cursor = mtmProductCursorCreate(mtm, 200, 299);
+    ASSERT_TEST(cursor != NULL);
+    mtmClearProduct(mtm, 299);
+    mtmChangeProductAmount(mtm, 200, 4);
+    MtmProductInfo info;
+    int products = 0;
+    unsigned int lastId = 0;
+    bool ordered = true;
+    while (mtmProductCursorNext(cursor, &info)) {
+        ordered = ordered && info.id >= 200 && info.id <= 299 && info.id > lastId;
+        ordered = ordered && (info.id != 200 || info.amount == 1);
+        lastId = info.id;
+        products++;
+    }
+    mtmProductCursorDestroy(cursor);
+    /* 204, 211, ..., 295 and the two added products */
+    ASSERT_TEST(products == 16 && lastId == 299 && ordered);
+    cursor = mtmProductCursorCreate(mtm, 300, 299);
+    ASSERT_TEST(cursor != NULL && !mtmProductCursorNext(cursor, &info));
+    mtmProductCursorDestroy(cursor);
+    fclose(ranged);
+    fclose(filtered);
+    matamazomDestroy(mtm);
+    return same;
+}
+
+bool testInventoryRange() {
+    ASSERT_TEST(mtmProductCursorCreate(NULL, 0, 10) == NULL);
+    ASSERT_TEST(rangeMatchesFilter(MATAMAZOM_DEFAULT_MODE));
+    ASSERT_TEST(rangeMatchesFilter(MATAMAZOM_CONCURRENT));
+    ASSERT_TEST(rangeMatchesFilter(MATAMAZOM_SHARDED));
+    return true;
+}
@@ -11,5 +11,29 @@ bool testPrintInventory();
 bool testPrintOrder();
 bool testPrintBestSelling();
 bool testPrintFiltered();
+bool testReserveStock();
+bool testShipOrders();
+bool testConcurrentAmountChanges();
+bool testConcurrentStress();
+bool testShardedStress();
+bool testShardedReports();
+bool testConcurrentCarts();
+bool testReportSnapshots();
+bool testPrintFilteredParallel();
+bool testOrderTotals();
+bool testAsyncQueue();
+bool testCoalescingQueue();
+bool testExactAmounts();
+bool testAmountValidation();
+bool testPriceCache();
+bool testUnitPrices();
+bool testPriceRules();
+bool testBatchPrices();
+bool testMaintainedOrderTotals();
+bool testInlineData();
+bool testVersions();
+bool testChangeFeed();
+bool testClearProductOrders();
+bool testInventoryRange();
 
 #endif /* MATAMAZOM_TESTS_H_ */